@@ -0,0 +1,86 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include <benchmark/benchmark.h>
+#include <uorb/abs_time.h>
+#include <uorb/topics/orb_test.h>
+#include <uorb/uorb.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// Time from orb_publish() until a thread blocked in orb_poll() has copied
+// the message. Measured as half of a ping-pong round trip between two
+// threads, on instance 0 (ping) and instance 1 (pong) of orb_multitest.
+static void BM_PollWakeLatency(benchmark::State &state) {
+  const auto meta = ORB_ID(orb_multitest);
+  orb_test_s data{};
+
+  unsigned ping_instance, pong_instance;
+  auto ping_pub = orb_create_publication_multi(meta, &ping_instance);
+  auto pong_pub = orb_create_publication_multi(meta, &pong_instance);
+  auto ping_sub = orb_create_subscription_multi(meta, ping_instance);
+  auto pong_sub = orb_create_subscription_multi(meta, pong_instance);
+
+  // Skip the messages of a previous run
+  orb_check_and_copy(ping_sub, &data);
+  orb_check_and_copy(pong_sub, &data);
+
+  std::atomic<bool> should_exit{false};
+  std::thread responder([&] {
+    orb_test_s message{};
+    orb_pollfd_t fds[1]{};
+    fds[0].fd = ping_sub;
+    fds[0].events = POLLIN;
+    while (!should_exit) {
+      if (orb_poll(fds, 1, 100) > 0 && orb_copy(ping_sub, &message)) {
+        orb_publish(pong_pub, &message);
+      }
+    }
+  });
+
+  orb_pollfd_t fds[1]{};
+  fds[0].fd = pong_sub;
+  fds[0].events = POLLIN;
+  for (auto _ : state) {
+    auto start = std::chrono::steady_clock::now();
+    orb_publish(ping_pub, &data);
+    if (orb_poll(fds, 1, 1000) <= 0) {
+      state.SkipWithError("Poll timeout");
+      break;
+    }
+    orb_copy(pong_sub, &data);
+    std::chrono::duration<double> round_trip =
+        std::chrono::steady_clock::now() - start;
+    state.SetIterationTime(round_trip.count() / 2);
+  }
+
+  should_exit = true;
+  responder.join();
+  orb_destroy_subscription(&ping_sub);
+  orb_destroy_subscription(&pong_sub);
+  orb_destroy_publication(&ping_pub);
+  orb_destroy_publication(&pong_pub);
+}
+BENCHMARK(BM_PollWakeLatency)->UseManualTime();
+
+// orb_poll() on a topic that already has an update, no waiting
+static void BM_PollReady(benchmark::State &state) {
+  const auto meta = ORB_ID(orb_test);
+  orb_test_s data{};
+  auto pub = orb_create_publication(meta);
+  auto sub = orb_create_subscription(meta);
+  orb_publish(pub, &data);
+
+  orb_pollfd_t fds[1]{};
+  fds[0].fd = sub;
+  fds[0].events = POLLIN;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(orb_poll(fds, 1, 0));
+  }
+
+  orb_destroy_subscription(&sub);
+  orb_destroy_publication(&pub);
+}
+BENCHMARK(BM_PollReady);
@@ -0,0 +1,165 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include <benchmark/benchmark.h>
+#include <uorb/topics/orb_test.h>
+#include <uorb/topics/orb_test_large.h>
+#include <uorb/topics/orb_test_medium.h>
+#include <uorb/uorb.h>
+
+#include <vector>
+
+// Publish and copy throughput for small (orb_test), medium (orb_test_medium)
+// and large (orb_test_large) messages.
+
+static void BM_Publish(benchmark::State &state, const orb_metadata *meta) {
+  std::vector<uint8_t> data(meta->o_size);
+  auto pub = orb_create_publication(meta);
+
+  for (auto _ : state) {
+    orb_publish(pub, data.data());
+  }
+
+  orb_destroy_publication(&pub);
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * meta->o_size);
+}
+BENCHMARK_CAPTURE(BM_Publish, small, ORB_ID(orb_test));
+BENCHMARK_CAPTURE(BM_Publish, medium, ORB_ID(orb_test_medium));
+BENCHMARK_CAPTURE(BM_Publish, large, ORB_ID(orb_test_large));
+
+static void BM_PublishCopy(benchmark::State &state, const orb_metadata *meta) {
+  std::vector<uint8_t> data(meta->o_size);
+  auto pub = orb_create_publication(meta);
+  auto sub = orb_create_subscription(meta);
+
+  for (auto _ : state) {
+    orb_publish(pub, data.data());
+    orb_copy(sub, data.data());
+    benchmark::DoNotOptimize(data.data());
+  }
+
+  orb_destroy_subscription(&sub);
+  orb_destroy_publication(&pub);
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * meta->o_size);
+}
+BENCHMARK_CAPTURE(BM_PublishCopy, small, ORB_ID(orb_test));
+BENCHMARK_CAPTURE(BM_PublishCopy, medium, ORB_ID(orb_test_medium));
+BENCHMARK_CAPTURE(BM_PublishCopy, large, ORB_ID(orb_test_large));
+
+// Every thread publishes to the same topic
+static void BM_ConcurrentPublish(benchmark::State &state,
+                                 const orb_metadata *meta) {
+  std::vector<uint8_t> data(meta->o_size);
+  auto pub = orb_create_publication(meta);
+
+  for (auto _ : state) {
+    orb_publish(pub, data.data());
+  }
+
+  orb_destroy_publication(&pub);
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * meta->o_size);
+}
+BENCHMARK_CAPTURE(BM_ConcurrentPublish, small, ORB_ID(orb_test))
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+BENCHMARK_CAPTURE(BM_ConcurrentPublish, large, ORB_ID(orb_test_large))
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+// Every thread copies the same topic with its own subscription
+static void BM_ConcurrentCopy(benchmark::State &state,
+                              const orb_metadata *meta) {
+  std::vector<uint8_t> data(meta->o_size);
+  if (state.thread_index() == 0) {
+    auto pub = orb_create_publication(meta);
+    orb_publish(pub, data.data());
+    orb_destroy_publication(&pub);
+  }
+  auto sub = orb_create_subscription(meta);
+
+  for (auto _ : state) {
+    orb_copy(sub, data.data());
+    benchmark::DoNotOptimize(data.data());
+  }
+
+  orb_destroy_subscription(&sub);
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * meta->o_size);
+}
+BENCHMARK_CAPTURE(BM_ConcurrentCopy, small, ORB_ID(orb_test))
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+BENCHMARK_CAPTURE(BM_ConcurrentCopy, large, ORB_ID(orb_test_large))
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+// Thread 0 publishes, the other threads copy every update they see
+static void BM_PublishWithSubscribers(benchmark::State &state,
+                                      const orb_metadata *meta) {
+  std::vector<uint8_t> data(meta->o_size);
+  const bool publisher = state.thread_index() == 0;
+  auto pub = publisher ? orb_create_publication(meta) : nullptr;
+  auto sub = publisher ? nullptr : orb_create_subscription(meta);
+
+  int64_t copies = 0;
+  for (auto _ : state) {
+    if (publisher) {
+      orb_publish(pub, data.data());
+    } else if (orb_check_update(sub)) {
+      orb_copy(sub, data.data());
+      ++copies;
+    }
+  }
+
+  if (pub) orb_destroy_publication(&pub);
+  if (sub) orb_destroy_subscription(&sub);
+  if (publisher) {
+    state.SetItemsProcessed(state.iterations());
+  } else {
+    state.counters["copies"] =
+        benchmark::Counter(copies, benchmark::Counter::kIsRate);
+  }
+}
+BENCHMARK_CAPTURE(BM_PublishWithSubscribers, medium, ORB_ID(orb_test_medium))
+    ->DenseThreadRange(2, 8, 2)
+    ->UseRealTime();
+
+// A logger drains a burst of queued messages into records with a header, one
+// message per call (batch 1) or all of them at once with orb_copy_batch()
+static void BM_Drain(benchmark::State &state, const orb_metadata *meta) {
+  const unsigned burst = 64;
+  const unsigned batch = state.range(0);
+  const size_t record_size = 16 + meta->o_size;
+  std::vector<uint8_t> data(meta->o_size);
+  std::vector<uint8_t> records(burst * record_size);
+  std::vector<orb_copy_info> infos(burst);
+  auto pub = orb_create_publication(meta);
+  auto sub = orb_create_subscription(meta);
+  orb_set_subscription_queue_size(sub, burst);
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    for (unsigned i = 0; i < burst; ++i) orb_publish(pub, data.data());
+    state.ResumeTiming();
+
+    if (batch == 1) {
+      for (unsigned i = 0; orb_check_update(sub); ++i) {
+        orb_copy_ex(sub, &records[i * record_size + 16], &infos[i]);
+      }
+    } else {
+      orb_copy_batch(sub, &records[16], record_size, burst, infos.data());
+    }
+    benchmark::DoNotOptimize(records.data());
+  }
+
+  orb_destroy_subscription(&sub);
+  orb_destroy_publication(&pub);
+  state.SetItemsProcessed(state.iterations() * burst);
+  state.SetBytesProcessed(state.iterations() * burst * meta->o_size);
+}
+BENCHMARK_CAPTURE(BM_Drain, small, ORB_ID(orb_test))->Arg(1)->Arg(64);
+BENCHMARK_CAPTURE(BM_Drain, medium, ORB_ID(orb_test_medium))->Arg(1)->Arg(64);
+BENCHMARK_CAPTURE(BM_Drain, large, ORB_ID(orb_test_large))->Arg(1)->Arg(64);
@@ -0,0 +1,46 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include <benchmark/benchmark.h>
+#include <uorb/abs_time.h>
+#include <uorb/publication.h>
+#include <uorb/subscription_interval.h>
+#include <uorb/topics/orb_test_medium.h>
+
+// Cost of reading the time with each clock source, and of checking a
+// SubscriptionInterval that has no update to copy yet.
+
+static void BM_AbsoluteTime(benchmark::State &state,
+                            orb_clock_source source) {
+  if (!orb_set_clock_source(source)) {
+    state.SkipWithError("Clock source not supported");
+    return;
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(orb_absolute_time_us());
+  }
+  orb_set_clock_source(ORB_CLOCK_MONOTONIC);
+}
+BENCHMARK_CAPTURE(BM_AbsoluteTime, monotonic, ORB_CLOCK_MONOTONIC);
+BENCHMARK_CAPTURE(BM_AbsoluteTime, monotonic_coarse,
+                  ORB_CLOCK_MONOTONIC_COARSE);
+BENCHMARK_CAPTURE(BM_AbsoluteTime, tsc, ORB_CLOCK_TSC);
+
+static void BM_SubscriptionIntervalUpdated(benchmark::State &state,
+                                           bool use_publish_time) {
+  uorb::PublicationData<uorb::msg::orb_test_medium_interval> pub;
+  uorb::SubscriptionInterval<uorb::msg::orb_test_medium_interval> sub(
+      1000 * 1000);
+  sub.set_use_publish_time(use_publish_time);
+  orb_test_medium_s data{};
+  pub.Publish();
+  sub.Update(&data);
+
+  // Within the interval: checked on every call, never copied
+  pub.Publish();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sub.Updated());
+  }
+}
+BENCHMARK_CAPTURE(BM_SubscriptionIntervalUpdated, clock, false);
+BENCHMARK_CAPTURE(BM_SubscriptionIntervalUpdated, publish_time, true);
@@ -0,0 +1,70 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include <benchmark/benchmark.h>
+#include <uorb/uorb.h>
+
+#include <deque>
+#include <string>
+
+// Cost of creating publications and subscriptions depending on the number of
+// topics that exist. The topics are generated at runtime; like every topic,
+// they are never deleted.
+
+static std::deque<std::string> topic_names;
+static std::deque<orb_metadata> topic_metas;
+
+// The n-th newest topic: device nodes are looked up from the newest one, so a
+// lookup of this topic walks n device nodes.
+static const orb_metadata *GetTopic(size_t n) {
+  while (topic_metas.size() < n) {
+    topic_names.push_back("benchmark_topic_" +
+                          std::to_string(topic_metas.size()));
+    topic_metas.push_back(orb_metadata{
+        ORB_METADATA_ABI_VERSION, topic_names.back().c_str(), 16, 16,
+        "uint64_t timestamp;uint64_t val;", 1, 0});
+
+    // Create the device node
+    auto pub = orb_create_publication(&topic_metas.back());
+    orb_destroy_publication(&pub);
+  }
+  return &topic_metas[topic_metas.size() - n];
+}
+
+static void BM_CreatePublication(benchmark::State &state) {
+  const auto meta = GetTopic(state.range(0));
+
+  for (auto _ : state) {
+    auto pub = orb_create_publication(meta);
+    orb_destroy_publication(&pub);
+  }
+  state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_CreatePublication)
+    ->RangeMultiplier(4)
+    ->Range(1, 4096)
+    ->Complexity();
+
+static void BM_CreateSubscription(benchmark::State &state) {
+  const auto meta = GetTopic(state.range(0));
+
+  for (auto _ : state) {
+    auto sub = orb_create_subscription(meta);
+    orb_destroy_subscription(&sub);
+  }
+  state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_CreateSubscription)
+    ->RangeMultiplier(4)
+    ->Range(1, 4096)
+    ->Complexity();
+
+static void BM_Exists(benchmark::State &state) {
+  const auto meta = GetTopic(state.range(0));
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(orb_exists(meta, 0));
+  }
+  state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_Exists)->RangeMultiplier(4)->Range(1, 4096)->Complexity();
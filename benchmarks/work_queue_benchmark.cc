@@ -0,0 +1,129 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include <benchmark/benchmark.h>
+#include <uorb/publication.h>
+#include <uorb/subscription_callback.h>
+#include <uorb/topics/orb_test_medium.h>
+#include <uorb/work_queue.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Work queues by thread count, the names must outlive the queues
+static const uorb::WorkQueueConfig kBenchmarkQueues[] = {
+    {"wq:bench1", 0, 0, 1, uorb::WorkQueueConfig::kFixedPriority, 0},
+    {"wq:bench2", 0, 0, 2, uorb::WorkQueueConfig::kFixedPriority, 0},
+    {"wq:bench4", 0, 0, 4, uorb::WorkQueueConfig::kFixedPriority, 0},
+    {"wq:bench8", 0, 0, 8, uorb::WorkQueueConfig::kFixedPriority, 0},
+    {"wq:bench16", 0, 0, 16, uorb::WorkQueueConfig::kFixedPriority, 0},
+};
+
+static const uorb::WorkQueueConfig &BenchmarkQueue(unsigned thread_count) {
+  for (const auto &config : kBenchmarkQueues) {
+    if (config.thread_count >= thread_count) return config;
+  }
+  return kBenchmarkQueues[0];
+}
+
+namespace {
+
+// A consumer doing some CPU work with every message
+class FanOutItem : public uorb::WorkItem {
+ public:
+  FanOutItem(const uorb::WorkQueueConfig &config, std::atomic<int> *completed,
+             std::chrono::nanoseconds work)
+      : WorkItem(config), completed_(completed), work_(work) {}
+  ~FanOutItem() override {
+    sub_.UnregisterCallback();
+    ScheduleClear();
+  }
+
+  bool Init() { return sub_.RegisterCallback(); }
+
+ private:
+  void Run() override {
+    orb_test_medium_s data{};
+    while (sub_.Update(&data)) {
+      const auto end = std::chrono::steady_clock::now() + work_;
+      while (std::chrono::steady_clock::now() < end) {
+      }
+      ++*completed_;
+    }
+  }
+
+  std::atomic<int> *const completed_;
+  const std::chrono::nanoseconds work_;
+  uorb::SubscriptionCallbackWorkItem<uorb::msg::orb_test_medium_work_queue>
+      sub_{this};
+};
+
+}  // namespace
+
+// One publication handled by num_items independent work items, on a work
+// queue with state.range(0) threads
+static void FanOut(benchmark::State &state, int num_items,
+                   std::chrono::nanoseconds work) {
+  const auto &config = BenchmarkQueue(state.range(0));
+
+  std::atomic<int> completed{0};
+  std::vector<std::unique_ptr<FanOutItem>> items;
+  for (int i = 0; i < num_items; ++i) {
+    items.emplace_back(new FanOutItem(config, &completed, work));
+    if (!items.back()->Init()) {
+      state.SkipWithError("Can't register the callback");
+      return;
+    }
+  }
+
+  uorb::PublicationData<uorb::msg::orb_test_medium_work_queue> pub;
+  for (auto _ : state) {
+    completed = 0;
+    pub.Publish();
+    while (completed < num_items) std::this_thread::yield();
+  }
+
+  state.SetItemsProcessed(state.iterations() * num_items);
+  state.counters["threads"] = config.thread_count;
+}
+
+// 16 work items with 10 us of work each, scales with the cores
+static void BM_WorkQueueFanOut(benchmark::State &state) {
+  FanOut(state, 16, std::chrono::microseconds(10));
+}
+BENCHMARK(BM_WorkQueueFanOut)
+    ->RangeMultiplier(2)
+    ->Range(1, 16)
+    ->UseRealTime();
+
+// 64 work items without work: the cost of the queue itself, which the
+// threads share. Each thread pops its own items and only locks the other
+// queues when it has none left.
+static void BM_WorkQueueContention(benchmark::State &state) {
+  FanOut(state, 64, std::chrono::nanoseconds(0));
+}
+BENCHMARK(BM_WorkQueueContention)
+    ->RangeMultiplier(2)
+    ->Range(1, 16)
+    ->UseRealTime();
+
+// ScheduleNow() until Run(), on an idle single thread queue
+static void BM_WorkQueueScheduleLatency(benchmark::State &state) {
+  struct SignalItem : uorb::WorkItem {
+    SignalItem() : WorkItem(BenchmarkQueue(1)) {}
+    ~SignalItem() override { ScheduleClear(); }
+    void Run() override { done = true; }
+    std::atomic<bool> done{false};
+  };
+
+  SignalItem item;
+  for (auto _ : state) {
+    item.done = false;
+    item.ScheduleNow();
+    while (!item.done) std::this_thread::yield();
+  }
+}
+BENCHMARK(BM_WorkQueueScheduleLatency)->UseRealTime();
@@ -0,0 +1,342 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+
+// End-to-end latency of uorb: a publisher thread stamps orb_absolute_time_us()
+// into every message and subscriber threads measure how late they receive it.
+// Used to evaluate kernel and configuration changes, e.g.:
+//
+//   uorb_example_latency -n 1000000 -r 10000 -s 4 -p 2 -c 3,4,5,6 -f 80
+
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "slog.h"
+#include "uorb/abs_time.h"
+#include "uorb/publication.h"
+#include "uorb/subscription.h"
+#include "uorb/subscription_callback.h"
+#include "uorb/subscription_interval.h"
+#include "uorb/topics/latency_probe.h"
+#include "uorb/work_queue.h"
+
+enum class Mode { kPoll, kInterval, kCallback };
+static const char *const kModeNames[] = {"poll", "interval", "callback"};
+
+struct Options {
+  uint64_t samples{1000000};
+  unsigned rate_hz{10000};  // 0: publish as fast as possible
+  unsigned subscribers{1};
+  Mode mode{Mode::kPoll};
+  uint32_t interval_us{1000};  // Mode::kInterval
+  int publisher_cpu{-1};
+  std::vector<int> subscriber_cpus;
+  int fifo_priority{0};  // 0: keep the default scheduling policy
+};
+
+struct SubscriberResult {
+  std::vector<uint32_t> latencies_us;
+  uint64_t lost{0};
+};
+
+// Sleep of Mode::kInterval while the interval has not elapsed yet, in us
+static constexpr unsigned kIntervalBackoff = 50;
+
+static std::atomic<unsigned> subscribers_ready{0};
+static std::atomic<bool> publishing_done{false};
+
+static void SetupThread(const char *name, int cpu, int fifo_priority) {
+  if (cpu >= 0) {
+#ifdef __linux__
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    int ret =
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    if (ret) {
+      LOGGER_WARN("%s: can't run on cpu %d: %s", name, cpu, strerror(ret));
+    }
+#else
+    LOGGER_WARN("%s: CPU pinning is only supported on Linux", name);
+#endif
+  }
+
+  if (fifo_priority > 0) {
+    sched_param param{};
+    param.sched_priority = fifo_priority;
+    int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (ret) LOGGER_WARN("%s: can't use SCHED_FIFO: %s", name, strerror(ret));
+  }
+}
+
+static void Publisher(const Options &options) {
+  SetupThread("publisher", options.publisher_cpu, options.fifo_priority);
+
+  uorb::PublicationData<uorb::msg::latency_probe> pub;
+  while (subscribers_ready < options.subscribers) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  const auto period = std::chrono::nanoseconds(
+      options.rate_hz ? 1000000000 / options.rate_hz : 0);
+  auto next_publish = std::chrono::steady_clock::now();
+  for (uint64_t sequence = 0; sequence < options.samples; ++sequence) {
+    if (options.rate_hz) {
+      std::this_thread::sleep_until(next_publish);
+      next_publish += period;
+    }
+
+    auto &data = pub.get();
+    data.sequence = sequence;
+    data.timestamp = orb_absolute_time_us();
+    if (!pub.Publish()) LOGGER_ERROR("Publish error");
+  }
+
+  publishing_done = true;
+}
+
+// Mode::kCallback: copies the messages in a work queue thread shared by all
+// subscribers
+class LatencyWorkItem : public uorb::WorkItem {
+ public:
+  LatencyWorkItem(const uorb::WorkQueueConfig &config,
+                  SubscriberResult *result)
+      : WorkItem(config), result_(result) {}
+  ~LatencyWorkItem() override {
+    sub_.UnregisterCallback();
+    ScheduleClear();
+  }
+
+  bool Init() { return sub_.RegisterCallback(); }
+
+ private:
+  void Run() override {
+    latency_probe_s data{};
+    orb_copy_info info{};
+    while (sub_.Update(&data, &info)) {
+      result_->lost += info.lost;
+      result_->latencies_us.push_back(orb_elapsed_time_us(data.timestamp));
+    }
+  }
+
+  SubscriberResult *const result_;
+  uorb::SubscriptionCallbackWorkItem<uorb::msg::latency_probe> sub_{this};
+};
+
+static void CallbackSubscriber(const Options &options,
+                               SubscriberResult *result) {
+  uint64_t cpu_affinity = 0;
+  for (auto cpu : options.subscriber_cpus) {
+    if (cpu >= 0 && cpu < 64) cpu_affinity |= 1ULL << cpu;
+  }
+  const uorb::WorkQueueConfig config{"wq:latency",
+                                     options.fifo_priority,
+                                     0,
+                                     1,
+                                     uorb::WorkQueueConfig::kFixedPriority,
+                                     cpu_affinity};
+  LatencyWorkItem work_item(config, result);
+  result->latencies_us.reserve(options.samples);
+  if (!work_item.Init()) {
+    LOGGER_ERROR("Can't register the callback: %s", strerror(errno));
+  }
+  ++subscribers_ready;
+
+  while (!publishing_done) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  // Time for the work queue to copy the last messages
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+}
+
+static void Subscriber(const Options &options, unsigned index,
+                       SubscriberResult *result) {
+  const std::string name = "subscriber " + std::to_string(index);
+  int cpu = -1;
+  if (!options.subscriber_cpus.empty()) {
+    cpu = options.subscriber_cpus[index % options.subscriber_cpus.size()];
+  }
+  SetupThread(name.c_str(), cpu, options.fifo_priority);
+
+  if (options.mode == Mode::kCallback) {
+    CallbackSubscriber(options, result);
+    return;
+  }
+
+  uorb::SubscriptionInterval<uorb::msg::latency_probe> sub(
+      options.mode == Mode::kInterval ? options.interval_us : 0);
+  result->latencies_us.reserve(options.samples);
+
+  orb_pollfd_t fds[1]{};
+  fds[0].fd = sub.handle();
+  fds[0].events = POLLIN;
+  ++subscribers_ready;
+
+  latency_probe_s data{};
+  orb_copy_info info{};
+  while (!publishing_done || orb_check_update(sub.handle())) {
+    if (orb_poll(fds, 1, 100) <= 0) continue;
+
+    if (options.mode == Mode::kInterval) {
+      if (!sub.Update(&data)) {
+        // orb_poll() keeps returning until the interval has elapsed
+        std::this_thread::sleep_for(
+            std::chrono::microseconds(kIntervalBackoff));
+        continue;
+      }
+    } else {
+      if (!sub.uorb::Subscription<uorb::msg::latency_probe>::Copy(&data,
+                                                                  &info)) {
+        continue;
+      }
+      result->lost += info.lost;
+    }
+    result->latencies_us.push_back(orb_elapsed_time_us(data.timestamp));
+  }
+}
+
+static void PrintHeader() {
+  printf("%-12s %10s %8s %8s %8s %8s %8s %8s %8s %8s\n", "subscriber",
+         "samples", "lost", "min", "p50", "p99", "p99.9", "max", "mean",
+         "jitter");
+}
+
+static void PrintStatistics(const std::string &name,
+                            std::vector<uint32_t> *latencies, uint64_t lost) {
+  if (latencies->empty()) {
+    printf("%-12s %10d\n", name.c_str(), 0);
+    return;
+  }
+
+  auto &values = *latencies;
+  std::sort(values.begin(), values.end());
+  auto percentile = [&values](double p) {
+    auto rank = size_t(std::ceil(p / 100 * values.size()));
+    return values[std::min(values.size(), std::max<size_t>(rank, 1)) - 1];
+  };
+
+  double sum = 0;
+  for (auto value : values) sum += value;
+  const double mean = sum / values.size();
+  double variance = 0;
+  for (auto value : values) variance += (value - mean) * (value - mean);
+  const double jitter = std::sqrt(variance / values.size());
+
+  printf("%-12s %10zu %8" PRIu64 " %8u %8u %8u %8u %8u %8.1f %8.1f\n",
+         name.c_str(), values.size(), lost, values.front(), percentile(50),
+         percentile(99), percentile(99.9), values.back(), mean, jitter);
+}
+
+static void Usage(const char *program) {
+  printf(
+      "Usage: %s [options]\n"
+      "  -n <samples>      Number of messages to publish (default 1000000)\n"
+      "  -r <rate>         Publish rate in Hz, 0 is as fast as possible "
+      "(default 10000)\n"
+      "  -s <subscribers>  Number of subscriber threads (default 1)\n"
+      "  -m <mode>         poll: copy every message after orb_poll()\n"
+      "                    interval: SubscriptionInterval, see -i\n"
+      "                    callback: copy in a shared work queue thread\n"
+      "  -i <interval>     Interval of -m interval in microseconds "
+      "(default 1000)\n"
+      "  -p <cpu>          Run the publisher on this cpu\n"
+      "  -c <cpus>         Run the subscribers (or the work queue of\n"
+      "                    -m callback) on these cpus, e.g. 2,3\n"
+      "  -f <priority>     Run all threads with SCHED_FIFO at this priority\n"
+      "All latencies are in microseconds.\n",
+      program);
+}
+
+static bool ParseOptions(int argc, char *argv[], Options *options) {
+  int opt;
+  while ((opt = getopt(argc, argv, "n:r:s:m:i:p:c:f:h")) != -1) {
+    switch (opt) {
+      case 'n':
+        options->samples = strtoull(optarg, nullptr, 0);
+        break;
+      case 'r':
+        options->rate_hz = strtoul(optarg, nullptr, 0);
+        break;
+      case 's':
+        options->subscribers = strtoul(optarg, nullptr, 0);
+        break;
+      case 'm':
+        if (!strcmp(optarg, "poll")) {
+          options->mode = Mode::kPoll;
+        } else if (!strcmp(optarg, "interval")) {
+          options->mode = Mode::kInterval;
+        } else if (!strcmp(optarg, "callback")) {
+          options->mode = Mode::kCallback;
+        } else {
+          return false;
+        }
+        break;
+      case 'i':
+        options->interval_us = strtoul(optarg, nullptr, 0);
+        break;
+      case 'p':
+        options->publisher_cpu = atoi(optarg);
+        break;
+      case 'c':
+        for (char *cpu = strtok(optarg, ","); cpu;
+             cpu = strtok(nullptr, ",")) {
+          options->subscriber_cpus.push_back(atoi(cpu));
+        }
+        break;
+      case 'f':
+        options->fifo_priority = atoi(optarg);
+        break;
+      default:
+        return false;
+    }
+  }
+  return options->subscribers > 0;
+}
+
+int main(int argc, char *argv[]) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    Usage(argv[0]);
+    return 1;
+  }
+
+  LOGGER_INFO("uORB version: %s", orb_version());
+  LOGGER_INFO("%" PRIu64 " samples at %u Hz, %u subscriber(s), mode: %s",
+              options.samples, options.rate_hz, options.subscribers,
+              kModeNames[int(options.mode)]);
+
+  std::vector<SubscriberResult> results(options.subscribers);
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < options.subscribers; ++i) {
+    threads.emplace_back(Subscriber, std::cref(options), i, &results[i]);
+  }
+  threads.emplace_back(Publisher, std::cref(options));
+  for (auto &thread : threads) thread.join();
+
+  PrintHeader();
+  std::vector<uint32_t> all;
+  uint64_t all_lost = 0;
+  for (unsigned i = 0; i < options.subscribers; ++i) {
+    all.insert(all.end(), results[i].latencies_us.begin(),
+               results[i].latencies_us.end());
+    all_lost += results[i].lost;
+    PrintStatistics(std::to_string(i), &results[i].latencies_us,
+                    results[i].lost);
+  }
+  if (options.subscribers > 1) PrintStatistics("all", &all, all_lost);
+
+  return 0;
+}
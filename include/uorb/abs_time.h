@@ -4,7 +4,8 @@
 #pragma once
 
 #include <inttypes.h>
-#include <time.h>
+#include <stdbool.h>
+#include <uorb/internal/export.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -19,19 +20,75 @@ extern "C" {
 typedef uint64_t orb_abstime_us;
 
 /**
- * Get absolute time in [us] (does not wrap).
+ * Clocks that orb_absolute_time_us() can read, all with the epoch of
+ * CLOCK_MONOTONIC.
  */
-static inline orb_abstime_us orb_absolute_time_us() {
-  struct timespec ts = {};
-  orb_abstime_us result;
+enum orb_clock_source {
+  // clock_gettime(CLOCK_MONOTONIC), the default
+  ORB_CLOCK_MONOTONIC,
+  // CLOCK_MONOTONIC_COARSE (Linux): several times cheaper, but only updated
+  // every scheduler tick (1 to 10 ms)
+  ORB_CLOCK_MONOTONIC_COARSE,
+  // Time stamp counter of x86-64 CPUs with an invariant TSC, calibrated
+  // against CLOCK_MONOTONIC: no system call even where the vDSO can't read
+  // the clock (e.g. some virtual machines), but drifts from CLOCK_MONOTONIC
+  // by the calibration error (a few ppm)
+  ORB_CLOCK_TSC,
+  // Simulation time, only advanced by orb_set_lockstep_time(). Starts at the
+  // CLOCK_MONOTONIC time when selected. Also drives the bus: publication
+  // timestamps, orb_poll() timeouts and work queue timers.
+  ORB_CLOCK_LOCKSTEP,
+};
 
-  clock_gettime(CLOCK_MONOTONIC, &ts);
+/**
+ * Select the clock of orb_absolute_time_us(). Call it once at startup:
+ * timestamps of different clocks can't be compared. Threads reading the time
+ * meanwhile get either clock, never a mix of both. Selecting ORB_CLOCK_TSC
+ * again recalibrates it.
+ *
+ * The bus itself (publication timestamps, orb_poll() timeouts, work queue
+ * timers) uses orb_monotonic_time_us(). Leaving ORB_CLOCK_LOCKSTEP wakes the
+ * timed waits, and the time jumps back to CLOCK_MONOTONIC.
+ *
+ * @return false with errno set if the clock is not available on this system
+ * (ENOTSUP), the previous clock is kept.
+ */
+bool orb_set_clock_source(enum orb_clock_source source) __EXPORT;
 
-  result = (orb_abstime_us)(ts.tv_sec) * 1000000;
-  result += ts.tv_nsec / 1000;
+/**
+ * Set the time of ORB_CLOCK_LOCKSTEP, e.g. from the simulator after every
+ * step. Timed waits that expire by then (orb_poll() timeouts, work queue
+ * timers) return as if the time had passed.
+ *
+ * The simulation runs as fast as the simulator steps it, so the simulator
+ * should wait for the outputs of a step before starting the next one.
+ *
+ * @return false with errno set to EINVAL if ORB_CLOCK_LOCKSTEP is not
+ * selected or if the time would go backwards.
+ */
+bool orb_set_lockstep_time(orb_abstime_us time_us) __EXPORT;
 
-  return result;
-}
+/**
+ * Advance the time of ORB_CLOCK_LOCKSTEP, see orb_set_lockstep_time().
+ */
+bool orb_advance_lockstep_time(uint64_t delta_us) __EXPORT;
+
+/**
+ * Get the clock selected with orb_set_clock_source().
+ */
+enum orb_clock_source orb_get_clock_source(void) __EXPORT;
+
+/**
+ * Get CLOCK_MONOTONIC in [us] regardless of the selected clock, except for
+ * ORB_CLOCK_LOCKSTEP: the simulation time.
+ */
+orb_abstime_us orb_monotonic_time_us(void) __EXPORT;
+
+/**
+ * Get absolute time in [us] (does not wrap), from the clock selected with
+ * orb_set_clock_source().
+ */
+orb_abstime_us orb_absolute_time_us(void) __EXPORT;
 
 /**
  * Compute the delta between a timestamp taken in the past
@@ -0,0 +1,362 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#pragma once
+
+#if __cplusplus < 202002L || !__has_include(<coroutine>)
+#error "uorb/coroutine.h requires C++20 coroutines"
+#endif
+
+#include <uorb/internal/noncopyable.h>
+#include <uorb/uorb.h>
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <set>
+#include <utility>
+
+/**
+ * Coroutines waiting for topics, e.g. for mission logic made of many mostly
+ * waiting consumers that should not cost a thread and a stack each.
+ *
+ * Example:
+ * @code
+ * uorb::coro::Task WaitForLanding(uorb::coro::Scheduler &scheduler) {
+ *   uorb::coro::Subscription<uorb::msg::vehicle_land_detected> land(scheduler);
+ *   uorb::coro::Subscription<uorb::msg::vehicle_status> status(scheduler);
+ *   while (true) {
+ *     if (co_await uorb::coro::when_any(land, status) == 0) {
+ *       vehicle_land_detected_s data;
+ *       if (land.Update(&data) && data.landed) co_return;
+ *     } else {
+ *       ...
+ *     }
+ *   }
+ * }
+ *
+ * uorb::coro::Scheduler scheduler;
+ * scheduler.Spawn(WaitForLanding(scheduler));
+ * scheduler.Run();  // Returns once all tasks have finished
+ * @endcode
+ */
+namespace uorb {
+namespace coro {
+
+class Scheduler;
+
+/**
+ * A coroutine started by Scheduler::Spawn(). Runs until its co_return, and
+ * only in the thread of Scheduler::Run().
+ */
+class Task {
+ public:
+  struct promise_type {
+    Scheduler *scheduler{nullptr};
+
+    Task get_return_object() {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    // Started by the scheduler
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    // Destroyed when finished
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept { std::terminate(); }
+
+    ~promise_type();
+  };
+
+  Task(Task &&other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+  Task &operator=(Task &&) = delete;
+
+  // Only a task that was never spawned is destroyed here
+  ~Task() {
+    if (handle_) handle_.destroy();
+  }
+
+ private:
+  friend class Scheduler;
+
+  explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+/**
+ * Runs tasks in a single thread, resuming them when the topics they wait for
+ * are published.
+ */
+class Scheduler : internal::Noncopyable {
+ public:
+  Scheduler() = default;
+
+  // Destroys the tasks that have not finished
+  ~Scheduler() {
+    auto tasks = std::move(tasks_);
+    for (auto address : tasks) {
+      std::coroutine_handle<>::from_address(address).destroy();
+    }
+  }
+
+  // Start a task in Run(). Call it before Run() or from a task.
+  void Spawn(Task task) {
+    auto handle = std::exchange(task.handle_, {});
+    handle.promise().scheduler = this;
+    {
+      std::lock_guard<std::mutex> lg(lock_);
+      tasks_.insert(handle.address());
+    }
+    Schedule(handle);
+  }
+
+  // Run the tasks until they have all finished or Stop() is called
+  void Run() {
+    std::unique_lock<std::mutex> lk(lock_);
+    while (!stop_ && !tasks_.empty()) {
+      if (ready_.empty()) {
+        ready_added_.wait(lk);
+        continue;
+      }
+      auto handle = ready_.front();
+      ready_.pop_front();
+      lk.unlock();
+      handle.resume();
+      lk.lock();
+    }
+    stop_ = false;
+  }
+
+  // Make Run() return, can be called from any thread
+  void Stop() {
+    std::lock_guard<std::mutex> lg(lock_);
+    stop_ = true;
+    ready_added_.notify_one();
+  }
+
+  // Number of spawned tasks that have not finished
+  size_t task_count() const {
+    std::lock_guard<std::mutex> lg(lock_);
+    return tasks_.size();
+  }
+
+  // Resume the coroutine in Run(), can be called from any thread
+  void Schedule(std::coroutine_handle<> handle) {
+    std::lock_guard<std::mutex> lg(lock_);
+    ready_.push_back(handle);
+    ready_added_.notify_one();
+  }
+
+ private:
+  friend struct Task::promise_type;
+
+  void OnTaskDestroyed(void *address) {
+    std::lock_guard<std::mutex> lg(lock_);
+    tasks_.erase(address);
+  }
+
+  mutable std::mutex lock_;
+  std::condition_variable ready_added_;
+  std::deque<std::coroutine_handle<>> ready_;  // Guarded by lock_
+  std::set<void *> tasks_;                     // Guarded by lock_
+  bool stop_{false};                           // Guarded by lock_
+};
+
+inline Task::promise_type::~promise_type() {
+  if (scheduler) {
+    scheduler->OnTaskDestroyed(
+        std::coroutine_handle<promise_type>::from_promise(*this).address());
+  }
+}
+
+namespace detail {
+
+// A suspended coroutine waiting for one of several subscriptions
+struct Waiter {
+  std::coroutine_handle<> handle;
+  Scheduler *scheduler{nullptr};
+  std::atomic<bool> fired{false};
+  size_t index{0};             // Of the subscription that resumed it
+  bool resumed_by_notify{false};
+};
+
+// The part of coro::Subscription that does not depend on the topic
+class SubscriptionBase : internal::Noncopyable {
+ public:
+  SubscriptionBase(Scheduler &scheduler, const orb_metadata &meta,
+                   uint8_t instance)
+      : handle_(orb_create_subscription_multi(&meta, instance)),
+        scheduler_(scheduler) {
+    // Stays registered, only notifies while armed
+    if (handle_) orb_set_subscription_callback(handle_, &Notify, this);
+  }
+
+  // Also removes the callback, waiting for a Notify() in progress
+  ~SubscriptionBase() {
+    if (handle_) orb_destroy_subscription(&handle_);
+  }
+
+  // false if the subscription could not be created (errno is set)
+  bool valid() const { return handle_ != nullptr; }
+
+  bool Updated() { return handle_ && orb_check_update(handle_); }
+
+  Scheduler &scheduler() const { return scheduler_; }
+
+  // Make the next publication resume the waiter
+  void Arm(Waiter *waiter, size_t index) {
+    waiter_index_ = index;
+    waiter_.store(waiter);
+  }
+
+  // Stop resuming the waiter. Once this returns, Notify() no longer accesses
+  // it and it can be destroyed.
+  void Disarm(Waiter *waiter, size_t index) {
+    auto expected = waiter;
+    if (waiter_.compare_exchange_strong(expected, nullptr)) return;
+    // Taken by a Notify() that may still be running, unless it resumed the
+    // waiter (its last access)
+    if (waiter->resumed_by_notify && waiter->index == index) return;
+    // Setting the callback waits until the previous one has returned
+    orb_set_subscription_callback(handle_, &Notify, this);
+  }
+
+ protected:
+  orb_subscription_t *handle_;
+
+ private:
+  // Runs in the publishing thread with the topic locked
+  static void Notify(void *arg) {
+    auto self = static_cast<SubscriptionBase *>(arg);
+    auto waiter = self->waiter_.exchange(nullptr);
+    if (!waiter || waiter->fired.exchange(true)) return;
+    waiter->index = self->waiter_index_;
+    waiter->resumed_by_notify = true;
+    waiter->scheduler->Schedule(waiter->handle);
+  }
+
+  Scheduler &scheduler_;
+  std::atomic<Waiter *> waiter_{nullptr};
+  size_t waiter_index_{0};  // Written before waiter_ is armed
+};
+
+// co_await until one of the subscriptions has an update, returns its index
+template <size_t N>
+class WhenAnyAwaiter {
+ public:
+  explicit WhenAnyAwaiter(const std::array<SubscriptionBase *, N> &subs)
+      : subs_(subs) {}
+
+  WhenAnyAwaiter(const WhenAnyAwaiter &) = delete;
+  WhenAnyAwaiter &operator=(const WhenAnyAwaiter &) = delete;
+
+  // Destroyed while suspended: the task was destroyed by the scheduler
+  ~WhenAnyAwaiter() {
+    if (armed_) DisarmAll();
+  }
+
+  bool await_ready() {
+    for (size_t i = 0; i < N; ++i) {
+      if (subs_[i]->Updated()) {
+        waiter_.index = i;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool await_suspend(std::coroutine_handle<> handle) {
+    waiter_.handle = handle;
+    waiter_.scheduler = &subs_[0]->scheduler();
+    for (size_t i = 0; i < N; ++i) subs_[i]->Arm(&waiter_, i);
+    armed_ = true;
+
+    // Published between await_ready() and Arm()
+    for (size_t i = 0; i < N; ++i) {
+      if (!subs_[i]->Updated()) continue;
+      if (waiter_.fired.exchange(true)) break;  // Resumed by a Notify()
+      waiter_.index = i;
+      return false;
+    }
+    // A Notify() can't resume it before this returns: the scheduler runs in
+    // this thread
+    return true;
+  }
+
+  size_t await_resume() {
+    if (armed_) DisarmAll();
+    return waiter_.index;
+  }
+
+ private:
+  void DisarmAll() {
+    for (size_t i = 0; i < N; ++i) subs_[i]->Disarm(&waiter_, i);
+    armed_ = false;
+  }
+
+  const std::array<SubscriptionBase *, N> subs_;
+  Waiter waiter_;
+  bool armed_{false};
+};
+
+}  // namespace detail
+
+/**
+ * Subscription that a task can co_await. Must only be used in the thread of
+ * its scheduler.
+ */
+template <const orb_metadata &meta>
+class Subscription : public detail::SubscriptionBase {
+ public:
+  using Type = typename msg::TypeMap<meta>::type;
+
+  explicit Subscription(Scheduler &scheduler, uint8_t instance = 0)
+      : SubscriptionBase(scheduler, meta, instance) {}
+
+  // Copy the unread message, if any
+  bool Update(Type *dst) { return Updated() && orb_copy(handle_, dst); }
+
+  /**
+   * co_await sub.next(): the next unread message, waiting for its
+   * publication if there is none.
+   */
+  auto next() {
+    class NextAwaiter : public detail::WhenAnyAwaiter<1> {
+     public:
+      explicit NextAwaiter(Subscription *sub)
+          : WhenAnyAwaiter<1>({sub}), sub_(sub) {}
+
+      Type await_resume() {
+        WhenAnyAwaiter<1>::await_resume();
+        Type data{};
+        if (sub_->handle_) orb_copy(sub_->handle_, &data);
+        return data;
+      }
+
+     private:
+      Subscription *const sub_;
+    };
+    return NextAwaiter(this);
+  }
+};
+
+/**
+ * co_await when_any(sub_a, sub_b, ...): wait until one of the subscriptions
+ * has an unread message, and get its index in the arguments. The message is
+ * not copied. The subscriptions must use the same scheduler.
+ */
+template <typename... Subscriptions>
+detail::WhenAnyAwaiter<sizeof...(Subscriptions)> when_any(
+    Subscriptions &...subs) {
+  static_assert(sizeof...(Subscriptions) > 0, "Needs a subscription");
+  return detail::WhenAnyAwaiter<sizeof...(Subscriptions)>(
+      {static_cast<detail::SubscriptionBase *>(&subs)...});
+}
+
+}  // namespace coro
+}  // namespace uorb
@@ -32,7 +32,7 @@
  ****************************************************************************/
 
 /**
- * @file orb_atomic.h
+ * @file atomic.h
  *
  * Provides atomic integers and counters. Each method is executed atomically and
  * thus can be used to prevent data races and add memory synchronization between
@@ -131,6 +131,54 @@ class atomic {
     return __atomic_fetch_add(&_value, num, __ATOMIC_SEQ_CST);
   }
 
+  /**
+   * Relaxed variants, for statistics counters that are updated on hot paths
+   * and do not order any other memory access.
+   */
+  inline T load_relaxed() const {
+#ifdef __PX4_QURT
+    return _value;
+#else
+    T value;
+    __atomic_load(&_value, &value, __ATOMIC_RELAXED);
+    return value;
+#endif
+  }
+
+  inline void store_relaxed(T value) {
+#ifdef __PX4_QURT
+    _value = value;
+#else
+    __atomic_store(&_value, &value, __ATOMIC_RELAXED);
+#endif
+  }
+
+  inline T fetch_add_relaxed(T num) {
+    return __atomic_fetch_add(&_value, num, __ATOMIC_RELAXED);
+  }
+
+  /**
+   * Acquire and release variants: the writes before store_release() are
+   * visible to a thread after its load_acquire() returned the stored value.
+   */
+  inline T load_acquire() const {
+#ifdef __PX4_QURT
+    return _value;
+#else
+    T value;
+    __atomic_load(&_value, &value, __ATOMIC_ACQUIRE);
+    return value;
+#endif
+  }
+
+  inline void store_release(T value) {
+#ifdef __PX4_QURT
+    _value = value;
+#else
+    __atomic_store(&_value, &value, __ATOMIC_RELEASE);
+#endif
+  }
+
   /**
    * Atomically substract a number and return the previous value.
    * @return value prior to the substraction
@@ -180,7 +228,7 @@ class atomic {
    * @return If desired is written into _value then true is returned
    */
   inline bool compare_exchange(T *expected, T num) {
-    return __atomic_compare_exchange(&_value, expected, num, false,
+    return __atomic_compare_exchange(&_value, expected, &num, false,
                                      __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
   }
 
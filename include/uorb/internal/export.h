@@ -0,0 +1,20 @@
+/**
+ * @file export.h
+ * Symbol visibility of the uORB API, shared by the public headers.
+ */
+
+#pragma once
+
+#if __GNUC__ >= 4
+#ifdef __EXPORT
+#undef __EXPORT
+#endif
+#define __EXPORT __attribute__((visibility("default")))
+#ifdef __PRIVATE
+#undef __PRIVATE
+#endif
+#define __PRIVATE __attribute__((visibility("hidden")))
+#else
+#define __EXPORT
+#define __PRIVATE
+#endif
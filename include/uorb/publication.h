@@ -28,6 +28,34 @@ class Publication : internal::Noncopyable {
     return handle_ && orb_publish(handle_, &data);
   }
 
+  /**
+   * Publish the struct unless it is equal to the latest message, see
+   * orb_publish_if_changed()
+   * @param data The uORB message struct we are updating.
+   */
+  bool PublishIfChanged(const Type &data) {
+    if (!handle_) {
+      handle_ = orb_create_publication(&meta);
+    }
+
+    return handle_ && orb_publish_if_changed(handle_, &data);
+  }
+
+  /**
+   * The queue slot of the next message, to fill in place and publish with
+   * PublishLoan(), see orb_loan()
+   */
+  Type *Loan() {
+    if (!handle_) {
+      handle_ = orb_create_publication(&meta);
+    }
+
+    return handle_ ? static_cast<Type *>(orb_loan(handle_)) : nullptr;
+  }
+
+  // Publish the slot returned by Loan()
+  bool PublishLoan() { return handle_ && orb_publish_loan(handle_); }
+
  private:
   orb_publication_t *handle_{nullptr};
 };
@@ -51,6 +79,9 @@ class PublicationData : public Publication<T> {
   // Publishes the embedded struct.
   bool Publish() { return Publication<T>::Publish(data_); }
 
+  // Publishes the embedded struct unless it is equal to the latest message.
+  bool PublishIfChanged() { return Publication<T>::PublishIfChanged(data_); }
+
  private:
   Type data_{};
 };
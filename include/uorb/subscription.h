@@ -41,12 +41,54 @@ class Subscription : internal::Noncopyable {
 
   decltype(handle_) handle() { return Subscribed() ? handle_ : nullptr; }
 
+  /**
+   * Set the priority and the deadline of the subscription, see
+   * orb_set_subscription_sched_param(). Set them before registering a
+   * callback.
+   */
+  bool SetSchedParam(int priority, unsigned deadline_us = 0) {
+    const orb_sched_param param{priority, deadline_us};
+    return Subscribed() && orb_set_subscription_sched_param(handle_, &param);
+  }
+
+  // Also the attributes set with orb_set_subscription_sched_param()
+  orb_sched_param sched_param() const {
+    orb_sched_param param{};
+    if (handle_) orb_get_subscription_sched_param(handle_, &param);
+    return param;
+  }
+
+  /**
+   * Only report the messages that change these fields, e.g. "armed", see
+   * orb_set_subscription_fields(). Null to report all messages.
+   */
+  bool SetFields(const char *fields) {
+    return Subscribed() && orb_set_subscription_fields(handle_, fields);
+  }
+
+  /**
+   * Keep up to queue_size messages for this subscription, 0 for the
+   * ORB_QUEUE_SIZE of the topic, see orb_set_subscription_queue_size().
+   */
+  bool SetQueueSize(unsigned queue_size) {
+    return Subscribed() &&
+           orb_set_subscription_queue_size(handle_, queue_size);
+  }
+
   /**
    * Update the struct
    * @param data The uORB message struct we are updating.
    */
   virtual bool Update(Type *dst) { return Updated() && Copy(dst); }
 
+  /**
+   * Update the struct, and get the generation, publish time and number of
+   * lost messages of the copied message.
+   */
+  bool Update(Type *dst, orb_copy_info *info) {
+    return Updated() && Copy(dst, info);
+  }
+
   /**
    * Copy the struct
    * @param data The uORB message struct we are updating.
@@ -54,6 +96,31 @@ class Subscription : internal::Noncopyable {
   virtual bool Copy(Type *dst) {
     return Subscribed() && orb_copy(handle_, dst);
   }
+
+  /**
+   * Copy the struct, see orb_copy_ex()
+   */
+  bool Copy(Type *dst, orb_copy_info *info) {
+    return Subscribed() && orb_copy_ex(handle_, dst, info);
+  }
+
+  /**
+   * Copy the newest queued message published at or before time_us, see
+   * orb_copy_at_time()
+   */
+  bool CopyAtTime(uint64_t time_us, Type *dst, orb_copy_info *info = nullptr) {
+    return Subscribed() && orb_copy_at_time(handle_, time_us, dst, info);
+  }
+
+  /**
+   * Copy up to max_count queued messages published between start_us and
+   * end_us into dst[], see orb_copy_range()
+   */
+  int CopyRange(uint64_t start_us, uint64_t end_us, Type *dst,
+                unsigned max_count, orb_copy_info *infos = nullptr) {
+    if (!Subscribed()) return -1;
+    return orb_copy_range(handle_, start_us, end_us, dst, max_count, infos);
+  }
 };
 
 // Subscription wrapper class with data
@@ -71,6 +138,9 @@ class SubscriptionData : public Subscription<T> {
 
   // update the embedded struct.
   bool Update() { return Subscription<T>::Update(&data_); }
+  bool Update(orb_copy_info *info) {
+    return Subscription<T>::Update(&data_, info);
+  }
 
   const Type &get() const { return data_; }
 
@@ -0,0 +1,124 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#pragma once
+
+#include <uorb/subscription.h>
+#include <uorb/uorb.h>
+#include <uorb/work_queue.h>
+
+namespace uorb {
+
+/**
+ * Subscription that calls Call() in the publishing thread every time the
+ * topic is published, see orb_set_subscription_callback().
+ *
+ * A class that implements Call() must call UnregisterCallback() in its own
+ * destructor, like SubscriptionCallbackWorkItem: by the time this destructor
+ * runs, a publishing thread may be in the Call() of a destroyed object.
+ *
+ * Example:
+ * @code
+ * class ArmedFlag : public uorb::SubscriptionCallback<uorb::msg::armed> {
+ *  public:
+ *   ~ArmedFlag() { UnregisterCallback(); }
+ *
+ *  private:
+ *   void Call() override { changed_ = true; }
+ *
+ *   std::atomic<bool> changed_{false};
+ * };
+ * @endcode
+ */
+template <const orb_metadata &meta>
+class SubscriptionCallback : public Subscription<meta> {
+ public:
+  explicit SubscriptionCallback(uint8_t instance = 0) noexcept
+      : Subscription<meta>(instance) {}
+
+  // Too late for the classes that implement Call(), see above
+  ~SubscriptionCallback() { UnregisterCallback(); }
+
+  /**
+   * Start calling Call() on every publication.
+   * @return false with errno set on failure.
+   */
+  bool RegisterCallback() {
+    return this->Subscribed() &&
+           orb_set_subscription_callback(this->handle_, &Notify, this);
+  }
+
+  // Stop calling Call(), it is not running anymore once this returns
+  void UnregisterCallback() {
+    if (this->handle_) {
+      orb_set_subscription_callback(this->handle_, nullptr, nullptr);
+    }
+  }
+
+ protected:
+  // Runs with the topic locked: must be short and must not access the topic
+  virtual void Call() = 0;
+
+ private:
+  static void Notify(void *arg) {
+    static_cast<SubscriptionCallback *>(arg)->Call();
+  }
+};
+
+/**
+ * Subscription that schedules a work item every time the topic is published.
+ * The work item copies the updates in its Run().
+ *
+ * The work item is scheduled with the priority and deadline of the
+ * subscription (SetSchedParam()), so that control loops run before loggers
+ * that become ready from the same publication.
+ *
+ * Example:
+ * @code
+ * class AccelFilter : public uorb::WorkItem {
+ *  public:
+ *   AccelFilter() : WorkItem(uorb::wq_configurations::kHighPriority) {}
+ *   ~AccelFilter() override {
+ *     accel_sub_.UnregisterCallback();
+ *     ScheduleClear();
+ *   }
+ *   bool Init() {
+ *     // Must handle a message within 2 ms, before lower priority work items
+ *     return accel_sub_.SetSchedParam(10, 2000) &&
+ *            accel_sub_.RegisterCallback();
+ *   }
+ *
+ *  private:
+ *   void Run() override {
+ *     sensor_accel_s accel;
+ *     while (accel_sub_.Update(&accel)) Filter(accel);
+ *   }
+ *
+ *   uorb::SubscriptionCallbackWorkItem<uorb::msg::sensor_accel> accel_sub_{
+ *       this};
+ * };
+ * @endcode
+ */
+template <const orb_metadata &meta>
+class SubscriptionCallbackWorkItem : public SubscriptionCallback<meta> {
+ public:
+  explicit SubscriptionCallbackWorkItem(WorkItem *work_item,
+                                        uint8_t instance = 0) noexcept
+      : SubscriptionCallback<meta>(instance), work_item_(work_item) {}
+
+  // Before work_item_ and Call() go away
+  ~SubscriptionCallbackWorkItem() { this->UnregisterCallback(); }
+
+ private:
+  void Call() override {
+    // Set by SetSchedParam() or orb_set_subscription_sched_param()
+    const auto param = this->sched_param();
+    work_item_->ScheduleNow(
+        param.priority,
+        param.deadline_us ? orb_monotonic_time_us() + param.deadline_us : 0);
+  }
+
+  WorkItem *const work_item_;
+};
+
+}  // namespace uorb
@@ -31,12 +31,25 @@ class SubscriptionInterval : public Subscription<T> {
 
   ~SubscriptionInterval() = default;
 
+  using Subscription<T>::Copy;
+  using Subscription<T>::Update;
+
   /**
    * Check if there is a new update.
    * */
   bool Updated() override {
-    return Subscription<T>::Updated() &&
-           (orb_elapsed_time_us(last_update_) >= interval_us_);
+    if (!use_publish_time_) {
+      return Subscription<T>::Updated() &&
+             (orb_elapsed_time_us(last_update_) >= interval_us_);
+    }
+
+    uint64_t publish_time;
+    if (!this->Subscribed() ||
+        !orb_check_update_ex(this->handle_, &publish_time)) {
+      return false;
+    }
+    latest_publish_time_ = publish_time;
+    return publish_time >= last_update_ + interval_us_;
   }
 
   /**
@@ -52,18 +65,37 @@ class SubscriptionInterval : public Subscription<T> {
     return false;
   }
 
+  /**
+   * Copy the struct if updated, see Subscription::Update().
+   */
+  bool Update(Type *dst, orb_copy_info *info) {
+    return Updated() && Copy(dst, info);
+  }
+
   /**
    * Copy the struct
    * @param dst The destination pointer where the struct will be copied.
    * @return true only if topic was copied successfully.
    */
-  bool Copy(Type *dst) override {
-    if (Subscription<T>::Copy(dst)) {
-      const orb_abstime_us now = orb_absolute_time_us();
+  bool Copy(Type *dst) override { return Copy(dst, nullptr); }
+
+  /**
+   * Copy the struct, see orb_copy_ex(). Counts for the interval like
+   * Copy(dst).
+   */
+  bool Copy(Type *dst, orb_copy_info *info) {
+    orb_copy_info copy_info{};
+    if (Subscription<T>::Copy(dst, &copy_info)) {
+      const orb_abstime_us now =
+          use_publish_time_ ? (copy_info.timestamp > latest_publish_time_
+                                   ? copy_info.timestamp
+                                   : latest_publish_time_)
+                            : orb_absolute_time_us();
       // shift last update time forward, but don't let it get further behind
       // than the interval
       last_update_ =
           constrain(last_update_ + interval_us_, now - interval_us_, now);
+      if (info) *info = copy_info;
       return true;
     }
 
@@ -75,9 +107,19 @@ class SubscriptionInterval : public Subscription<T> {
   void set_interval_us(uint32_t interval) { interval_us_ = interval; }
   void set_interval_ms(uint32_t interval) { interval_us_ = interval * 1000; }
 
+  /**
+   * Measure the interval between the publish times of the messages instead
+   * of reading the clock on every check. A message published less than the
+   * interval after the previously copied one is then skipped, even if no
+   * newer message follows.
+   */
+  void set_use_publish_time(bool enable) { use_publish_time_ = enable; }
+
  protected:
   orb_abstime_us last_update_{0};  // last update in microseconds
   uint32_t interval_us_{0};        // maximum update interval in microseconds
+  bool use_publish_time_{false};
+  orb_abstime_us latest_publish_time_{0};  // Seen by the last Updated()
 };
 
 }  // namespace uorb
@@ -0,0 +1,252 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#pragma once
+
+#include <uorb/internal/noncopyable.h>
+#include <uorb/uorb.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+
+namespace uorb {
+namespace detail {
+
+// One topic matched against the publish times of the first topic of a
+// Synchronizer. Only reads the queue of the topic, with orb_copy_at_time()
+// and orb_copy_range().
+class SyncInput : internal::Noncopyable {
+ public:
+  enum Result {
+    kMatched,
+    kWait,     // A later message may still match, or match better
+    kNoMatch,  // No message will match
+  };
+
+  SyncInput() = default;
+  ~SyncInput() {
+    if (handle_) orb_destroy_subscription(&handle_);
+  }
+
+  void Init(const orb_metadata &meta) {
+    handle_ = orb_create_subscription(&meta);
+  }
+
+  /**
+   * Find the queued message published nearest to time_us, at most
+   * tolerance_us away and after the previously copied one. Only reads the
+   * information of the messages.
+   */
+  Result Find(uint64_t time_us, uint64_t tolerance_us, orb_copy_info *match) {
+    if (!handle_) return kNoMatch;
+
+    uint64_t low = time_us > tolerance_us ? time_us - tolerance_us : 0;
+    if (low <= last_time_us_) low = last_time_us_ + 1;
+    const uint64_t high = time_us + tolerance_us;
+    if (low > high) return kNoMatch;
+
+    // The newest message at or before time_us, and the oldest one after it
+    orb_copy_info before{}, after{};
+    const bool has_before =
+        orb_copy_at_time(handle_, time_us, nullptr, &before) &&
+        before.timestamp >= low;
+    const uint64_t after_low = time_us < low ? low : time_us + 1;
+    const bool has_after =
+        after_low <= high &&
+        orb_copy_range(handle_, after_low, high, nullptr, 1, &after) == 1;
+
+    if (has_after) {
+      // Later messages are further away
+      const bool before_nearer =
+          has_before && time_us - before.timestamp <= after.timestamp - time_us;
+      *match = before_nearer ? before : after;
+      return kMatched;
+    }
+
+    uint64_t last_publish_time = 0;
+    orb_check_update_ex(handle_, &last_publish_time);
+    if (last_publish_time <= high) return kWait;
+    if (!has_before) return kNoMatch;
+    *match = before;
+    return kMatched;
+  }
+
+  /**
+   * Copy the message found by Find(), false if it was overwritten since.
+   * The messages up to it are read like with orb_copy(), so the
+   * subscription does not hold back publishers that wait for their
+   * subscribers, see orb_get_subscriber_backlog().
+   */
+  bool Copy(const orb_copy_info &match, void *dst) {
+    orb_copy_info info{};
+    do {
+      if (!orb_copy_ex(handle_, dst, &info)) return false;
+    } while (int(info.generation - match.generation) < 0);
+    if (info.generation != match.generation) return false;
+    last_time_us_ = match.timestamp;
+    return true;
+  }
+
+  orb_subscription_t *handle() const { return handle_; }
+
+ private:
+  orb_subscription_t *handle_{nullptr};
+  uint64_t last_time_us_{0};  // Of the last copied message
+};
+
+// Pointers to the elements I to size - 1 of a tuple
+template <typename Tuple, size_t I = 0,
+          bool end = (I == std::tuple_size<Tuple>::value)>
+struct TupleElements {
+  static void Get(Tuple *tuple, void **elements) {
+    elements[I] = &std::get<I>(*tuple);
+    TupleElements<Tuple, I + 1>::Get(tuple, elements);
+  }
+};
+
+template <typename Tuple, size_t I>
+struct TupleElements<Tuple, I, true> {
+  static void Get(Tuple *, void **) {}
+};
+
+}  // namespace detail
+
+/**
+ * Matches the messages of several topics by publish time, like the
+ * approximate and exact time policies of ROS message_filters, e.g. to pair
+ * camera frames with IMU samples.
+ *
+ * The publish times are those of orb_copy_info.timestamp, not the timestamp
+ * field of the messages. With the exact policy (tolerance_us 0) the messages
+ * must be published at the same time of the clock, e.g. in one step of
+ * ORB_CLOCK_LOCKSTEP. With the monotonic clock, the tolerance has to cover
+ * the delay between the publishers.
+ *
+ * Every message of the first topic is matched with the message of each other
+ * topic that was published nearest to it, at most tolerance_us away
+ * (0: exactly at the same time). The other topics are searched in their
+ * queues (ORB_QUEUE_SIZE), and only the matched messages are copied. A
+ * message is matched at most once. Usually the first topic is the one with
+ * the lowest rate.
+ *
+ * Example:
+ * @code
+ * uorb::Synchronizer<uorb::msg::camera_frame, uorb::msg::sensor_accel>
+ *     sync(2000);
+ * decltype(sync)::Tuple data;
+ * while (orb_poll(fds, 1, 1000) >= 0) {  // fds[0].fd = sync.handle()
+ *   while (sync.Update(&data)) {
+ *     const auto &frame = std::get<0>(data);
+ *     const auto &accel = std::get<1>(data);
+ *     ...
+ *   }
+ * }
+ * @endcode
+ */
+template <const orb_metadata &first, const orb_metadata &... others>
+class Synchronizer : internal::Noncopyable {
+  static_assert(sizeof...(others) > 0, "Needs two topics or more");
+
+ public:
+  using Tuple = std::tuple<typename msg::TypeMap<first>::type,
+                           typename msg::TypeMap<others>::type...>;
+
+  explicit Synchronizer(uint64_t tolerance_us = 0)
+      : first_(orb_create_subscription(&first)), tolerance_us_(tolerance_us) {
+    static const orb_metadata *const metas[] = {&others...};
+    for (size_t i = 0; i < sizeof...(others); ++i) inputs_[i].Init(*metas[i]);
+  }
+
+  ~Synchronizer() {
+    if (first_) orb_destroy_subscription(&first_);
+  }
+
+  /**
+   * Copy the next matched messages.
+   *
+   * A message of the first topic waits until the messages of the other
+   * topics that could match it have been published, so call this again
+   * when any of the topics is published. When polling only handle(), the
+   * match is found by the next message of the first topic at the latest.
+   *
+   * @param time_us  Receives the publish time of the message of the first
+   * topic, may be null.
+   * @return true if dst received a new match.
+   */
+  bool Update(Tuple *dst, uint64_t *time_us = nullptr) {
+    if (!first_) return false;
+
+    while (true) {
+      if (!pending_) {
+        if (!orb_check_update(first_) ||
+            !orb_copy_ex(first_, &first_data_, &first_info_)) {
+          return false;
+        }
+        pending_ = true;
+      }
+
+      orb_copy_info matches[sizeof...(others)];
+      bool wait = false;
+      bool no_match = false;
+      for (size_t i = 0; i < sizeof...(others); ++i) {
+        switch (inputs_[i].Find(first_info_.timestamp, tolerance_us_,
+                                &matches[i])) {
+          case detail::SyncInput::kWait:
+            wait = true;
+            break;
+          case detail::SyncInput::kNoMatch:
+            no_match = true;
+            break;
+          default:
+            break;
+        }
+      }
+      if (!no_match && wait) return false;
+
+      pending_ = false;
+      if (!no_match) {
+        void *elements[1 + sizeof...(others)];
+        detail::TupleElements<Tuple>::Get(dst, elements);
+        bool copied = true;
+        for (size_t i = 0; i < sizeof...(others) && copied; ++i) {
+          copied = inputs_[i].Copy(matches[i], elements[1 + i]);
+        }
+        if (copied) {
+          std::get<0>(*dst) = first_data_;
+          if (time_us) *time_us = first_info_.timestamp;
+          return true;
+        }
+      }
+      ++dropped_count_;
+    }
+  }
+
+  // The subscription of the first topic, e.g. for orb_poll()
+  orb_subscription_t *handle() const { return first_; }
+
+  // The subscription of the other topic index (0 is the second topic), e.g.
+  // for orb_set_subscription_callback(). Its messages are only read up to
+  // the last match, so orb_poll() would return right away.
+  orb_subscription_t *handle(size_t index) const {
+    return index < sizeof...(others) ? inputs_[index].handle() : nullptr;
+  }
+
+  // Messages of the first topic without a match
+  uint64_t dropped_count() const { return dropped_count_; }
+
+  uint64_t tolerance_us() const { return tolerance_us_; }
+
+ private:
+  orb_subscription_t *first_;
+  const uint64_t tolerance_us_;
+  detail::SyncInput inputs_[sizeof...(others)];
+
+  // Copied from the first topic, waiting for the other topics
+  typename msg::TypeMap<first>::type first_data_{};
+  orb_copy_info first_info_{};
+  bool pending_{false};
+  uint64_t dropped_count_{0};
+};
+
+}  // namespace uorb
@@ -7,39 +7,62 @@
 
 #include <errno.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <uorb/internal/export.h>
 
-#if __GNUC__ >= 4
-#ifdef __EXPORT
-#undef __EXPORT
-#endif
-#define __EXPORT __attribute__((visibility("default")))
-#ifdef __PRIVATE
-#undef __PRIVATE
-#endif
-#define __PRIVATE __attribute__((visibility("hidden")))
-#else
-#define __EXPORT
-#define __PRIVATE
-#endif
+/**
+ * Version of the layout of orb_metadata, stored first in every topic so that
+ * topics generated for another layout are rejected (EPROTO)
+ */
+#define ORB_METADATA_ABI_VERSION 2U
 
 /**
  * Object metadata.
  */
 struct orb_metadata {
-  const char *o_name;    /**< unique object name */
-  const uint16_t o_size; /**< object size */
-  const uint16_t
+  const uint32_t o_abi_version; /**< ORB_METADATA_ABI_VERSION */
+  const char *o_name;           /**< unique object name */
+  const uint32_t o_size;        /**< object size */
+  const uint32_t
       o_size_no_padding; /**< object size w/o padding at the end (for logger) */
   const char *o_fields;  /**< semicolon separated list of fields (with type) */
-  uint16_t o_queue_size; /**< semicolon separated list of fields (with type) */
+  uint32_t o_queue_size; /**< messages in the queue (ORB_QUEUE_SIZE) */
+  uint8_t o_flags;       /**< ORB_FLAG_* */
+};
+
+/**
+ * The largest queue size of a topic or a subscription
+ */
+#define ORB_QUEUE_SIZE_MAX (1U << 24U)
+
+/**
+ * orb_publish() skips messages equal to the latest one, like
+ * orb_publish_if_changed(). Set with ORB_SUPPRESS_DUPLICATES in the msg file.
+ */
+#define ORB_FLAG_SUPPRESS_DUPLICATES (1U << 0U)
+
+/**
+ * Time between the publication of a message and its copy by a subscriber,
+ * in nanoseconds. Percentiles are accurate to 12.5%.
+ *
+ * Only measured when uorb is built with UORB_LATENCY_STATS, zero otherwise.
+ */
+struct orb_latency_status {
+  uint64_t count;  // Number of measured copies
+  uint64_t mean_ns;
+  uint64_t p50_ns;
+  uint64_t p90_ns;
+  uint64_t p99_ns;
+  uint64_t p999_ns;
+  uint64_t max_ns;
 };
 
 /**
  * The status of a topic
  */
 struct orb_status {
-  uint16_t queue_size;            // Queue size
+  uint32_t queue_size;            // Queue size
   uint8_t subscriber_count;       // Number of subscribers
   bool has_anonymous_subscriber;  // Whether there are anonymous subscribers
                                   // (orb_anonymous_copy() is called)
@@ -47,6 +70,63 @@ struct orb_status {
   bool has_anonymous_publisher;   // Whether there are anonymous publisher
                                   // (orb_anonymous_publish() is called)
   unsigned latest_data_index;     // The latest data index
+
+  uint64_t publish_count;  // Messages published
+  uint64_t publish_bytes;  // Bytes published
+  float publish_rate_hz;   // Moving average of the publish rate
+  uint64_t copy_count;     // Messages copied by all subscribers
+  uint64_t lost_count;     // Messages overwritten before a subscriber copied
+                           // them, summed over all subscribers
+  uint64_t suppressed_count;  // Messages not published because they were
+                              // equal to the latest one
+  uint64_t queue_bytes;  // Memory allocated for the queue
+  struct orb_latency_status latency;  // Publish to copy latency
+};
+
+/**
+ * Information about a message returned by orb_copy_ex()
+ */
+struct orb_copy_info {
+  unsigned generation;  // Sequence number of the message in the topic
+  uint64_t timestamp;   // orb_monotonic_time_us() when it was published
+  unsigned lost;        // Messages overwritten since the previous copy
+};
+
+/**
+ * The status of a subscription
+ */
+struct orb_subscription_status {
+  uint64_t copy_count;  // Messages copied by this subscription
+  uint64_t lost_count;  // Messages overwritten before they were copied
+  unsigned unread;      // Messages that can be copied now
+  uint64_t deadline_miss_count;  // Messages copied later than deadline_us
+                                 // after their publication
+};
+
+/**
+ * Scheduling attributes of a subscription, see
+ * orb_set_subscription_sched_param()
+ */
+struct orb_sched_param {
+  int priority;          // Higher is more urgent, default 0
+  unsigned deadline_us;  // Time from publication to copy, 0: none (default)
+};
+
+/**
+ * Contention of the lock of a topic instance, or of the topic registry
+ * (name "orb_device_master"). Times are in nanoseconds.
+ *
+ * Only measured when uorb is built with UORB_LOCK_STATS.
+ */
+struct orb_lock_status {
+  const char *name;          // Topic name
+  unsigned instance;         // ORB instance
+  uint64_t lock_count;       // Number of times the lock was taken
+  uint64_t contended_count;  // Number of times it had to wait for the lock
+  uint64_t wait_ns;          // Total waiting time
+  uint64_t max_wait_ns;
+  uint64_t hold_ns;          // Total time the lock was held
+  uint64_t max_hold_ns;
 };
 
 #ifdef __cplusplus
@@ -112,8 +192,16 @@ struct TypeMap;
  *                      e.g: "float[3] position;bool armed"
  */
 #define ORB_DEFINE(_name, _struct, _size_no_padding, _fields, _queue_size) \
+  ORB_DEFINE_FLAGS(_name, _struct, _size_no_padding, _fields, _queue_size, 0)
+
+/**
+ * ORB_DEFINE() with flags, see ORB_FLAG_SUPPRESS_DUPLICATES.
+ */
+#define ORB_DEFINE_FLAGS(_name, _struct, _size_no_padding, _fields,        \
+                         _queue_size, _flags)                              \
   const struct orb_metadata uorb::msg::_name = {                           \
-      #_name, sizeof(_struct), _size_no_padding, _fields, _queue_size};    \
+      ORB_METADATA_ABI_VERSION, #_name, sizeof(_struct), _size_no_padding, \
+      _fields, _queue_size, _flags};                                       \
   const struct orb_metadata *__orb_##_name = &uorb::msg::_name;            \
   struct hack
 
@@ -196,8 +284,9 @@ orb_publication_t *orb_create_publication(
  * there are other 0 instance publishers (by passing in NULL, or the first
  * instance), the data of multiple publishers will be sent to the same instance.
  *
- * @return NULL on error(No memory or too many instances), otherwise returns an
- * ORB topic advertiser handle that can be used to publish to the topic.
+ * @return NULL on error(No memory or too many instances, EPROTO if meta has
+ * another ORB_METADATA_ABI_VERSION), otherwise returns an ORB topic
+ * advertiser handle that can be used to publish to the topic.
  */
 orb_publication_t *orb_create_publication_multi(
     const struct orb_metadata *meta, unsigned int *instance) __EXPORT;
@@ -226,6 +315,42 @@ bool orb_destroy_publication(orb_publication_t **handle_ptr) __EXPORT;
  */
 bool orb_publish(orb_publication_t *handle, const void *data) __EXPORT;
 
+/**
+ * Publish new data to a topic, unless it is equal to the latest message.
+ *
+ * Skipped messages do not wake the subscribers and are counted in
+ * orb_status::suppressed_count. The messages are compared over
+ * o_size_no_padding bytes (o_size if it is 0), so a timestamp field that
+ * changes makes every message different.
+ *
+ * @see orb_publish()
+ */
+bool orb_publish_if_changed(orb_publication_t *handle,
+                            const void *data) __EXPORT;
+
+/**
+ * Borrow the queue slot of the next message of a topic, to fill it in place
+ * and publish it with orb_publish_loan() without copying it, e.g. for camera
+ * frames.
+ *
+ * The slot holds an older message, or zeros. If the queue is full, its oldest
+ * message is given up when the slot is loaned. Until the slot is published,
+ * orb_publish() and other loans of the topic fail with EBUSY, and the queue
+ * is not resized. ORB_FLAG_SUPPRESS_DUPLICATES does not apply.
+ *
+ * @param handle  The handle returned from orb_advertise.
+ * @return  The slot of o_size bytes, null with orb_errno set on failure.
+ */
+void *orb_loan(orb_publication_t *handle) __EXPORT;
+
+/**
+ * Publish the slot returned by orb_loan().
+ *
+ * @return  true on success, false with orb_errno set: EINVAL if nothing is
+ * loaned.
+ */
+bool orb_publish_loan(orb_publication_t *handle) __EXPORT;
+
 /**
  * Anonymously publish data on the topic instance 0,
  *
@@ -305,7 +430,8 @@ orb_subscription_t *orb_create_subscription(
  * @param instance  The instance of the topic. Instance 0 matches the
  *      topic of the orb_create_subscription() call, higher indices
  *      are for topics created with orb_advertise_multi().
- * @return    NULL on error, otherwise returns a subscriber handle
+ * @return    NULL on error (EPROTO if meta has another
+ *      ORB_METADATA_ABI_VERSION), otherwise returns a subscriber handle
  *      that can be used to read and update the topic.
  */
 orb_subscription_t *orb_create_subscription_multi(
@@ -336,6 +462,101 @@ bool orb_destroy_subscription(orb_subscription_t **handle_ptr) __EXPORT;
  */
 bool orb_copy(orb_subscription_t *handle, void *buffer) __EXPORT;
 
+/**
+ * Same as orb_copy(), and also returns information about the message.
+ *
+ * If the subscriber fell more than the queue size behind, the oldest messages
+ * were overwritten: info->lost is the number of messages skipped between the
+ * previous copy and this one.
+ *
+ * @param handle  A handle returned from orb_create_subscription.
+ * @param buffer  Pointer to the buffer receiving the data.
+ * @param info    Receives the information, may be null.
+ * @return    true on success, false otherwise with orb_errno set accordingly.
+ */
+bool orb_copy_ex(orb_subscription_t *handle, void *buffer,
+                 struct orb_copy_info *info) __EXPORT;
+
+/**
+ * Copy up to max_count unread messages at once, oldest first, like as many
+ * orb_copy_ex() calls but taking the lock of the topic only once. E.g. a
+ * logger drains a burst of messages directly into its buffers.
+ *
+ * @param handle  A handle returned from orb_create_subscription.
+ * @param buffer  Message i is copied to buffer + i * stride.
+ * @param stride  Bytes between two messages in buffer, at least the size of
+ *                the topic, or 0 to copy all of them to buffer.
+ * @param max_count  The maximum number of messages to copy.
+ * @param infos   max_count entries receiving the information of the copied
+ *                messages, may be null. infos[0].lost counts the messages
+ *                overwritten since the previous copy.
+ * @return    The number of copied messages (0 if none is unread), -1 with
+ *            orb_errno set on error.
+ */
+int orb_copy_batch(orb_subscription_t *handle, void *buffer, size_t stride,
+                   unsigned max_count, struct orb_copy_info *infos) __EXPORT;
+
+/**
+ * Copy the newest queued message that was published at or before time_us
+ * (see orb_copy_info.timestamp), e.g. to find the IMU sample of a camera
+ * frame. Only the last ORB_QUEUE_SIZE messages of the topic are kept. The
+ * next message of orb_copy() does not change.
+ *
+ * @param handle  A handle returned from orb_create_subscription.
+ * @param time_us  Time of orb_monotonic_time_us().
+ * @param buffer  Pointer to the buffer receiving the data. May be null to
+ *                only get the information.
+ * @param info    Receives the information, may be null. info->lost is 0.
+ * @return    true on success, false otherwise with orb_errno set: ENODATA if
+ *            all the queued messages were published later.
+ */
+bool orb_copy_at_time(orb_subscription_t *handle, uint64_t time_us,
+                      void *buffer, struct orb_copy_info *info) __EXPORT;
+
+/**
+ * Copy the queued messages published between start_us and end_us (both
+ * included), oldest first. See orb_copy_at_time().
+ *
+ * @param handle  A handle returned from orb_create_subscription.
+ * @param buffer  Room for max_count messages of the topic. May be null to
+ *                only get the information.
+ * @param max_count  The maximum number of messages to copy, the oldest ones
+ *                   are copied.
+ * @param infos   max_count entries receiving the information of the copied
+ *                messages, may be null.
+ * @return    The number of copied messages, -1 with orb_errno set on error.
+ */
+int orb_copy_range(orb_subscription_t *handle, uint64_t start_us,
+                   uint64_t end_us, void *buffer, unsigned max_count,
+                   struct orb_copy_info *infos) __EXPORT;
+
+/**
+ * Number of times orb_snapshot() copies the topics before giving up
+ */
+#define ORB_SNAPSHOT_MAX_TRIES 16
+
+/**
+ * Copy the latest messages of several topics as they all were at one moment,
+ * e.g. the position and attitude of one control step. Reading them with
+ * orb_copy() one after the other can mix old and new messages when the
+ * topics are published in between.
+ *
+ * The latest messages are copied, then copied again for the topics that
+ * were published since, until none was. Publishers are never blocked longer
+ * than by orb_copy(). The next messages of orb_copy() do not change.
+ *
+ * @param handles  n handles returned from orb_create_subscription.
+ * @param n        The number of topics.
+ * @param buffers  n buffers receiving the messages.
+ * @param infos    n entries receiving the information of the messages, may be
+ *                 null. The lost counts are 0.
+ * @return    true on success, false otherwise with orb_errno set: ENODATA if
+ *            a topic was never published, EAGAIN if the topics kept being
+ *            published during ORB_SNAPSHOT_MAX_TRIES tries.
+ */
+bool orb_snapshot(orb_subscription_t *const *handles, unsigned n,
+                  void *const *buffers, struct orb_copy_info *infos) __EXPORT;
+
 /**
  * Anonymously copy data on the topic instance 0,
  *
@@ -368,6 +589,18 @@ bool orb_copy_anonymous(const struct orb_metadata *meta, void *buffer) __EXPORT;
  */
 bool orb_check_update(orb_subscription_t *handle) __EXPORT;
 
+/**
+ * Same as orb_check_update(), and also get the time when the latest message
+ * of the topic was published (orb_monotonic_time_us(), see
+ * orb_copy_info.timestamp), without reading the clock.
+ *
+ * @param handle  A handle returned from orb_create_subscription.
+ * @param publish_time  Receives the publish time, 0 if never published.
+ * @return true if there is an unread message.
+ */
+bool orb_check_update_ex(orb_subscription_t *handle,
+                         uint64_t *publish_time) __EXPORT;
+
 /**
  * If the message is updated, copy the message.
  * See orb_check_update() and orb_copy().
@@ -377,6 +610,99 @@ static inline bool orb_check_and_copy(orb_subscription_t *handle,
   return orb_check_update(handle) && orb_copy(handle, buffer);
 }
 
+/**
+ * Function called by orb_publish() for every message of a subscribed topic.
+ */
+typedef void (*orb_callback_t)(void *arg);
+
+/**
+ * Set the function that is called every time a message is published to the
+ * topic of the subscription, e.g. to schedule a uorb::WorkItem.
+ *
+ * The function runs in the publishing thread while the topic is locked: it
+ * must be short and must not call uorb functions on the same topic.
+ *
+ * A subscription has at most one callback, setting another one replaces it.
+ * Once this function returns, the previous callback is not running anymore
+ * and will not be called again. orb_destroy_subscription() removes the
+ * callback as well.
+ *
+ * @param handle  A handle returned from orb_create_subscription.
+ * @param callback  The function, or null to remove the callback.
+ * @param arg  Passed to the function.
+ * @return false with errno set on failure.
+ */
+bool orb_set_subscription_callback(orb_subscription_t *handle,
+                                   orb_callback_t callback,
+                                   void *arg) __EXPORT;
+
+/**
+ * Set the priority and the deadline of a subscription.
+ *
+ * A uorb::SubscriptionCallbackWorkItem schedules its work item with them:
+ * among the work items that become ready from the same publication, the work
+ * queue runs the most urgent ones first (see uorb::WorkQueueConfig). A
+ * message copied more than deadline_us after its publication counts as a
+ * deadline miss in orb_subscription_status.
+ *
+ * @param handle  A handle returned from orb_create_subscription.
+ * @param param  The attributes.
+ * @return false with errno set on failure.
+ */
+bool orb_set_subscription_sched_param(orb_subscription_t *handle,
+                                      const struct orb_sched_param *param)
+    __EXPORT;
+
+/**
+ * Get the attributes set with orb_set_subscription_sched_param().
+ *
+ * @param handle  A handle returned from orb_create_subscription.
+ * @param param  Receives the attributes.
+ * @return false with errno set on failure.
+ */
+bool orb_get_subscription_sched_param(orb_subscription_t *handle,
+                                      struct orb_sched_param *param) __EXPORT;
+
+/**
+ * Only report the messages that change some fields of the topic.
+ *
+ * E.g. a subscriber of the armed field of a large status topic is not woken
+ * up by the other messages: orb_check_update(), orb_poll() and the
+ * subscription callback ignore them. A message is reported if it changes the
+ * bytes of the fields from the message published before it, and the next
+ * copies read the messages up to it as usual.
+ *
+ * The fields are found from the o_fields of the topic, so fields after a
+ * nested message type are not supported.
+ *
+ * @param handle  A handle returned from orb_create_subscription.
+ * @param fields  Field names separated by ';', e.g. "armed;nav_state", or
+ * null to report all messages again.
+ * @return false with errno set on failure (EINVAL: a field is not found).
+ */
+bool orb_set_subscription_fields(orb_subscription_t *handle,
+                                 const char *fields) __EXPORT;
+
+/**
+ * Set how many messages a subscription can fall behind, instead of the
+ * ORB_QUEUE_SIZE of the topic.
+ *
+ * The queue of the topic grows to the largest size requested by its
+ * subscriptions, and shrinks again when they are destroyed or request 0.
+ * E.g. a logger asks for 64 messages while the controllers of the same topic
+ * use the default. A subscription that asks
+ * for fewer messages than the queue holds only reads the newest ones, the
+ * older ones count as lost.
+ *
+ * @param handle  A handle returned from orb_create_subscription.
+ * @param queue_size  Number of messages, 0 for the ORB_QUEUE_SIZE of the
+ * topic.
+ * @return false with errno set on failure (EINVAL: queue_size is larger than
+ * ORB_QUEUE_SIZE_MAX).
+ */
+bool orb_set_subscription_queue_size(orb_subscription_t *handle,
+                                     unsigned queue_size) __EXPORT;
+
 /**
  * Check if a topic has already been created and published (advertised)
  *
@@ -406,6 +732,47 @@ unsigned int orb_group_count(const struct orb_metadata *meta) __EXPORT;
 bool orb_get_topic_status(const struct orb_metadata *meta,
                           unsigned int instance, struct orb_status *status);
 
+/**
+ * Get the counters of a subscription.
+ *
+ * Compare lost_count with copy_count to find out whether the queue of a topic
+ * (ORB_QUEUE_SIZE) is large enough for this subscriber.
+ *
+ * @param handle  A handle returned from orb_create_subscription.
+ * @param status  Receives the status.
+ * @return false with errno set on failure.
+ */
+bool orb_get_subscription_status(orb_subscription_t *handle,
+                                 struct orb_subscription_status *status)
+    __EXPORT;
+
+/**
+ * Get the lock contention statistics, most contended lock (longest total
+ * waiting time) first.
+ *
+ * @param status  Receives up to max_count entries
+ * @param max_count  Size of the status array
+ * @return The number of entries written, or -1 with errno set on failure
+ * (ENOTSUP: uorb was built without UORB_LOCK_STATS).
+ */
+int orb_get_lock_status(struct orb_lock_status *status,
+                        unsigned max_count) __EXPORT;
+
+/**
+ * Get the largest number of messages that a subscriber of the topic has not
+ * copied yet (at most the queue size of the topic).
+ *
+ * Publishers that must not overrun slow subscribers, such as a log replay,
+ * can wait until the backlog is below the queue size before publishing. The
+ * backlog of a subscription with a smaller queue size than the topic (see
+ * orb_set_subscription_queue_size()) includes the difference, so it also
+ * reaches the queue size when the next message would be lost.
+ *
+ * @param handle  The handle returned from orb_create_publication.
+ * @return The backlog, 0 if there is no subscriber or on error.
+ */
+unsigned orb_get_subscriber_backlog(orb_publication_t *handle) __EXPORT;
+
 /**
  * Similar to the poll() function of POSIX.
  *
@@ -0,0 +1,164 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#pragma once
+
+#include <uorb/abs_time.h>
+#include <uorb/internal/atomic.h>
+#include <uorb/internal/noncopyable.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace uorb {
+
+/**
+ * A work queue runs the work items scheduled on it in one or more threads.
+ * Work items with the same queue name share the threads.
+ *
+ * With more than one thread, every thread has its own deque of scheduled
+ * items and idle threads steal items from the others, so that the items
+ * scheduled by one publication run in parallel. A work item never runs in
+ * two threads at the same time.
+ *
+ * Ready work items run in the order of their priority or deadline (see
+ * WorkItem::ScheduleNow()), items with the same priority and deadline in the
+ * order they were scheduled. This orders the items of one queue, the queues
+ * themselves are ordered by the scheduling policy of their threads. With
+ * more than one thread, every thread runs its own items in this order and
+ * only steals the most urgent item of another thread when it has none left.
+ */
+struct WorkQueueConfig {
+  static constexpr unsigned kThreadPerCpu = ~0U;
+
+  enum Ordering : uint8_t {
+    kFixedPriority,     // Highest priority first
+    kEarliestDeadline,  // Earliest deadline first, then highest priority
+  };
+
+  const char *name;  // Must outlive the work queue, usually a literal
+
+  // > 0: SCHED_FIFO priority of the threads. Falls back to the default policy
+  //      if the process is not allowed to use SCHED_FIFO.
+  // = 0: default policy
+  // < 0: default policy with the nice value -priority (Linux only)
+  int priority;
+
+  size_t stack_size;  // 0: default stack size
+
+  // 0 or 1: one thread, or kThreadPerCpu: one thread per CPU of cpu_affinity
+  unsigned thread_count;
+
+  Ordering ordering;
+
+  // Bit n set: the threads may run on CPU n. 0: any CPU (Linux only)
+  uint64_t cpu_affinity;
+};
+
+namespace wq_configurations {
+static constexpr WorkQueueConfig kHighPriority{
+    "wq:hp", 50, 0, 1, WorkQueueConfig::kFixedPriority, 0};
+static constexpr WorkQueueConfig kDefault{
+    "wq:default", 0, 0, 1, WorkQueueConfig::kFixedPriority, 0};
+static constexpr WorkQueueConfig kLowPriority{
+    "wq:lp", -10, 0, 1, WorkQueueConfig::kFixedPriority, 0};
+static constexpr WorkQueueConfig kPool{"wq:pool",
+                                       0,
+                                       0,
+                                       WorkQueueConfig::kThreadPerCpu,
+                                       WorkQueueConfig::kFixedPriority,
+                                       0};
+}  // namespace wq_configurations
+
+class WorkQueue;
+
+/**
+ * Work that runs in the thread of a work queue, usually scheduled by a
+ * uorb::SubscriptionCallbackWorkItem when a topic is published. Many mostly
+ * idle work items can share a queue instead of each blocking in orb_poll() on
+ * its own thread.
+ *
+ * The work queue thread is started by the first work item that uses it and
+ * runs until the process exits.
+ */
+class WorkItem : internal::Noncopyable {
+ public:
+  explicit WorkItem(const WorkQueueConfig &config);
+  virtual ~WorkItem();
+
+  /**
+   * Run the item once in the work queue thread, as soon as possible.
+   *
+   * Scheduling an item that has not started running yet has no effect, so
+   * Run() must handle everything that happened since its last run (e.g. copy
+   * all updates of a topic). Can be called from any thread and from
+   * orb_set_subscription_callback() callbacks.
+   *
+   * @return false with errno set if the work queue thread could not be
+   * started.
+   */
+  bool ScheduleNow() { return ScheduleNow(0, 0); }
+
+  /**
+   * Same as ScheduleNow(), with the priority (higher runs first) and the
+   * absolute deadline (orb_monotonic_time_us(), 0: none) of this run.
+   * Scheduling an item again before it runs raises it to the highest
+   * priority and the earliest deadline requested.
+   */
+  bool ScheduleNow(int priority, orb_abstime_us deadline);
+
+  /**
+   * Run the item once, delay_us from now. Timers share the threads and the
+   * ready items of the work queue, so one thread serves periodic and topic
+   * driven work. An item has at most one timer, setting another one replaces
+   * it.
+   */
+  bool ScheduleDelayed(uint32_t delay_us) {
+    return ScheduleAt(orb_monotonic_time_us() + delay_us);
+  }
+
+  // Run the item once at the absolute time (orb_monotonic_time_us())
+  bool ScheduleAt(orb_abstime_us time) { return ScheduleTimer(time, 0); }
+
+  /**
+   * Run the item every interval_us, the first time delay_us from now.
+   *
+   * The runs are scheduled at absolute times (first + n * interval_us), so
+   * they do not drift with the execution time. Periods missed because the
+   * thread was busy are skipped. Every run has the end of its period as
+   * deadline, see WorkQueueConfig::kEarliestDeadline.
+   */
+  bool ScheduleOnInterval(uint32_t interval_us, uint32_t delay_us = 0);
+
+  /**
+   * Stop the timer, remove the item from its queue and wait until a Run() in
+   * progress has returned. Derived classes must call this in their
+   * destructor, before their members are destroyed, and after unregistering
+   * the callbacks that schedule the item.
+   */
+  void ScheduleClear();
+
+  // Number of completed Run() calls
+  uint64_t run_count() const { return run_count_.load(); }
+
+ protected:
+  virtual void Run() = 0;
+
+ private:
+  friend class WorkQueue;
+
+  bool ScheduleTimer(orb_abstime_us time, uint32_t interval_us);
+
+  WorkQueue *const queue_;
+  base::atomic<uint8_t> state_{0};  // WorkQueue::ItemState
+  // Of the next run, see ScheduleNow()
+  base::atomic<int> priority_;
+  base::atomic<orb_abstime_us> deadline_;
+  // Guarded by the timer lock of the queue, timer_time_ is 0 without timer
+  orb_abstime_us timer_time_{0};
+  uint32_t timer_interval_us_{0};
+  uint64_t timer_sequence_{0};
+  base::atomic<uint64_t> run_count_{0};
+};
+
+}  // namespace uorb
@@ -0,0 +1,234 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include <time.h>
+#include <unistd.h>
+#include <uorb/abs_time.h>
+
+#include "base/lockstep.h"
+#include "base/mutex.h"
+#include "base/orb_errno.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define ORB_HAVE_TSC_CLOCK 1
+#endif
+
+namespace {
+
+// State of the selected clock
+struct ClockState {
+  unsigned sequence;  // Odd while clock_state is written, see LoadClock()
+  orb_clock_source source;
+  clockid_t clock_id;  // Read by clock_gettime()
+  uint64_t tsc_base;   // TSC at base_us
+  uint64_t base_us;
+  uint64_t tsc_mult;  // Microseconds per TSC tick << kTscMultShift
+};
+
+constexpr int kTscMultShift = 40;
+
+// Written by orb_set_clock_source() under clock_lock, read by the clocks
+// without a lock. All the fields are accessed atomically.
+ClockState clock_state = {0, ORB_CLOCK_MONOTONIC, CLOCK_MONOTONIC, 0, 0, 0};
+uorb::base::Mutex clock_lock;
+
+template <typename T>
+T LoadRelaxed(const T &field) {
+  return __atomic_load_n(&field, __ATOMIC_RELAXED);
+}
+
+template <typename T>
+void StoreRelaxed(T *field, T value) {
+  __atomic_store_n(field, value, __ATOMIC_RELAXED);
+}
+
+// The source alone, written last with release by StoreClock()
+orb_clock_source LoadSource() {
+  return __atomic_load_n(&clock_state.source, __ATOMIC_ACQUIRE);
+}
+
+// A consistent copy of clock_state: retried while it is written, so that a
+// recalibration never mixes the TSC base of a calibration with the
+// multiplier of another
+ClockState LoadClock() {
+  ClockState state;
+  do {
+    state.sequence = __atomic_load_n(&clock_state.sequence, __ATOMIC_ACQUIRE);
+    state.source = LoadRelaxed(clock_state.source);
+    state.clock_id = LoadRelaxed(clock_state.clock_id);
+    state.tsc_base = LoadRelaxed(clock_state.tsc_base);
+    state.base_us = LoadRelaxed(clock_state.base_us);
+    state.tsc_mult = LoadRelaxed(clock_state.tsc_mult);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while ((state.sequence & 1) ||
+           state.sequence != LoadRelaxed(clock_state.sequence));
+  return state;
+}
+
+// Publish a new state, with clock_lock held. The other fields are written
+// before the source, and the source before the sequence is even again.
+void StoreClock(const ClockState &state) {
+  const unsigned sequence = clock_state.sequence;
+  StoreRelaxed(&clock_state.sequence, sequence + 1);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  StoreRelaxed(&clock_state.clock_id, state.clock_id);
+  StoreRelaxed(&clock_state.tsc_base, state.tsc_base);
+  StoreRelaxed(&clock_state.base_us, state.base_us);
+  StoreRelaxed(&clock_state.tsc_mult, state.tsc_mult);
+  __atomic_store_n(&clock_state.source, state.source, __ATOMIC_RELEASE);
+  __atomic_store_n(&clock_state.sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+orb_abstime_us ReadClock(clockid_t clock_id) {
+  timespec ts{};
+  clock_gettime(clock_id, &ts);
+  return orb_abstime_us(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+#ifdef ORB_HAVE_TSC_CLOCK
+
+// The TSC runs at a constant rate in all power states
+bool HasInvariantTsc() {
+  unsigned eax, ebx, ecx, edx;
+  if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007) {
+    return false;
+  }
+  __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+  return edx & (1U << 8);
+}
+
+// Read CLOCK_MONOTONIC in nanoseconds and the TSC at the same moment, from
+// the fastest of a few tries
+void ReadClocks(uint64_t *tsc, uint64_t *monotonic_ns) {
+  uint64_t best_duration = UINT64_MAX;
+  for (int i = 0; i < 8; ++i) {
+    timespec ts{};
+    const uint64_t before = __rdtsc();
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    const uint64_t after = __rdtsc();
+    if (after - before < best_duration) {
+      best_duration = after - before;
+      *tsc = before + best_duration / 2;
+      *monotonic_ns = uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    }
+  }
+}
+
+bool CalibrateTsc(ClockState *state) {
+  if (!HasInvariantTsc()) return false;
+
+  uint64_t start_tsc, start_ns, end_tsc, end_ns;
+  ReadClocks(&start_tsc, &start_ns);
+  usleep(50 * 1000);  // The error is about 100 ns over this time
+  ReadClocks(&end_tsc, &end_ns);
+  if (end_tsc <= start_tsc || end_ns <= start_ns) return false;
+
+  state->tsc_mult = uint64_t(
+      ((unsigned __int128)(end_ns - start_ns) << kTscMultShift) /
+      ((unsigned __int128)(end_tsc - start_tsc) * 1000));
+  state->tsc_base = end_tsc;
+  state->base_us = end_ns / 1000;
+  return true;
+}
+#endif
+
+}  // namespace
+
+bool orb_set_clock_source(enum orb_clock_source source) {
+  uorb::base::LockGuard<uorb::base::Mutex> lg(clock_lock);
+  ClockState state = LoadClock();
+  const auto previous = state.source;
+  state.source = source;
+
+  switch (source) {
+    case ORB_CLOCK_MONOTONIC:
+      state.clock_id = CLOCK_MONOTONIC;
+      break;
+
+    case ORB_CLOCK_MONOTONIC_COARSE:
+#ifdef CLOCK_MONOTONIC_COARSE
+      state.clock_id = CLOCK_MONOTONIC_COARSE;
+      break;
+#else
+      orb_errno = ENOTSUP;
+      return false;
+#endif
+
+    case ORB_CLOCK_TSC:
+#ifdef ORB_HAVE_TSC_CLOCK
+      if (!CalibrateTsc(&state)) {
+        orb_errno = ENOTSUP;
+        return false;
+      }
+      break;
+#else
+      orb_errno = ENOTSUP;
+      return false;
+#endif
+
+    case ORB_CLOCK_LOCKSTEP:
+      if (previous != ORB_CLOCK_LOCKSTEP) {
+        uorb::base::LockstepStart(orb_monotonic_time_us());
+      }
+      break;
+
+    default:
+      orb_errno = EINVAL;
+      return false;
+  }
+
+  StoreClock(state);
+  // Timed waits fall back to the system clock
+  if (previous == ORB_CLOCK_LOCKSTEP && source != ORB_CLOCK_LOCKSTEP) {
+    uorb::base::LockstepStop();
+  }
+  return true;
+}
+
+enum orb_clock_source orb_get_clock_source(void) { return LoadSource(); }
+
+orb_abstime_us orb_monotonic_time_us(void) {
+  if (LoadSource() == ORB_CLOCK_LOCKSTEP) {
+    return uorb::base::LockstepTime();
+  }
+  return ReadClock(CLOCK_MONOTONIC);
+}
+
+orb_abstime_us orb_absolute_time_us(void) {
+  const ClockState state = LoadClock();
+  if (state.source == ORB_CLOCK_LOCKSTEP) {
+    return uorb::base::LockstepTime();
+  }
+
+#ifdef ORB_HAVE_TSC_CLOCK
+  if (state.source == ORB_CLOCK_TSC) {
+    // The TSC of another core can be slightly behind the one of the base
+    const int64_t delta = int64_t(__rdtsc() - state.tsc_base);
+    const uint64_t ticks = delta > 0 ? delta : 0;
+    return state.base_us +
+           orb_abstime_us(((unsigned __int128)ticks * state.tsc_mult) >>
+                          kTscMultShift);
+  }
+#endif
+
+  return ReadClock(state.clock_id);
+}
+
+bool orb_set_lockstep_time(orb_abstime_us time_us) {
+  if (!uorb::base::LockstepSetTime(time_us)) {
+    orb_errno = EINVAL;
+    return false;
+  }
+  return true;
+}
+
+bool orb_advance_lockstep_time(uint64_t delta_us) {
+  // Under the lock of the lockstep time, so that concurrent calls add up
+  if (!uorb::base::LockstepAdvance(delta_us)) {
+    orb_errno = EINVAL;
+    return false;
+  }
+  return true;
+}
@@ -6,7 +6,9 @@
 #include <pthread.h>
 #include <stdint.h>
 #include <time.h>
+#include <uorb/abs_time.h>
 
+#include "base/lockstep.h"
 #include "base/mutex.h"
 #include "uorb/internal/noncopyable.h"
 
@@ -63,6 +65,10 @@ class ConditionVariable : public internal::Noncopyable {
 
   // Return true if successful
   bool wait_for(Mutex &lock, uint32_t time_ms) {  // NOLINT
+    if (orb_get_clock_source() == ORB_CLOCK_LOCKSTEP) {
+      return LockstepWaitUntil(&cond_, lock.native_handle(),
+                               orb_monotonic_time_us() + time_ms * 1000ULL);
+    }
 #ifdef __APPLE__
     struct timespec rel_ts = {.tv_sec = time_ms / 1000,
                               .tv_nsec = (time_ms % 1000) * 1000000};
@@ -87,6 +93,29 @@ class ConditionVariable : public internal::Noncopyable {
     return true;
   }
 
+  // Wait until an absolute time of orb_monotonic_time_us(), which follows the
+  // simulation time with ORB_CLOCK_LOCKSTEP. Returns false on timeout.
+  bool wait_until_us(Mutex &lock, uint64_t time_us) {  // NOLINT
+    if (orb_get_clock_source() == ORB_CLOCK_LOCKSTEP) {
+      return LockstepWaitUntil(&cond_, lock.native_handle(), time_us);
+    }
+#ifdef __APPLE__
+    const struct timespec now = get_now_time();
+    const uint64_t now_us = now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+    const uint64_t rel_us = time_us > now_us ? time_us - now_us : 0;
+    struct timespec rel_ts = {.tv_sec = time_t(rel_us / 1000000),
+                              .tv_nsec = long(rel_us % 1000000) * 1000};
+    return pthread_cond_timedwait_relative_np(&cond_, lock.native_handle(),
+                                              &rel_ts) == 0;
+#else
+    struct timespec until_time {};
+    until_time.tv_sec = time_t(time_us / 1000000);
+    until_time.tv_nsec = long(time_us % 1000000) * 1000;
+    return pthread_cond_timedwait(&cond_, lock.native_handle(),
+                                  &until_time) == 0;
+#endif
+  }
+
   pthread_cond_t *native_handle() { return &cond_; }
 
  private:
@@ -0,0 +1,167 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include "base/lock_stats.h"
+
+#include <uorb/internal/atomic.h>
+
+#include <algorithm>
+#include <map>
+
+#include "base/mutex.h"
+
+namespace {
+
+using uorb::base::LockStats;
+
+// Slots per thread, mutexes beyond that are not recorded by the thread
+constexpr unsigned kSlotBits = 8;
+constexpr unsigned kSlotCount = 1U << kSlotBits;
+
+class ThreadLockStats;
+
+// Buffers of the running threads and the sums of the exited ones
+struct Registry {
+  uorb::base::Mutex lock;
+  std::vector<const ThreadLockStats *> threads;
+  std::map<const void *, LockStats> exited;
+};
+
+// Never destroyed: threads may exit after the static destructors have run
+Registry &registry() {
+  static auto *registry = new Registry;
+  return *registry;
+}
+
+void Merge(const LockStats &from, std::map<const void *, LockStats> *to) {
+  auto result = to->emplace(from.mutex, from);
+  if (result.second) return;
+
+  auto &stats = result.first->second;
+  stats.lock_count += from.lock_count;
+  stats.contended_count += from.contended_count;
+  stats.wait_ns += from.wait_ns;
+  stats.max_wait_ns = std::max(stats.max_wait_ns, from.max_wait_ns);
+  stats.hold_ns += from.hold_ns;
+  stats.max_hold_ns = std::max(stats.max_hold_ns, from.max_hold_ns);
+}
+
+/**
+ * Open addressing table of the mutexes used by one thread. Only the owning
+ * thread writes it; CollectLockStats() reads it concurrently.
+ */
+class ThreadLockStats {
+ public:
+  ThreadLockStats() {
+    auto &r = registry();
+    uorb::base::LockGuard<uorb::base::Mutex> lg(r.lock);
+    r.threads.push_back(this);
+  }
+
+  ~ThreadLockStats() {
+    auto &r = registry();
+    uorb::base::LockGuard<uorb::base::Mutex> lg(r.lock);
+    AddTo(&r.exited);
+    r.threads.erase(std::find(r.threads.begin(), r.threads.end(), this));
+  }
+
+  void Record(const void *mutex, const char *name, unsigned instance,
+              bool contended, uint64_t wait_ns, uint64_t hold_ns) {
+    auto hash = unsigned((uintptr_t(mutex) >> 4) * 0x9E3779B97F4A7C15ULL >>
+                         (64 - kSlotBits));
+    for (unsigned i = 0; i < kSlotCount; ++i) {
+      auto &slot = slots_[(hash + i) & (kSlotCount - 1)];
+      auto key = slot.mutex.load_relaxed();
+      if (!key) {
+        slot.name = name;
+        slot.instance = instance;
+        slot.mutex.store(mutex);  // Publishes name and instance
+        key = mutex;
+      }
+      if (key != mutex) continue;
+
+      Add(&slot.lock_count, 1);
+      Add(&slot.hold_ns, hold_ns);
+      SetMax(&slot.max_hold_ns, hold_ns);
+      if (contended) {
+        Add(&slot.contended_count, 1);
+        Add(&slot.wait_ns, wait_ns);
+        SetMax(&slot.max_wait_ns, wait_ns);
+      }
+      return;
+    }
+  }
+
+  void AddTo(std::map<const void *, LockStats> *stats) const {
+    for (const auto &slot : slots_) {
+      auto mutex = slot.mutex.load();
+      if (!mutex) continue;
+
+      LockStats s{};
+      s.mutex = mutex;
+      s.name = slot.name;
+      s.instance = slot.instance;
+      s.lock_count = slot.lock_count.load_relaxed();
+      s.contended_count = slot.contended_count.load_relaxed();
+      s.wait_ns = slot.wait_ns.load_relaxed();
+      s.max_wait_ns = slot.max_wait_ns.load_relaxed();
+      s.hold_ns = slot.hold_ns.load_relaxed();
+      s.max_hold_ns = slot.max_hold_ns.load_relaxed();
+      Merge(s, stats);
+    }
+  }
+
+ private:
+  using Counter = uorb::base::atomic<uint64_t>;
+
+  struct Slot {
+    uorb::base::atomic<const void *> mutex;
+    const char *name;
+    unsigned instance;
+    Counter lock_count;
+    Counter contended_count;
+    Counter wait_ns;
+    Counter max_wait_ns;
+    Counter hold_ns;
+    Counter max_hold_ns;
+  };
+
+  // Single writer, so no read-modify-write instructions are needed
+  static void Add(Counter *counter, uint64_t value) {
+    counter->store_relaxed(counter->load_relaxed() + value);
+  }
+  static void SetMax(Counter *counter, uint64_t value) {
+    if (value > counter->load_relaxed()) counter->store_relaxed(value);
+  }
+
+  Slot slots_[kSlotCount]{};
+};
+
+}  // namespace
+
+void uorb::base::RecordLockStats(const void *mutex, const char *name,
+                                 unsigned instance, bool contended,
+                                 uint64_t wait_ns, uint64_t hold_ns) {
+  static thread_local ThreadLockStats thread_stats;
+  thread_stats.Record(mutex, name, instance, contended, wait_ns, hold_ns);
+}
+
+std::vector<uorb::base::LockStats> uorb::base::CollectLockStats() {
+  std::map<const void *, LockStats> sums;
+  {
+    auto &r = registry();
+    LockGuard<Mutex> lg(r.lock);
+    sums = r.exited;
+    for (auto thread : r.threads) thread->AddTo(&sums);
+  }
+
+  std::vector<LockStats> result;
+  result.reserve(sums.size());
+  for (const auto &sum : sums) result.push_back(sum.second);
+  std::sort(result.begin(), result.end(),
+            [](const LockStats &a, const LockStats &b) {
+              return a.wait_ns != b.wait_ns ? a.wait_ns > b.wait_ns
+                                            : a.lock_count > b.lock_count;
+            });
+  return result;
+}
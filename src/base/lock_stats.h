@@ -0,0 +1,51 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#pragma once
+
+#include <time.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace uorb {
+namespace base {
+
+/**
+ * Contention statistics of one named Mutex, see UORB_LOCK_STATS.
+ */
+struct LockStats {
+  const void *mutex;
+  const char *name;
+  unsigned instance;
+  uint64_t lock_count;
+  uint64_t contended_count;
+  uint64_t wait_ns;
+  uint64_t max_wait_ns;
+  uint64_t hold_ns;
+  uint64_t max_hold_ns;
+};
+
+// CLOCK_MONOTONIC with nanosecond resolution, real time even with the
+// lockstep clock
+static inline uint64_t LockStatsTimeNs() {
+  struct timespec ts = {};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Record one critical section of a named mutex into the buffer of the calling
+ * thread. Only the owning thread writes a buffer, so this takes no lock.
+ */
+void RecordLockStats(const void *mutex, const char *name, unsigned instance,
+                     bool contended, uint64_t wait_ns, uint64_t hold_ns);
+
+/**
+ * Sum up the buffers of all threads, including the threads that have exited.
+ * @return The statistics of every recorded mutex, longest total wait first.
+ */
+std::vector<LockStats> CollectLockStats();
+
+}  // namespace base
+}  // namespace uorb
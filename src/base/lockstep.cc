@@ -0,0 +1,127 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include "base/lockstep.h"
+
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "base/condition_variable.h"
+#include "base/mutex.h"
+
+namespace {
+
+struct Wait {
+  pthread_cond_t *cond;
+  pthread_mutex_t *lock;
+  bool timed_out;  // Guarded by *lock
+  bool firing;     // Guarded by registry_lock
+};
+
+// Waits are woken without holding registry_lock, so that the lock order is
+// always the lock of the wait, then registry_lock.
+uorb::base::Mutex registry_lock;
+uorb::base::ConditionVariable fired;  // A firing flag was cleared
+std::set<std::pair<uint64_t, Wait *>> waits;  // Guarded by registry_lock
+bool started = false;                         // Guarded by registry_lock
+// Written under registry_lock, read without it by LockstepTime()
+uint64_t lockstep_time_us = 0;
+
+// Wake the waits taken from the registry, then let them return
+void Fire(const std::vector<Wait *> &expired) {
+  for (auto wait : expired) {
+    pthread_mutex_lock(wait->lock);
+    wait->timed_out = true;
+    pthread_cond_broadcast(wait->cond);
+    pthread_mutex_unlock(wait->lock);
+  }
+
+  if (expired.empty()) return;
+  uorb::base::LockGuard<uorb::base::Mutex> lg(registry_lock);
+  for (auto wait : expired) wait->firing = false;  // The last access
+  fired.notify_all();
+}
+
+// Set the time, or advance it by time_us, and wake the expired waits
+bool UpdateTime(uint64_t time_us, bool advance) {
+  std::vector<Wait *> expired;
+  {
+    uorb::base::LockGuard<uorb::base::Mutex> lg(registry_lock);
+    if (!started) return false;
+    if (advance) time_us += lockstep_time_us;
+    if (time_us < lockstep_time_us) return false;  // Backwards, or wrapped
+    __atomic_store_n(&lockstep_time_us, time_us, __ATOMIC_RELEASE);
+    while (!waits.empty() && waits.begin()->first <= time_us) {
+      waits.begin()->second->firing = true;
+      expired.push_back(waits.begin()->second);
+      waits.erase(waits.begin());
+    }
+  }
+  Fire(expired);
+  return true;
+}
+
+}  // namespace
+
+void uorb::base::LockstepStart(uint64_t time_us) {
+  LockGuard<Mutex> lg(registry_lock);
+  __atomic_store_n(&lockstep_time_us, time_us, __ATOMIC_RELEASE);
+  started = true;
+}
+
+void uorb::base::LockstepStop() {
+  std::vector<Wait *> expired;
+  {
+    LockGuard<Mutex> lg(registry_lock);
+    started = false;
+    for (const auto &entry : waits) {
+      entry.second->firing = true;
+      expired.push_back(entry.second);
+    }
+    waits.clear();
+  }
+  Fire(expired);
+}
+
+uint64_t uorb::base::LockstepTime() {
+  return __atomic_load_n(&lockstep_time_us, __ATOMIC_ACQUIRE);
+}
+
+bool uorb::base::LockstepSetTime(uint64_t time_us) {
+  return UpdateTime(time_us, false);
+}
+
+bool uorb::base::LockstepAdvance(uint64_t delta_us) {
+  return UpdateTime(delta_us, true);
+}
+
+bool uorb::base::LockstepWaitUntil(pthread_cond_t *cond, pthread_mutex_t *lock,
+                                   uint64_t time_us) {
+  Wait wait{cond, lock, false, false};
+  {
+    LockGuard<Mutex> lg(registry_lock);
+    if (!started || time_us <= lockstep_time_us) return false;
+    waits.insert({time_us, &wait});
+  }
+
+  pthread_cond_wait(cond, lock);
+
+  bool firing;
+  {
+    LockGuard<Mutex> lg(registry_lock);
+    waits.erase({time_us, &wait});
+    firing = wait.firing;
+  }
+  if (firing) {
+    // Fire() is about to lock *lock, and must be done with the wait before it
+    // goes out of scope
+    pthread_mutex_unlock(lock);
+    {
+      LockGuard<Mutex> lg(registry_lock);
+      while (wait.firing) fired.wait(registry_lock);
+    }
+    pthread_mutex_lock(lock);
+  }
+  return !wait.timed_out;
+}
@@ -0,0 +1,37 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+
+namespace uorb {
+namespace base {
+
+// Timed waits of ConditionVariable while ORB_CLOCK_LOCKSTEP is selected. They
+// are woken by LockstepSetTime() instead of the system clock.
+
+// Start accepting waits, at the time time_us
+void LockstepStart(uint64_t time_us);
+
+// Wake all the waits as timed out and stop accepting new ones
+void LockstepStop();
+
+// The time of ORB_CLOCK_LOCKSTEP, read without the lock
+uint64_t LockstepTime();
+
+// Set the time and wake the expired waits. Returns false if not started or if
+// the time would go backwards.
+bool LockstepSetTime(uint64_t time_us);
+
+// Advance the time by delta_us in one step, like LockstepSetTime()
+bool LockstepAdvance(uint64_t delta_us);
+
+// Wait on cond, with lock held, until notified or until the lockstep time
+// reaches time_us. Returns false on timeout, or right away if not started.
+bool LockstepWaitUntil(pthread_cond_t *cond, pthread_mutex_t *lock,
+                       uint64_t time_us);
+
+}  // namespace base
+}  // namespace uorb
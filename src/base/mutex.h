@@ -12,10 +12,18 @@
 
 #include "uorb/internal/noncopyable.h"
 
+#ifdef UORB_LOCK_STATS
+#include "base/lock_stats.h"
+#endif
+
 namespace uorb {
 namespace base {
 
 /// The standard Mutex type.
+///
+/// With UORB_LOCK_STATS, named mutexes first try to take the lock and record
+/// how long they waited when that fails, and how long the lock was held (see
+/// lock_stats.h). Unnamed mutexes and the default build use pthread only.
 class Mutex : internal::Noncopyable {
 #define SAFE_PTHREAD_MUTEX(fncall)          \
   do { /* run fncall if is_safe_ is true */ \
@@ -36,12 +44,74 @@ class Mutex : internal::Noncopyable {
   Mutex(const Mutex &) = delete;
   Mutex &operator=(const Mutex &) = delete;
 
+  /**
+   * A mutex whose contention is reported under this name (usually the topic
+   * name) in UORB_LOCK_STATS builds.
+   * @param name Must outlive the mutex
+   */
+#if defined(PTHREAD_MUTEX_INITIALIZER) && defined(UORB_LOCK_STATS)
+  constexpr explicit Mutex(const char *name, unsigned instance = 0) noexcept
+      : name_(name), instance_(instance) {}
+#elif defined(PTHREAD_MUTEX_INITIALIZER)
+  constexpr explicit Mutex(const char *, unsigned = 0) noexcept {}
+#else
+  explicit Mutex(const char *name, unsigned instance = 0) noexcept : Mutex() {
+#ifdef UORB_LOCK_STATS
+    name_ = name;
+    instance_ = instance;
+#else
+    (void)name;
+    (void)instance;
+#endif
+  }
+#endif
+
+#ifdef UORB_LOCK_STATS
+  void lock() {
+    if (!name_) {
+      SAFE_PTHREAD_MUTEX(pthread_mutex_lock);
+      return;
+    }
+
+    if (try_lock()) return;
+    const auto start_time = LockStatsTimeNs();
+    SAFE_PTHREAD_MUTEX(pthread_mutex_lock);
+    locked_time_ns_ = LockStatsTimeNs();
+    wait_ns_ = locked_time_ns_ - start_time;
+    contended_ = true;
+  }
+
+  void unlock() {
+    if (!name_) {
+      SAFE_PTHREAD_MUTEX(pthread_mutex_unlock);
+      return;
+    }
+
+    // Only valid while the lock is held
+    const auto hold_ns = LockStatsTimeNs() - locked_time_ns_;
+    const auto wait_ns = wait_ns_;
+    const bool contended = contended_;
+    SAFE_PTHREAD_MUTEX(pthread_mutex_unlock);
+    RecordLockStats(this, name_, instance_, contended, wait_ns, hold_ns);
+  }
+
+  bool try_lock() noexcept {
+    if (is_safe_ && 0 != pthread_mutex_trylock(&mutex_)) return false;
+    if (name_) {
+      locked_time_ns_ = LockStatsTimeNs();
+      wait_ns_ = 0;
+      contended_ = false;
+    }
+    return true;
+  }
+#else
   void lock() { SAFE_PTHREAD_MUTEX(pthread_mutex_lock); }
   void unlock() { SAFE_PTHREAD_MUTEX(pthread_mutex_unlock); }
 
   bool try_lock() noexcept {
     return is_safe_ ? 0 == pthread_mutex_trylock(&mutex_) : true;
   }
+#endif
 
   pthread_mutex_t *native_handle() noexcept { return &mutex_; }
 
@@ -58,6 +128,15 @@ class Mutex : internal::Noncopyable {
   volatile bool is_safe_{};
   inline void SetIsSafe() { is_safe_ = true; }
 #endif
+
+#ifdef UORB_LOCK_STATS
+  const char *name_{};
+  unsigned instance_{};
+  // Written by the owner of the lock
+  uint64_t locked_time_ns_{};
+  uint64_t wait_ns_{};
+  bool contended_{};
+#endif
 };
 
 /**
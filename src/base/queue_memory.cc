@@ -0,0 +1,52 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include "queue_memory.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <new>
+
+static inline size_t AlignUp(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+uint8_t *uorb::base::AllocateQueue(size_t bytes, size_t *mapped_bytes) {
+  *mapped_bytes = 0;
+  if (bytes < kLargeQueueBytes) return new (std::nothrow) uint8_t[bytes];
+
+  // Map one huge page more than needed and keep the aligned part
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  const size_t size = AlignUp(bytes, page_size);
+  const size_t reserved = size + kLargeQueueBytes;
+  void *mapping = mmap(nullptr, reserved, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapping == MAP_FAILED) return nullptr;
+
+  const auto begin = reinterpret_cast<uintptr_t>(mapping);
+  const auto aligned = AlignUp(begin, kLargeQueueBytes);
+  if (aligned > begin) munmap(mapping, aligned - begin);
+  const size_t tail = begin + reserved - (aligned + size);
+  if (tail) munmap(reinterpret_cast<void *>(aligned + size), tail);
+
+  auto queue = reinterpret_cast<uint8_t *>(aligned);
+#ifdef MADV_HUGEPAGE
+  // Fewer TLB misses when the messages are copied, if the system allows it
+  madvise(queue, size, MADV_HUGEPAGE);
+#endif
+  // Fault all the pages in now instead of during the first publications
+  memset(queue, 0, size);
+
+  *mapped_bytes = size;
+  return queue;
+}
+
+void uorb::base::FreeQueue(uint8_t *queue, size_t mapped_bytes) {
+  if (mapped_bytes) {
+    munmap(queue, mapped_bytes);
+  } else {
+    delete[] queue;
+  }
+}
@@ -0,0 +1,31 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace uorb {
+namespace base {
+
+// Queues of at least this size, e.g. a few camera frames, get their own
+// mapping aligned to transparent huge pages
+constexpr size_t kLargeQueueBytes = 2 * 1024 * 1024;
+
+/**
+ * Allocate the memory of a message queue.
+ *
+ * Large queues are mapped and written once, so that publishing does not take
+ * page faults later.
+ *
+ * @param mapped_bytes  Receives the size to pass to FreeQueue(), 0 if the
+ * queue is on the heap.
+ * @return null if out of memory.
+ */
+uint8_t *AllocateQueue(size_t bytes, size_t *mapped_bytes);
+
+void FreeQueue(uint8_t *queue, size_t mapped_bytes);
+
+}  // namespace base
+}  // namespace uorb
@@ -0,0 +1,34 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include "base/queue_memory.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+
+TEST(QueueMemoryTest, small_queue) {
+  size_t mapped_bytes = 1;
+  auto queue = uorb::base::AllocateQueue(100, &mapped_bytes);
+  ASSERT_NE(queue, nullptr);
+  EXPECT_EQ(mapped_bytes, 0);
+  memset(queue, 1, 100);
+  uorb::base::FreeQueue(queue, mapped_bytes);
+}
+
+TEST(QueueMemoryTest, large_queue) {
+  const size_t bytes = uorb::base::kLargeQueueBytes + 1000;
+  size_t mapped_bytes = 0;
+  auto queue = uorb::base::AllocateQueue(bytes, &mapped_bytes);
+  ASSERT_NE(queue, nullptr);
+  EXPECT_GE(mapped_bytes, bytes);
+  EXPECT_LT(mapped_bytes, bytes + 65536);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(queue) % uorb::base::kLargeQueueBytes,
+            0);
+
+  // Already written once
+  EXPECT_EQ(queue[0], 0);
+  EXPECT_EQ(queue[bytes - 1], 0);
+  memset(queue, 1, bytes);
+  uorb::base::FreeQueue(queue, mapped_bytes);
+}
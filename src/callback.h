@@ -3,6 +3,8 @@
 //
 #pragma once
 
+#include <uorb/uorb.h>
+
 #include "base/condition_variable.h"
 
 namespace uorb {
@@ -40,4 +42,12 @@ struct SemaphoreCallback : public Callback<>, public base::SimpleSemaphore {
   void operator()() override { release(); }
 };
 
+// The callback of orb_set_subscription_callback()
+struct FunctionCallback : public Callback<> {
+  orb_callback_t function{nullptr};
+  void *arg{nullptr};
+
+  void operator()() override { function(arg); }
+};
+
 }  // namespace uorb
@@ -61,5 +61,5 @@ class uorb::DeviceMaster {
   static DeviceMaster instance_;
 
   List<DeviceNode *> node_list_{};
-  mutable base::Mutex lock_{};
+  mutable base::Mutex lock_{"orb_device_master"};
 };
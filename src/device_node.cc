@@ -1,71 +1,259 @@
 #include "device_node.h"
 
+#include <uorb/abs_time.h>
+
+#include <algorithm>
 #include <cerrno>
 #include <cstring>
 
-static inline uint16_t RoundPowOfTwo(uint16_t n) {
-  if (n == 0) {
-    return 1;
-  }
-
-  // Avoid is already a power of 2
-  uint32_t value = n - 1;
-
-  // Fill 1
-  value |= value >> 1U;
-  value |= value >> 2U;
-  value |= value >> 4U;
-  value |= value >> 8U;
+#include "base/queue_memory.h"
+#include "subscription_impl.h"
 
-  // Unable to round-up, take the value of round-down
-  if (value == UINT16_MAX) {
-    value >>= 1U;
-  }
-
-  return value + 1;
+// Queues hold exactly the requested number of messages
+static inline unsigned QueueSize(unsigned n) {
+  if (n == 0) return 1;
+  return n < ORB_QUEUE_SIZE_MAX ? n : ORB_QUEUE_SIZE_MAX;
 }
 
 uorb::DeviceNode::DeviceNode(const struct orb_metadata &meta, uint8_t instance)
     : meta_(meta),
       instance_(instance),
-      queue_size_(RoundPowOfTwo(meta.o_queue_size)) {}
+      topic_queue_size_(QueueSize(meta.o_queue_size)),
+      queue_size_(topic_queue_size_),
+      lock_(meta.o_name, instance) {}
+
+uorb::DeviceNode::~DeviceNode() {
+  base::FreeQueue(data_, data_mapped_bytes_);
+  delete[] publish_time_ns_;
+}
 
-uorb::DeviceNode::~DeviceNode() { delete[] data_; }
+// Same clock as orb_monotonic_time_us(), with nanosecond resolution
+static inline uint64_t MonotonicTimeNs() {
+  if (orb_get_clock_source() == ORB_CLOCK_LOCKSTEP) {
+    return orb_monotonic_time_us() * 1000;
+  }
+  struct timespec ts = {};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
 
-bool uorb::DeviceNode::Copy(void *dst, unsigned *sub_generation_ptr) const {
-  if (!dst || !sub_generation_ptr || !data_) {
+// Weight of a new publish interval in the moving average: 1 / 2^kRateShift
+static constexpr unsigned kRateShift = 3;
+
+bool uorb::DeviceNode::Copy(void *dst, unsigned *sub_generation_ptr,
+                            orb_copy_info *info, unsigned depth) const {
+  if (!dst || !sub_generation_ptr) {
     return false;
   }
 
   auto &sub_generation = *sub_generation_ptr;
+  unsigned lost = 0;
 
   base::LockGuard<base::Mutex> lg(lock_);
+  // Not published yet, or the only slot is loaned, see Loan()
+  if (!queued_count_) return false;
 
   // If queue_size is 4 and cur_generation is 10, then 6, 7, 8, 9 are in the
   // range, and others are not.
 
   // The subscriber already read the latest message, but nothing new was
   // published yet. Return the previous message */
-  if (generation_ == sub_generation) {
-    sub_generation = generation_ - 1;
-  } else if (generation_ - sub_generation > queue_size_) {
+  unsigned count;
+  OldestGeneration(&count);
+  if (!depth) depth = topic_queue_size_;
+  if (depth < count) count = depth;
+
+  const unsigned generation = generation_.load_relaxed();
+  if (generation == sub_generation) {
+    sub_generation = generation - 1;
+  } else if (generation - sub_generation > count) {
     // Reader is too far behind: some messages are lost
-    sub_generation = generation_ - queue_size_;
+    lost = generation - sub_generation - count;
+    lost_count_.fetch_add_relaxed(lost);
+    sub_generation = generation - count;
   }
 
-  memcpy(dst, data_ + (meta_.o_size * (sub_generation & (queue_size_ - 1))),
-         meta_.o_size);
+  const unsigned index = Index(sub_generation);
+  memcpy(dst, Slot(index), meta_.o_size);
+
+#ifdef UORB_LATENCY_STATS
+  latency_.Record(MonotonicTimeNs() - publish_time_ns_[index]);
+#endif
+
+  if (info) {
+    info->generation = sub_generation;
+    info->timestamp = publish_time_ns_[index] / 1000;
+    info->lost = lost;
+  }
 
   ++sub_generation;
+  copy_count_.fetch_add_relaxed(1);
+
+  return true;
+}
+
+unsigned uorb::DeviceNode::CopyBatch(uint8_t *dst, size_t stride,
+                                     unsigned max_count,
+                                     unsigned *sub_generation_ptr,
+                                     orb_copy_info *infos,
+                                     unsigned depth) const {
+  auto &sub_generation = *sub_generation_ptr;
+
+  base::LockGuard<base::Mutex> lg(lock_);
+  const unsigned generation = generation_.load_relaxed();
+  if (!queued_count_ || !max_count || generation == sub_generation) return 0;
+
+  unsigned count;
+  OldestGeneration(&count);
+  if (!depth) depth = topic_queue_size_;
+  if (depth < count) count = depth;
+
+  unsigned lost = 0;
+  if (generation - sub_generation > count) {
+    lost = generation - sub_generation - count;
+    lost_count_.fetch_add_relaxed(lost);
+    sub_generation = generation - count;
+  }
+
+#ifdef UORB_LATENCY_STATS
+  const auto now_ns = MonotonicTimeNs();
+#endif
+  unsigned copied = 0;
+  for (; sub_generation != generation && copied < max_count;
+       ++sub_generation, ++copied) {
+    CopyGeneration(sub_generation, dst + stride * copied, &infos[copied]);
+#ifdef UORB_LATENCY_STATS
+    latency_.Record(now_ns - publish_time_ns_[Index(sub_generation)]);
+#endif
+  }
+  infos[0].lost = lost;
+  copy_count_.fetch_add_relaxed(copied);
+  return copied;
+}
+
+unsigned uorb::DeviceNode::Index(unsigned generation) const {
+  // head_ is the index of generation_, generation is at most queue_size_
+  // messages older. Not generation % queue_size_, which would jump when
+  // the generation wraps around.
+  const unsigned index =
+      head_ + queue_size_ - (generation_.load_relaxed() - generation);
+  return index < queue_size_ ? index : index - queue_size_;
+}
+
+unsigned uorb::DeviceNode::OldestGeneration(unsigned *count) const {
+  *count = queued_count_;
+  return generation_.load_relaxed() - *count;
+}
 
+unsigned uorb::DeviceNode::FirstGenerationAfter(uint64_t time_us) const {
+  // The publish times of the queue are in generation order
+  unsigned count;
+  unsigned first = OldestGeneration(&count);
+  while (count > 0) {
+    const unsigned half = count / 2;
+    const unsigned middle = first + half;
+    if (publish_time_ns_[Index(middle)] / 1000 <= time_us) {
+      first = middle + 1;
+      count -= half + 1;
+    } else {
+      count = half;
+    }
+  }
+  return first;
+}
+
+void uorb::DeviceNode::CopyGeneration(unsigned generation, void *dst,
+                                      orb_copy_info *info) const {
+  const unsigned index = Index(generation);
+  if (dst) memcpy(dst, Slot(index), meta_.o_size);
+  if (info) {
+    info->generation = generation;
+    info->timestamp = publish_time_ns_[index] / 1000;
+    info->lost = 0;
+  }
+}
+
+bool uorb::DeviceNode::CopyLatest(void *dst, orb_copy_info *info) const {
+  base::LockGuard<base::Mutex> lg(lock_);
+  if (!queued_count_) return false;
+
+  CopyGeneration(generation_.load_relaxed() - 1, dst, info);
+  return true;
+}
+
+bool uorb::DeviceNode::CopyAtTime(uint64_t time_us, void *dst,
+                                  orb_copy_info *info) const {
+  if (!dst && !info) return false;
+
+  base::LockGuard<base::Mutex> lg(lock_);
+  if (!queued_count_) return false;
+
+  unsigned count;
+  const unsigned oldest = OldestGeneration(&count);
+  const unsigned after = FirstGenerationAfter(time_us);
+  if (after == oldest) return false;  // All published later
+
+  CopyGeneration(after - 1, dst, info);
   return true;
 }
 
+unsigned uorb::DeviceNode::CopyRange(uint64_t start_us, uint64_t end_us,
+                                     void *dst, unsigned max_count,
+                                     orb_copy_info *infos) const {
+  if ((!dst && !infos) || start_us > end_us) return 0;
+
+  base::LockGuard<base::Mutex> lg(lock_);
+  if (!queued_count_) return 0;
+
+  unsigned count;
+  const unsigned oldest = OldestGeneration(&count);
+  unsigned generation = start_us ? FirstGenerationAfter(start_us - 1) : oldest;
+  const unsigned end = FirstGenerationAfter(end_us);
+  // Only if the clock went backwards, see orb_set_clock_source()
+  if (end - oldest < generation - oldest) return 0;
+
+  auto buffer = static_cast<uint8_t *>(dst);
+  unsigned copied = 0;
+  for (; generation != end && copied < max_count; ++generation, ++copied) {
+    CopyGeneration(generation,
+                   buffer ? buffer + size_t(meta_.o_size) * copied : nullptr,
+                   infos ? &infos[copied] : nullptr);
+  }
+  return copied;
+}
+
+float uorb::DeviceNode::publish_rate_hz() const {
+  const auto last_publish_time = last_publish_time_us_.load_relaxed();
+  uint64_t interval = publish_interval_us_.load_relaxed();
+  if (!last_publish_time || !interval) return 0;
+
+  // Decay when the publisher stopped
+  const auto since_last_publish = orb_elapsed_time_us(last_publish_time);
+  if (since_last_publish > interval) interval = since_last_publish;
+  return 1e6f / interval;
+}
+
 unsigned uorb::DeviceNode::updates_available(unsigned generation) const {
-  return generation_ - generation;
+  return generation_.load_acquire() - generation;
 }
 
-bool uorb::DeviceNode::Publish(const void *data) {
+bool uorb::DeviceNode::Allocate() {
+  size_t mapped_bytes;
+  data_ = base::AllocateQueue(size_t(meta_.o_size) * queue_size_,
+                              &mapped_bytes);
+
+  /* failed or could not allocate */
+  if (nullptr == data_) {
+    errno = ENOMEM;
+    return false;
+  }
+
+  data_mapped_bytes_ = mapped_bytes;
+  publish_time_ns_ = new uint64_t[queue_size_];
+  return true;
+}
+
+bool uorb::DeviceNode::Publish(const void *data, bool if_changed) {
   if (data == nullptr) {
     errno = EFAULT;
     return false;
@@ -73,51 +261,250 @@ bool uorb::DeviceNode::Publish(const void *data) {
 
   base::LockGuard<base::Mutex> lg(lock_);
 
-  if (nullptr == data_) {
-    data_ = new uint8_t[meta_.o_size * queue_size_];
+  // The loaned slot is the next one, see Loan()
+  if (loaned_) {
+    errno = EBUSY;
+    return false;
+  }
+  if (nullptr == data_ && !Allocate()) return false;
+
+  // The latest message, null before the first one
+  const uint8_t *latest =
+      queued_count_ ? Slot(Index(generation_.load_relaxed() - 1)) : nullptr;
 
-    /* failed or could not allocate */
-    if (nullptr == data_) {
-      errno = ENOMEM;
-      return false;
+  if (latest &&
+      (if_changed || (meta_.o_flags & ORB_FLAG_SUPPRESS_DUPLICATES))) {
+    // The padding at the end may not be initialized by the publisher
+    const size_t size =
+        meta_.o_size_no_padding ? meta_.o_size_no_padding : meta_.o_size;
+    if (memcmp(latest, data, size) == 0) {
+      suppressed_count_.fetch_add_relaxed(1);
+      return true;
     }
   }
 
-  memcpy(data_ + (meta_.o_size * (generation_ % queue_size_)),
-         (const char *)data, meta_.o_size);
+  // Before the latest message is overwritten, with a queue size of 1
+  UpdateChangedFields(latest, data);
+
+  memcpy(Slot(head_), data, meta_.o_size);
+  Commit();
+  return true;
+}
+
+void *uorb::DeviceNode::Loan() {
+  base::LockGuard<base::Mutex> lg(lock_);
+
+  if (loaned_) {
+    errno = EBUSY;
+    return nullptr;
+  }
+  if (nullptr == data_ && !Allocate()) return nullptr;
+
+  // The oldest message is given up now, it is overwritten in place
+  if (queued_count_ == queue_size_) queued_count_--;
+  loaned_ = true;
+  return Slot(head_);
+}
 
-  generation_++;
+bool uorb::DeviceNode::PublishLoan() {
+  base::LockGuard<base::Mutex> lg(lock_);
 
-  for (auto callback : callbacks_) {
-    (*callback).Notify();
+  if (!loaned_) {
+    errno = EINVAL;
+    return false;
   }
+  loaned_ = false;
+
+  const uint8_t *latest =
+      queued_count_ ? Slot(Index(generation_.load_relaxed() - 1)) : nullptr;
+  UpdateChangedFields(latest, Slot(head_));
+  Commit();
 
+  // Deferred while the slot was loaned
+  Resize(RequiredQueueSize());
   return true;
 }
 
-void uorb::DeviceNode::add_subscriber() {
+void uorb::DeviceNode::UpdateChangedFields(const uint8_t *latest,
+                                           const void *data) {
+  if (!field_subscriber_count_) return;
+
+  for (auto subscription : subscriptions_) {
+    const auto &fields = subscription->fields();
+    if (!fields.empty() && (!latest || FieldsChanged(fields, latest, data))) {
+      subscription->set_changed_generation(generation_.load_relaxed() + 1);
+    }
+  }
+}
+
+void uorb::DeviceNode::Commit() {
+  const unsigned index = head_;
+  if (queued_count_ < queue_size_) queued_count_++;
+  if (++head_ == queue_size_) head_ = 0;
+
+  const auto now_ns = MonotonicTimeNs();
+  publish_time_ns_[index] = now_ns;
+
+  const uint64_t now = now_ns / 1000;
+  const auto last_publish_time = last_publish_time_us_.load_relaxed();
+  if (last_publish_time) {
+    const int64_t interval = now - last_publish_time;
+    const int64_t average = publish_interval_us_.load_relaxed();
+    publish_interval_us_.store_relaxed(
+        average ? average + (interval - average) / (1 << kRateShift)
+                : interval);
+  }
+  last_publish_time_us_.store_relaxed(now);
+  publish_count_.fetch_add_relaxed(1);
+
+  // Last, the new message and its publish time are visible to the threads
+  // which read the generation without the lock, see orb_check_update_ex()
+  // and orb_snapshot()
+  const unsigned generation = generation_.load_relaxed() + 1;
+  generation_.store_release(generation);
+
+  for (const auto &item : callbacks_) {
+    // Not woken by messages that do not change its fields
+    const auto subscription = item.second;
+    if (subscription && !subscription->fields().empty() &&
+        subscription->changed_generation() != generation) {
+      continue;
+    }
+    (*item.first).Notify();
+  }
+}
+
+void uorb::DeviceNode::add_subscriber(const SubscriptionImpl *subscription) {
   base::LockGuard<base::Mutex> lg(lock_);
+  subscriptions_.emplace(subscription);
   subscriber_count_++;
 }
 
-void uorb::DeviceNode::remove_subscriber() {
+void uorb::DeviceNode::remove_subscriber(
+    const SubscriptionImpl *subscription) {
   base::LockGuard<base::Mutex> lg(lock_);
+  subscriptions_.erase(subscription);
   subscriber_count_--;
+  if (!subscription->fields().empty()) field_subscriber_count_--;
+  // Shrink the queue if it was the deepest subscriber
+  if (subscription->requested_queue_size()) Resize(RequiredQueueSize());
+}
+
+unsigned uorb::DeviceNode::queue_size() const {
+  base::LockGuard<base::Mutex> lg(lock_);
+  return queue_size_;
+}
+
+size_t uorb::DeviceNode::queue_bytes() const {
+  base::LockGuard<base::Mutex> lg(lock_);
+  if (!data_) return 0;
+  return queue_size_ * (size_t(meta_.o_size) + sizeof(*publish_time_ns_));
+}
+
+void uorb::DeviceNode::SetQueueSize(SubscriptionImpl *subscription,
+                                    unsigned queue_size) {
+  base::LockGuard<base::Mutex> lg(lock_);
+  subscription->set_requested_queue_size(queue_size);
+  Resize(RequiredQueueSize());
+}
+
+unsigned uorb::DeviceNode::RequiredQueueSize() const {
+  unsigned queue_size = topic_queue_size_;
+  for (auto subscription : subscriptions_) {
+    if (subscription->requested_queue_size() > queue_size) {
+      queue_size = subscription->requested_queue_size();
+    }
+  }
+  return queue_size;
+}
+
+void uorb::DeviceNode::Resize(unsigned queue_size) {
+  // Deferred until the loaned slot is published, see PublishLoan()
+  if (queue_size == queue_size_ || loaned_) return;
+
+  if (data_) {
+    size_t mapped_bytes;
+    auto data = base::AllocateQueue(size_t(meta_.o_size) * queue_size,
+                                    &mapped_bytes);
+    if (!data) return;  // Keep the current queue
+    auto publish_time_ns = new uint64_t[queue_size];
+
+    // The queued messages move to the start of the new queue
+    if (queued_count_ > queue_size) queued_count_ = queue_size;
+    unsigned to = 0;
+    const unsigned latest = generation_.load_relaxed();
+    for (unsigned generation = latest - queued_count_; generation != latest;
+         ++generation, ++to) {
+      const unsigned from = Index(generation);
+      memcpy(data + size_t(meta_.o_size) * to, Slot(from), meta_.o_size);
+      publish_time_ns[to] = publish_time_ns_[from];
+    }
+
+    base::FreeQueue(data_, data_mapped_bytes_);
+    delete[] publish_time_ns_;
+    data_ = data;
+    data_mapped_bytes_ = mapped_bytes;
+    publish_time_ns_ = publish_time_ns;
+    head_ = to == queue_size ? 0 : to;
+  }
+  queue_size_ = queue_size;
+}
+
+void uorb::DeviceNode::SetFields(SubscriptionImpl *subscription,
+                                 std::vector<FieldRange> fields) {
+  base::LockGuard<base::Mutex> lg(lock_);
+  if (subscription->fields().empty() && !fields.empty()) {
+    field_subscriber_count_++;
+  } else if (!subscription->fields().empty() && fields.empty()) {
+    field_subscriber_count_--;
+  }
+  // The unread messages are still reported
+  subscription->set_fields(std::move(fields), generation_.load_relaxed());
+}
+
+unsigned uorb::DeviceNode::subscriber_backlog() const {
+  base::LockGuard<base::Mutex> lg(lock_);
+
+  unsigned backlog = 0;
+  for (auto subscription : subscriptions_) {
+    // Messages older than the queue are lost anyway
+    auto unread = generation_.load_relaxed() - subscription->last_generation();
+    unsigned depth = subscription->requested_queue_size();
+    if (!depth) depth = topic_queue_size_;
+    // The queue may not be resized yet, see Resize()
+    depth = std::min(depth, queue_size_);
+    if (unread > depth) unread = depth;
+    // Counted from the queue size of the topic, see
+    // orb_get_subscriber_backlog()
+    unread += queue_size_ - depth;
+    if (unread > backlog) backlog = unread;
+  }
+  return backlog;
 }
 
 unsigned uorb::DeviceNode::initial_generation() const {
   base::LockGuard<base::Mutex> lg(lock_);
 
   // If there any previous publications allow the subscriber to read them
-  return generation_ - (data_ ? 1 : 0);
+  return generation_.load_relaxed() - (queued_count_ ? 1 : 0);
 }
 
 void uorb::DeviceNode::remove_publisher() {
   base::LockGuard<base::Mutex> lg(lock_);
   publisher_count_--;
+  // Nobody is left to publish the loaned slot
+  if (!publisher_count_ && loaned_) {
+    loaned_ = false;
+    Resize(RequiredQueueSize());
+  }
 }
 
 void uorb::DeviceNode::add_publisher() {
   base::LockGuard<base::Mutex> lg(lock_);
   publisher_count_++;
+  // Large queues are allocated and written before the first publication
+  if (!data_ &&
+      size_t(meta_.o_size) * queue_size_ >= base::kLargeQueueBytes) {
+    Allocate();
+  }
 }
@@ -1,15 +1,22 @@
 #pragma once
 
+#include <uorb/internal/atomic.h>
 #include <uorb/internal/noncopyable.h>
 #include <uorb/uorb.h>
 
 #include <cerrno>
+#include <map>
 #include <set>
+#include <vector>
 
 #include "base/condition_variable.h"
 #include "base/intrusive_list.h"
 #include "base/mutex.h"
 #include "callback.h"
+#include "topic_fields.h"
+#ifdef UORB_LATENCY_STATS
+#include "latency_histogram.h"
+#endif
 
 namespace uORBTest {
 class UnitTest;
@@ -17,6 +24,7 @@ class UnitTest;
 
 namespace uorb {
 class DeviceMaster;
+struct SubscriptionImpl;
 
 /**
  * Per-object device instance.
@@ -26,11 +34,17 @@ class DeviceNode : public ListNode<DeviceNode *>,
   friend DeviceMaster;
 
  public:
-  // Publish a data to this node.
-  bool Publish(const void *data);
+  // Publish a data to this node. If if_changed is true or the topic has
+  // ORB_FLAG_SUPPRESS_DUPLICATES, data equal to the latest message is skipped.
+  bool Publish(const void *data, bool if_changed = false);
 
-  void add_subscriber();
-  void remove_subscriber();
+  // The queue slot of the next message, to be filled in place and published
+  // with PublishLoan(), see orb_loan(). Publish() fails with EBUSY meanwhile.
+  void *Loan();
+  bool PublishLoan();
+
+  void add_subscriber(const SubscriptionImpl *subscription);
+  void remove_subscriber(const SubscriptionImpl *subscription);
   uint8_t subscriber_count() const { return subscriber_count_; }
   bool has_anonymous_subscriber() const { return has_anonymous_subscriber_; }
   void mark_anonymous_subscriber() { has_anonymous_subscriber_ = true; }
@@ -50,16 +64,18 @@ class DeviceNode : public ListNode<DeviceNode *>,
     return &meta_ == &meta;
   }
 
-  // add item to list of work items to schedule on node update
+  // add item to list of work items to schedule on node update, only when
+  // the fields of subscription change if it has any, see SetFields()
   template <typename Callback>
-  bool RegisterCallback(Callback *callback) {
+  bool RegisterCallback(Callback *callback,
+                        const SubscriptionImpl *subscription = nullptr) {
     if (!callback) {
       errno = EINVAL;
       return false;
     }
 
     uorb::base::LockGuard<base::Mutex> lg(lock_);
-    uorb::DeviceNode::callbacks_.emplace(callback);
+    uorb::DeviceNode::callbacks_.emplace(callback, subscription);
     return true;
   }
 
@@ -70,13 +86,32 @@ class DeviceNode : public ListNode<DeviceNode *>,
     return uorb::DeviceNode::callbacks_.erase(callback) != 0;
   }
 
+  // Only report the messages that change these fields to the subscription,
+  // see orb_set_subscription_fields(). Empty to report all messages.
+  void SetFields(SubscriptionImpl *subscription,
+                 std::vector<FieldRange> fields);
+
   // Returns the number of updated data relative to the parameter 'generation'
   unsigned updates_available(unsigned generation) const;
   unsigned initial_generation() const;
 
-  unsigned queue_size() const { return queue_size_; }
+  // The largest number of messages a subscriber has not copied yet
+  unsigned subscriber_backlog() const;
+
+  unsigned queue_size() const;
+  // The queue size of the subscriptions that did not request one
+  unsigned topic_queue_size() const { return topic_queue_size_; }
+
+  // Grow the queue to at least queue_size messages for the subscription, or
+  // back to the largest size still needed if it is 0, see
+  // orb_set_subscription_queue_size()
+  void SetQueueSize(SubscriptionImpl *subscription, unsigned queue_size);
+  // Memory allocated for the queue, 0 until the first message is published or,
+  // for large queues, a publisher is added
+  size_t queue_bytes() const;
 
   const char *name() const { return meta_.o_name; }
+  const orb_metadata &meta() const { return meta_; }
   uint8_t instance() const { return instance_; }
 
   /**
@@ -87,10 +122,59 @@ class DeviceNode : public ListNode<DeviceNode *>,
    *   The buffer into which the data is copied.
    * @param sub_generation
    *   The generation that was copied.
+   * @param info
+   *   If not null, receives the generation and publish time of the copied
+   *   message, and the number of messages that were overwritten before they
+   *   could be copied.
+   * @param depth
+   *   Only the newest depth messages are copied, older ones count as
+   *   overwritten. 0 for topic_queue_size().
    * @return bool
    *   Returns true if the data was copied.
    */
-  bool Copy(void *dst, unsigned *sub_generation) const;
+  bool Copy(void *dst, unsigned *sub_generation, orb_copy_info *info = nullptr,
+            unsigned depth = 0) const;
+
+  // Copies up to max_count unread messages, the i-th one to dst + i * stride,
+  // and advances sub_generation past them, see orb_copy_batch(). infos[0].lost
+  // is the number of messages overwritten before. Returns the number of
+  // copied messages.
+  unsigned CopyBatch(uint8_t *dst, size_t stride, unsigned max_count,
+                     unsigned *sub_generation, orb_copy_info *infos,
+                     unsigned depth = 0) const;
+
+  // Copies the latest message, false if none was published, see
+  // orb_snapshot()
+  bool CopyLatest(void *dst, orb_copy_info *info) const;
+
+  // Generation of the next message, read without the lock. The messages
+  // before it are visible, see Commit().
+  unsigned generation() const { return generation_.load_acquire(); }
+
+  // Copies the newest queued message published at or before time_us, see
+  // orb_copy_at_time()
+  bool CopyAtTime(uint64_t time_us, void *dst, orb_copy_info *info) const;
+
+  // Copies the queued messages published between start_us and end_us, see
+  // orb_copy_range(). Returns the number of copied messages.
+  unsigned CopyRange(uint64_t start_us, uint64_t end_us, void *dst,
+                     unsigned max_count, orb_copy_info *infos) const;
+
+  // Traffic counters, see orb_status
+  uint64_t publish_count() const { return publish_count_.load_relaxed(); }
+  uint64_t copy_count() const { return copy_count_.load_relaxed(); }
+  uint64_t lost_count() const { return lost_count_.load_relaxed(); }
+  uint64_t suppressed_count() const {
+    return suppressed_count_.load_relaxed();
+  }
+  float publish_rate_hz() const;
+  uint64_t last_publish_time_us() const {
+    return last_publish_time_us_.load_relaxed();
+  }
+
+#ifdef UORB_LATENCY_STATS
+  const LatencyHistogram &latency_histogram() const { return latency_; }
+#endif
 
  private:
   friend uORBTest::UnitTest;
@@ -99,19 +183,68 @@ class DeviceNode : public ListNode<DeviceNode *>,
   const uint8_t instance_;   /**< orb multi instance identifier */
 
   uint8_t *data_{nullptr};    /**< allocated object buffer */
-  const uint16_t queue_size_; /**< maximum number of elements in the queue */
-  unsigned generation_{0};    /**< object generation count */
-
-  mutable base::Mutex lock_{};
+  size_t data_mapped_bytes_{0}; /**< see base::AllocateQueue() */
+  const unsigned topic_queue_size_; /**< ORB_QUEUE_SIZE */
+  unsigned queue_size_;  /**< maximum number of elements, see SetQueueSize() */
+  unsigned queued_count_{0}; /**< number of elements in the queue */
+  unsigned head_{0};         /**< index of the next element */
+  /** object generation count, written under lock_ */
+  base::atomic<unsigned> generation_{0};
+  bool loaned_{false};       /**< the slot at head_ is loaned, see Loan() */
+
+  base::atomic<uint64_t> publish_count_{0};
+  mutable base::atomic<uint64_t> copy_count_{0};
+  mutable base::atomic<uint64_t> lost_count_{0};
+  base::atomic<uint64_t> suppressed_count_{0};
+  base::atomic<uint64_t> last_publish_time_us_{0};
+  base::atomic<uint64_t> publish_interval_us_{0}; /**< moving average */
+
+  uint64_t *publish_time_ns_{nullptr}; /**< publish time of each queue slot */
+#ifdef UORB_LATENCY_STATS
+  mutable LatencyHistogram latency_; /**< publish to copy latency */
+#endif
+
+  mutable base::Mutex lock_; /**< named after the topic, see lock_stats.h */
 
   uint8_t subscriber_count_{0};
   bool has_anonymous_subscriber_{false};
   uint8_t publisher_count_{0};
   bool has_anonymous_publisher_{false};
 
-  std::set<detail::CallbackBase *> callbacks_;
+  // The subscription of each callback, null if it is notified of all messages
+  std::map<detail::CallbackBase *, const SubscriptionImpl *> callbacks_;
+  std::set<const SubscriptionImpl *> subscriptions_;
+  unsigned field_subscriber_count_{0}; /**< subscriptions with fields */
 
   DeviceNode(const struct orb_metadata &meta, uint8_t instance);
   ~DeviceNode();
+
+  // The queue size needed by the topic and the subscribers, with lock_ held
+  unsigned RequiredQueueSize() const;
+  // Reallocate the queue, keeping the newest messages, with lock_ held
+  void Resize(unsigned queue_size);
+
+  // Index of a queued generation, with lock_ held
+  unsigned Index(unsigned generation) const;
+  uint8_t *Slot(unsigned index) const {
+    return data_ + size_t(meta_.o_size) * index;
+  }
+
+  // Allocate the queue, with lock_ held
+  bool Allocate();
+  // Mark the subscriptions whose fields change from latest (null for the
+  // first message) to data, with lock_ held
+  void UpdateChangedFields(const uint8_t *latest, const void *data);
+  // Publish the message in the slot at head_, with lock_ held
+  void Commit();
+
+  // The oldest generation still in the queue and the number of queued
+  // messages, with lock_ held
+  unsigned OldestGeneration(unsigned *count) const;
+  // The first queued generation published after time_us, with lock_ held
+  unsigned FirstGenerationAfter(uint64_t time_us) const;
+  // Copies one queued message (if dst is not null), with lock_ held
+  void CopyGeneration(unsigned generation, void *dst,
+                      orb_copy_info *info) const;
 };
 }  // namespace uorb
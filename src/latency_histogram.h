@@ -0,0 +1,95 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#pragma once
+
+#include <uorb/internal/atomic.h>
+
+#include <cstdint>
+
+namespace uorb {
+
+/**
+ * Lock-free log-linear histogram (HDR histogram style).
+ *
+ * Every power of two range is divided into kSubBuckets linear buckets, so a
+ * recorded value is known with a relative error below 1 / kSubBuckets
+ * (12.5%). Values from 2^kMaxExponent (about 18 minutes in nanoseconds) fall
+ * into the last bucket.
+ *
+ * Record() can be called from any number of threads; readers see a
+ * consistent-enough snapshot for statistics.
+ */
+class LatencyHistogram {
+ public:
+  static constexpr unsigned kSubBucketBits = 3;
+  static constexpr unsigned kSubBuckets = 1U << kSubBucketBits;
+  static constexpr unsigned kMaxExponent = 40;
+  static constexpr unsigned kBucketCount =
+      kSubBuckets + (kMaxExponent - kSubBucketBits) * kSubBuckets;
+
+  void Record(uint64_t value) {
+    buckets_[BucketIndex(value)].fetch_add_relaxed(1);
+    count_.fetch_add_relaxed(1);
+    sum_.fetch_add_relaxed(value);
+
+    auto max = max_.load_relaxed();
+    while (value > max && !max_.compare_exchange(&max, value)) {
+    }
+  }
+
+  uint64_t count() const { return count_.load_relaxed(); }
+  uint64_t sum() const { return sum_.load_relaxed(); }
+  uint64_t max() const { return max_.load_relaxed(); }
+
+  /**
+   * The smallest value that is greater than or equal to percentile% of the
+   * recorded values, rounded up to the end of its bucket.
+   * @param percentile 0 ~ 100
+   */
+  uint64_t Percentile(double percentile) const {
+    const uint64_t count = this->count();
+    if (!count) return 0;
+
+    auto rank = uint64_t(percentile / 100 * count + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > count) rank = count;
+
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < kBucketCount; ++i) {
+      seen += buckets_[i].load_relaxed();
+      if (seen >= rank) {
+        auto value = BucketUpperBound(i);
+        return value < max() ? value : max();
+      }
+    }
+    return max();  // Buckets updated after count() was read
+  }
+
+  static unsigned BucketIndex(uint64_t value) {
+    if (value < kSubBuckets) return value;
+
+    const unsigned exponent = 63 - __builtin_clzll(value);
+    if (exponent >= kMaxExponent) return kBucketCount - 1;
+
+    const unsigned shift = exponent - kSubBucketBits;
+    return kSubBuckets + shift * kSubBuckets +
+           ((value >> shift) & (kSubBuckets - 1));
+  }
+
+  static uint64_t BucketUpperBound(unsigned index) {
+    if (index < kSubBuckets) return index;
+
+    const unsigned shift = (index - kSubBuckets) / kSubBuckets;
+    const uint64_t sub_bucket = (index - kSubBuckets) % kSubBuckets;
+    return ((kSubBuckets + sub_bucket + 1) << shift) - 1;
+  }
+
+ private:
+  base::atomic<uint64_t> buckets_[kBucketCount]{};
+  base::atomic<uint64_t> count_{0};
+  base::atomic<uint64_t> sum_{0};
+  base::atomic<uint64_t> max_{0};
+};
+
+}  // namespace uorb
@@ -0,0 +1,68 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include "latency_histogram.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+using uorb::LatencyHistogram;
+
+TEST(LatencyHistogram, bucket_bounds) {
+  const unsigned bucket_count = LatencyHistogram::kBucketCount;
+
+  // Every value is in a bucket whose upper bound is at most 12.5% above it
+  for (uint64_t value = 0; value < 100000; ++value) {
+    auto index = LatencyHistogram::BucketIndex(value);
+    ASSERT_LT(index, bucket_count);
+    auto upper = LatencyHistogram::BucketUpperBound(index);
+    ASSERT_GE(upper, value);
+    ASSERT_LE(upper - value, value / LatencyHistogram::kSubBuckets);
+    if (index > 0) {
+      ASSERT_LT(LatencyHistogram::BucketUpperBound(index - 1), value);
+    }
+  }
+
+  EXPECT_EQ(LatencyHistogram::BucketIndex(UINT64_MAX), bucket_count - 1);
+}
+
+TEST(LatencyHistogram, percentile) {
+  LatencyHistogram histogram;
+  EXPECT_EQ(histogram.Percentile(50), 0);
+
+  for (uint64_t value = 1; value <= 1000; ++value) histogram.Record(value);
+
+  EXPECT_EQ(histogram.count(), 1000);
+  EXPECT_EQ(histogram.max(), 1000);
+  EXPECT_EQ(histogram.sum(), 1000 * 1001 / 2);
+
+  const double percentiles[] = {1, 50, 90, 99, 99.9};
+  for (auto percentile : percentiles) {
+    const double exact = percentile * 10;
+    auto value = histogram.Percentile(percentile);
+    EXPECT_GE(value, exact);
+    EXPECT_LE(value, exact * 1.125 + 1);
+  }
+  EXPECT_EQ(histogram.Percentile(100), 1000);
+}
+
+TEST(LatencyHistogram, concurrent_record) {
+  LatencyHistogram histogram;
+  const int num_threads = 4;
+  const int num_values = 100000;
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back([&histogram, i] {
+      for (int value = 0; value < num_values; ++value) {
+        histogram.Record(value + i);
+      }
+    });
+  }
+  for (auto &thread : threads) thread.join();
+
+  EXPECT_EQ(histogram.count(), num_threads * num_values);
+  EXPECT_EQ(histogram.max(), num_values - 1 + num_threads - 1);
+}
@@ -3,6 +3,8 @@
 //
 #pragma once
 
+#include <uorb/abs_time.h>
+
 #include "device_node.h"
 
 namespace uorb {
@@ -10,15 +12,124 @@ namespace uorb {
 struct SubscriptionImpl {
   explicit SubscriptionImpl(DeviceNode &device_node) : dev_(device_node) {
     last_generation_ = device_node.initial_generation();
-    dev_.add_subscriber();
+    dev_.add_subscriber(this);
+  }
+
+  ~SubscriptionImpl() {
+    if (callback_.function) dev_.UnregisterCallback(&callback_);
+    dev_.remove_subscriber(this);
   }
 
-  ~SubscriptionImpl() { dev_.remove_subscriber(); }
+  bool Copy(void *buffer, orb_copy_info *info = nullptr) {
+    orb_copy_info copy_info;
+    if (!dev_.Copy(buffer, &last_generation_, &copy_info,
+                   requested_queue_size_.load_relaxed())) {
+      return false;
+    }
+    CountCopies(&copy_info, 1);
+    if (info) *info = copy_info;
+    return true;
+  }
 
-  bool Copy(void *buffer) { return dev_.Copy(buffer, &last_generation_); }
+  // See orb_copy_batch()
+  unsigned CopyBatch(void *buffer, size_t stride, unsigned max_count,
+                     orb_copy_info *infos) {
+    auto dst = static_cast<uint8_t *>(buffer);
+    orb_copy_info local_infos[16];
+    unsigned copied = 0;
+    while (copied < max_count) {
+      auto chunk_infos = infos ? infos + copied : local_infos;
+      unsigned chunk = max_count - copied;
+      if (!infos && chunk > 16) chunk = 16;
+      const unsigned count =
+          dev_.CopyBatch(dst + stride * copied, stride, chunk,
+                         &last_generation_, chunk_infos,
+                         requested_queue_size_.load_relaxed());
+      CountCopies(chunk_infos, count);
+      copied += count;
+      if (count < chunk) break;
+    }
+    return copied;
+  }
   unsigned updates_available() const {
+    // No message changed the fields since the last copy
+    if (has_fields_.load_relaxed() &&
+        int(changed_generation_.load_relaxed() - last_generation_) <= 0) {
+      return 0;
+    }
     return dev_.updates_available(last_generation_);
   }
+  // The messages this subscription can read
+  unsigned queue_size() const {
+    const unsigned requested = requested_queue_size_.load_relaxed();
+    return requested ? requested : dev_.topic_queue_size();
+  }
+
+  // See orb_set_subscription_queue_size()
+  void SetQueueSize(unsigned queue_size) {
+    dev_.SetQueueSize(this, queue_size);
+  }
+  unsigned requested_queue_size() const {
+    return requested_queue_size_.load_relaxed();
+  }
+  void set_requested_queue_size(unsigned queue_size) {
+    requested_queue_size_.store_relaxed(queue_size);
+  }
+  uint64_t last_publish_time_us() const { return dev_.last_publish_time_us(); }
+
+  bool CopyLatest(void *buffer, orb_copy_info *info) const {
+    return dev_.CopyLatest(buffer, info);
+  }
+  unsigned generation() const { return dev_.generation(); }
+
+  bool CopyAtTime(uint64_t time_us, void *buffer, orb_copy_info *info) const {
+    return dev_.CopyAtTime(time_us, buffer, info);
+  }
+  unsigned CopyRange(uint64_t start_us, uint64_t end_us, void *buffer,
+                     unsigned max_count, orb_copy_info *infos) const {
+    return dev_.CopyRange(start_us, end_us, buffer, max_count, infos);
+  }
+
+  uint64_t copy_count() const { return copy_count_.load_relaxed(); }
+  uint64_t lost_count() const { return lost_count_.load_relaxed(); }
+  uint64_t deadline_miss_count() const {
+    return deadline_miss_count_.load_relaxed();
+  }
+
+  // See orb_set_subscription_sched_param()
+  void SetSchedParam(const orb_sched_param &param) {
+    priority_.store_relaxed(param.priority);
+    deadline_us_.store_relaxed(param.deadline_us);
+  }
+  orb_sched_param sched_param() const {
+    return {priority_.load_relaxed(), deadline_us_.load_relaxed()};
+  }
+
+  // Only stable while holding the lock of the device node
+  unsigned last_generation() const { return last_generation_; }
+
+  // See orb_set_subscription_fields()
+  bool SetFields(const char *names) {
+    std::vector<FieldRange> fields;
+    if (names && !GetFieldRanges(dev_.meta(), names, &fields)) return false;
+    dev_.SetFields(this, std::move(fields));
+    return true;
+  }
+
+  // The fields, and the generation after the last message that changed them,
+  // with the lock of the device node held
+  const std::vector<FieldRange> &fields() const { return fields_; }
+  void set_fields(std::vector<FieldRange> fields, unsigned generation) {
+    fields_ = std::move(fields);
+    changed_generation_.store_relaxed(generation);
+    has_fields_.store_relaxed(!fields_.empty());
+  }
+  unsigned changed_generation() const {
+    return changed_generation_.load_relaxed();
+  }
+  void set_changed_generation(unsigned generation) const {
+    changed_generation_.store_relaxed(generation);
+  }
 
   template <typename Callback>
   bool UnregisterCallback(Callback *callback) {
@@ -27,11 +138,45 @@ struct SubscriptionImpl {
 
   template <typename Callback>
   bool RegisterCallback(Callback *callback) {
-    return dev_.RegisterCallback(callback);
+    return dev_.RegisterCallback(callback, this);
+  }
+
+  // See orb_set_subscription_callback()
+  void SetCallback(orb_callback_t function, void *arg) {
+    // The device node calls the callback with its lock held, so it is not
+    // running anymore once unregistered
+    if (callback_.function) dev_.UnregisterCallback(&callback_);
+    callback_.function = function;
+    callback_.arg = arg;
+    if (callback_.function) dev_.RegisterCallback(&callback_, this);
   }
 
  private:
+  void CountCopies(const orb_copy_info *infos, unsigned count) {
+    if (!count) return;
+    copy_count_.fetch_add_relaxed(count);
+    lost_count_.fetch_add_relaxed(infos[0].lost);
+    const unsigned deadline_us = deadline_us_.load_relaxed();
+    if (!deadline_us) return;
+    const auto now = orb_monotonic_time_us();
+    for (unsigned i = 0; i < count; ++i) {
+      if (now - infos[i].timestamp > deadline_us) {
+        deadline_miss_count_.fetch_add_relaxed(1);
+      }
+    }
+  }
+
   DeviceNode &dev_;
   unsigned last_generation_{}; /**< last generation the subscriber has seen */
+  base::atomic<uint64_t> copy_count_{0};
+  base::atomic<uint64_t> lost_count_{0};
+  base::atomic<uint64_t> deadline_miss_count_{0};
+  base::atomic<int> priority_{0};
+  base::atomic<unsigned> deadline_us_{0};
+  FunctionCallback callback_{};
+  std::vector<FieldRange> fields_;
+  base::atomic<bool> has_fields_{false};
+  mutable base::atomic<unsigned> changed_generation_{0};
+  base::atomic<unsigned> requested_queue_size_{0};
 };
 }  // namespace uorb
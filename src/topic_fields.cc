@@ -0,0 +1,115 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include "topic_fields.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace {
+
+// Size of the basic types of the msg generator, 0 for nested message types
+unsigned TypeSize(const std::string &type) {
+  static const struct {
+    const char *name;
+    unsigned size;
+  } kTypes[] = {
+      {"int8_t", 1},  {"uint8_t", 1},  {"bool", 1},    {"char", 1},
+      {"int16_t", 2}, {"uint16_t", 2}, {"int32_t", 4}, {"uint32_t", 4},
+      {"float", 4},   {"int64_t", 8},  {"uint64_t", 8}, {"double", 8},
+  };
+  for (const auto &item : kTypes) {
+    if (type == item.name) return item.size;
+  }
+  return 0;
+}
+
+std::vector<std::string> Split(const char *str) {
+  std::vector<std::string> items;
+  std::string item;
+  for (const char *p = str; *p; ++p) {
+    if (*p == ';') {
+      if (!item.empty()) items.push_back(item);
+      item.clear();
+    } else if (*p != ' ') {
+      item += *p;
+    }
+  }
+  if (!item.empty()) items.push_back(item);
+  return items;
+}
+
+}  // namespace
+
+bool uorb::GetFieldRanges(const orb_metadata &meta, const char *names,
+                          std::vector<FieldRange> *ranges) {
+  ranges->clear();
+  auto wanted = Split(names);
+  std::sort(wanted.begin(), wanted.end());
+  wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+  if (wanted.empty() || !meta.o_fields) return false;
+
+  // The fields are laid out in order, the generator adds the padding fields
+  unsigned offset = 0;
+  bool offset_known = true;
+  size_t found = 0;
+  const char *field = meta.o_fields;
+  while (*field) {
+    const char *end = strchr(field, ';');
+    if (!end) end = field + strlen(field);
+    const std::string declaration(field, end);
+    field = *end ? end + 1 : end;
+
+    // "type name" or "type[count] name"
+    const auto space = declaration.rfind(' ');
+    if (space == std::string::npos) continue;
+    const auto name = declaration.substr(space + 1);
+    auto type = declaration.substr(0, space);
+    unsigned count = 1;
+    const auto bracket = type.find('[');
+    if (bracket != std::string::npos) {
+      count = strtoul(type.c_str() + bracket + 1, nullptr, 10);
+      type.resize(bracket);
+    }
+    const unsigned size = TypeSize(type) * count;
+    if (size == 0) offset_known = false;
+
+    if (std::find(wanted.begin(), wanted.end(), name) != wanted.end()) {
+      if (!offset_known || offset + size > meta.o_size) return false;
+      ranges->push_back({offset, size});
+      ++found;
+    }
+    offset += size;
+  }
+  if (found != wanted.size()) return false;
+
+  std::sort(ranges->begin(), ranges->end(),
+            [](const FieldRange &a, const FieldRange &b) {
+              return a.offset < b.offset;
+            });
+  std::vector<FieldRange> merged;
+  for (const auto &range : *ranges) {
+    if (!merged.empty() &&
+        merged.back().offset + merged.back().size == range.offset) {
+      merged.back().size += range.size;
+    } else {
+      merged.push_back(range);
+    }
+  }
+  ranges->swap(merged);
+  return true;
+}
+
+bool uorb::FieldsChanged(const std::vector<FieldRange> &ranges, const void *a,
+                         const void *b) {
+  const auto *bytes_a = static_cast<const uint8_t *>(a);
+  const auto *bytes_b = static_cast<const uint8_t *>(b);
+  for (const auto &range : ranges) {
+    if (memcmp(bytes_a + range.offset, bytes_b + range.offset, range.size)) {
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,34 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#pragma once
+
+#include <uorb/uorb.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace uorb {
+
+// Bytes of a message
+struct FieldRange {
+  uint32_t offset;
+  uint32_t size;
+};
+
+/**
+ * Find the bytes of the fields of a topic from orb_metadata::o_fields.
+ *
+ * @param names  Field names separated by ';', e.g. "armed;nav_state".
+ * @param ranges  Receives the sorted byte ranges, adjacent fields are merged.
+ * @return false if a field is not found, or follows a nested message type,
+ * whose size is not in o_fields.
+ */
+bool GetFieldRanges(const orb_metadata &meta, const char *names,
+                    std::vector<FieldRange> *ranges);
+
+// Whether the bytes of the ranges differ between two messages
+bool FieldsChanged(const std::vector<FieldRange> &ranges, const void *a,
+                   const void *b);
+
+}  // namespace uorb
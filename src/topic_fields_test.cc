@@ -0,0 +1,63 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include "topic_fields.h"
+
+#include <gtest/gtest.h>
+
+using uorb::FieldRange;
+
+static const orb_metadata kMeta = {
+    ORB_METADATA_ABI_VERSION, "topic_fields", 40, 38,
+    "uint64_t timestamp;float[3] position;bool armed;uint8_t nav_state;"
+    "int16_t[2] ids;uint32_t count;uint8_t[2] _padding0;",
+    1, 0};
+
+TEST(TopicFields, ranges) {
+  std::vector<FieldRange> ranges;
+  ASSERT_TRUE(uorb::GetFieldRanges(kMeta, "armed", &ranges));
+  ASSERT_EQ(ranges.size(), 1);
+  EXPECT_EQ(ranges[0].offset, 20);
+  EXPECT_EQ(ranges[0].size, 1);
+
+  // Sorted, and adjacent fields are merged
+  ASSERT_TRUE(uorb::GetFieldRanges(kMeta, "count; nav_state;armed", &ranges));
+  ASSERT_EQ(ranges.size(), 2);
+  EXPECT_EQ(ranges[0].offset, 20);
+  EXPECT_EQ(ranges[0].size, 2);
+  EXPECT_EQ(ranges[1].offset, 26);
+  EXPECT_EQ(ranges[1].size, 4);
+
+  ASSERT_TRUE(uorb::GetFieldRanges(kMeta, "position;ids;", &ranges));
+  ASSERT_EQ(ranges.size(), 2);
+  EXPECT_EQ(ranges[0].offset, 8);
+  EXPECT_EQ(ranges[0].size, 12);
+  EXPECT_EQ(ranges[1].offset, 22);
+  EXPECT_EQ(ranges[1].size, 4);
+
+  EXPECT_FALSE(uorb::GetFieldRanges(kMeta, "armed;missing", &ranges));
+  EXPECT_FALSE(uorb::GetFieldRanges(kMeta, "", &ranges));
+}
+
+TEST(TopicFields, nested_types) {
+  static const orb_metadata meta = {
+      ORB_METADATA_ABI_VERSION, "topic_fields_nested", 32, 32,
+      "uint64_t timestamp;vehicle_position[2] positions;int32_t val;", 1, 0};
+  std::vector<FieldRange> ranges;
+  ASSERT_TRUE(uorb::GetFieldRanges(meta, "timestamp", &ranges));
+  // The size of the nested type is unknown
+  EXPECT_FALSE(uorb::GetFieldRanges(meta, "positions", &ranges));
+  EXPECT_FALSE(uorb::GetFieldRanges(meta, "val", &ranges));
+}
+
+TEST(TopicFields, changed) {
+  const std::vector<FieldRange> ranges = {{1, 2}, {6, 1}};
+  const uint8_t a[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+  uint8_t b[8] = {9, 1, 2, 9, 9, 9, 6, 9};
+  EXPECT_FALSE(uorb::FieldsChanged(ranges, a, b));
+  b[2] = 0;
+  EXPECT_TRUE(uorb::FieldsChanged(ranges, a, b));
+  b[2] = 2;
+  b[6] = 0;
+  EXPECT_TRUE(uorb::FieldsChanged(ranges, a, b));
+}
@@ -5,8 +5,11 @@
 
 #include <uorb/uorb.h>
 
+#include <algorithm>
 #include <cerrno>
+#include <vector>
 
+#include "base/lock_stats.h"
 #include "callback.h"
 #include "device_master.h"
 #include "device_node.h"
@@ -31,6 +34,8 @@ orb_publication_t *orb_create_publication(const struct orb_metadata *meta) {
 orb_publication_t *orb_create_publication_multi(const struct orb_metadata *meta,
                                                 unsigned int *instance) {
   ORB_CHECK_TRUE(meta, EINVAL, return nullptr);
+  ORB_CHECK_TRUE(meta->o_abi_version == ORB_METADATA_ABI_VERSION, EPROTO,
+                 return nullptr);
   auto &meta_ = *meta;
   auto &device_master = DeviceMaster::get_instance();
   auto *dev_ = device_master.CreateAdvertiser(meta_, instance);
@@ -60,8 +65,31 @@ bool orb_publish(orb_publication_t *handle, const void *data) {
   return dev.Publish(data);
 }
 
+bool orb_publish_if_changed(orb_publication_t *handle, const void *data) {
+  ORB_CHECK_TRUE(handle && data, EINVAL, return false);
+
+  auto &dev = *(uorb::DeviceNode *)handle;
+  return dev.Publish(data, true);
+}
+
+void *orb_loan(orb_publication_t *handle) {
+  ORB_CHECK_TRUE(handle, EINVAL, return nullptr);
+
+  auto &dev = *(uorb::DeviceNode *)handle;
+  return dev.Loan();
+}
+
+bool orb_publish_loan(orb_publication_t *handle) {
+  ORB_CHECK_TRUE(handle, EINVAL, return false);
+
+  auto &dev = *(uorb::DeviceNode *)handle;
+  return dev.PublishLoan();
+}
+
 bool orb_publish_anonymous(const struct orb_metadata *meta, const void *data) {
   ORB_CHECK_TRUE(meta, EINVAL, return false);
+  ORB_CHECK_TRUE(meta->o_abi_version == ORB_METADATA_ABI_VERSION, EPROTO,
+                 return false);
 
   auto &device_master = DeviceMaster::get_instance();
   auto *dev = device_master.OpenDeviceNode(*meta, 0);
@@ -79,6 +107,8 @@ orb_subscription_t *orb_create_subscription(const struct orb_metadata *meta) {
 orb_subscription_t *orb_create_subscription_multi(
     const struct orb_metadata *meta, unsigned instance) {
   ORB_CHECK_TRUE(meta, EINVAL, return nullptr);
+  ORB_CHECK_TRUE(meta->o_abi_version == ORB_METADATA_ABI_VERSION, EPROTO,
+                 return nullptr);
 
   DeviceMaster &device_master = uorb::DeviceMaster::get_instance();
 
@@ -112,8 +142,95 @@ bool orb_copy(orb_subscription_t *handle, void *buffer) {
   return sub.Copy(buffer);
 }
 
+bool orb_copy_ex(orb_subscription_t *handle, void *buffer,
+                 struct orb_copy_info *info) {
+  ORB_CHECK_TRUE(handle && buffer, EINVAL, return false);
+
+  auto &sub = *reinterpret_cast<SubscriptionImpl *>(handle);
+
+  return sub.Copy(buffer, info);
+}
+
+int orb_copy_batch(orb_subscription_t *handle, void *buffer, size_t stride,
+                   unsigned max_count, struct orb_copy_info *infos) {
+  ORB_CHECK_TRUE(handle && buffer, EINVAL, return -1);
+
+  auto &sub = *reinterpret_cast<SubscriptionImpl *>(handle);
+  return int(sub.CopyBatch(buffer, stride, max_count, infos));
+}
+
+bool orb_copy_at_time(orb_subscription_t *handle, uint64_t time_us,
+                      void *buffer, struct orb_copy_info *info) {
+  ORB_CHECK_TRUE(handle && (buffer || info), EINVAL, return false);
+
+  auto &sub = *reinterpret_cast<SubscriptionImpl *>(handle);
+  ORB_CHECK_TRUE(sub.CopyAtTime(time_us, buffer, info), ENODATA,
+                 return false);
+  return true;
+}
+
+int orb_copy_range(orb_subscription_t *handle, uint64_t start_us,
+                   uint64_t end_us, void *buffer, unsigned max_count,
+                   struct orb_copy_info *infos) {
+  ORB_CHECK_TRUE(handle && (buffer || infos), EINVAL, return -1);
+
+  auto &sub = *reinterpret_cast<SubscriptionImpl *>(handle);
+  return int(sub.CopyRange(start_us, end_us, buffer, max_count, infos));
+}
+
+bool orb_snapshot(orb_subscription_t *const *handles, unsigned n,
+                  void *const *buffers, struct orb_copy_info *infos) {
+  ORB_CHECK_TRUE(handles && buffers && n, EINVAL, return false);
+  for (unsigned i = 0; i < n; ++i) {
+    ORB_CHECK_TRUE(handles[i] && buffers[i], EINVAL, return false);
+  }
+
+  // The generations of the copies, on the stack for the usual counts
+  orb_copy_info local_infos[16];
+  std::vector<orb_copy_info> heap_infos;
+  if (!infos) {
+    if (n > sizeof(local_infos) / sizeof(local_infos[0])) heap_infos.resize(n);
+    infos = heap_infos.empty() ? local_infos : heap_infos.data();
+  }
+
+  auto sub = [handles](unsigned i) -> const SubscriptionImpl & {
+    return *reinterpret_cast<const SubscriptionImpl *>(handles[i]);
+  };
+  for (unsigned i = 0; i < n; ++i) {
+    ORB_CHECK_TRUE(sub(i).CopyLatest(buffers[i], &infos[i]), ENODATA,
+                   return false);
+  }
+
+  // Linearization: a pass which finds no publication copies nothing, so
+  // every copy of topic i, made under its lock at generation g_i, was
+  // sequenced before every check of that pass. A check loads the generation
+  // of topic i with acquire, and it cannot read an older value than the
+  // copy did. Reading g_i + 1 again means no Commit() of topic i came in
+  // between, as the generation only grows (barring 2^32 publications). So
+  // each copy stayed the latest message of its topic from the copy to the
+  // check, and all these intervals contain the moment between the last copy
+  // and the first check of the pass: the snapshot is what the topics held
+  // then. Commit() stores the generation with release after the message,
+  // so a newer generation is never seen before the message it counts.
+  for (int tries = 1; tries < ORB_SNAPSHOT_MAX_TRIES; ++tries) {
+    bool published = false;
+    for (unsigned i = 0; i < n; ++i) {
+      if (sub(i).generation() != infos[i].generation + 1) {
+        sub(i).CopyLatest(buffers[i], &infos[i]);
+        published = true;
+      }
+    }
+    if (!published) return true;
+  }
+
+  errno = EAGAIN;
+  return false;
+}
+
 bool orb_copy_anonymous(const struct orb_metadata *meta, void *buffer) {
   ORB_CHECK_TRUE(meta, EINVAL, return false);
+  ORB_CHECK_TRUE(meta->o_abi_version == ORB_METADATA_ABI_VERSION, EPROTO,
+                 return false);
 
   auto &device_master = DeviceMaster::get_instance();
   auto *dev = device_master.OpenDeviceNode(*meta, 0);
@@ -133,6 +250,60 @@ bool orb_check_update(orb_subscription_t *handle) {
   return sub.updates_available();
 }
 
+bool orb_check_update_ex(orb_subscription_t *handle, uint64_t *publish_time) {
+  ORB_CHECK_TRUE(handle && publish_time, EINVAL, return false);
+
+  auto &sub = *reinterpret_cast<SubscriptionImpl *>(handle);
+  *publish_time = sub.last_publish_time_us();
+  return sub.updates_available();
+}
+
+bool orb_set_subscription_callback(orb_subscription_t *handle,
+                                   orb_callback_t callback, void *arg) {
+  ORB_CHECK_TRUE(handle, EINVAL, return false);
+
+  auto &sub = *reinterpret_cast<SubscriptionImpl *>(handle);
+  sub.SetCallback(callback, arg);
+  return true;
+}
+
+bool orb_set_subscription_sched_param(orb_subscription_t *handle,
+                                      const struct orb_sched_param *param) {
+  ORB_CHECK_TRUE(handle && param, EINVAL, return false);
+
+  auto &sub = *reinterpret_cast<SubscriptionImpl *>(handle);
+  sub.SetSchedParam(*param);
+  return true;
+}
+
+bool orb_set_subscription_fields(orb_subscription_t *handle,
+                                 const char *fields) {
+  ORB_CHECK_TRUE(handle, EINVAL, return false);
+
+  auto &sub = *reinterpret_cast<SubscriptionImpl *>(handle);
+  ORB_CHECK_TRUE(sub.SetFields(fields), EINVAL, return false);
+  return true;
+}
+
+bool orb_set_subscription_queue_size(orb_subscription_t *handle,
+                                     unsigned queue_size) {
+  ORB_CHECK_TRUE(handle && queue_size <= ORB_QUEUE_SIZE_MAX, EINVAL,
+                 return false);
+
+  auto &sub = *reinterpret_cast<SubscriptionImpl *>(handle);
+  sub.SetQueueSize(queue_size);
+  return true;
+}
+
+bool orb_get_subscription_sched_param(orb_subscription_t *handle,
+                                      struct orb_sched_param *param) {
+  ORB_CHECK_TRUE(handle && param, EINVAL, return false);
+
+  auto &sub = *reinterpret_cast<SubscriptionImpl *>(handle);
+  *param = sub.sched_param();
+  return true;
+}
+
 bool orb_exists(const struct orb_metadata *meta, unsigned int instance) {
   ORB_CHECK_TRUE(meta, EINVAL, return false);
 
@@ -171,10 +342,79 @@ bool orb_get_topic_status(const struct orb_metadata *meta,
     status->publisher_count = dev->publisher_count();
     status->has_anonymous_publisher = dev->has_anonymous_publisher();
     status->latest_data_index = dev->updates_available(0);
+    status->publish_count = dev->publish_count();
+    status->publish_bytes = status->publish_count * meta->o_size;
+    status->publish_rate_hz = dev->publish_rate_hz();
+    status->copy_count = dev->copy_count();
+    status->lost_count = dev->lost_count();
+    status->suppressed_count = dev->suppressed_count();
+    status->queue_bytes = dev->queue_bytes();
+
+    status->latency = {};
+#ifdef UORB_LATENCY_STATS
+    const auto &histogram = dev->latency_histogram();
+    auto &latency = status->latency;
+    latency.count = histogram.count();
+    if (latency.count) {
+      latency.mean_ns = histogram.sum() / latency.count;
+      latency.p50_ns = histogram.Percentile(50);
+      latency.p90_ns = histogram.Percentile(90);
+      latency.p99_ns = histogram.Percentile(99);
+      latency.p999_ns = histogram.Percentile(99.9);
+      latency.max_ns = histogram.max();
+    }
+#endif
   }
   return true;
 }
 
+bool orb_get_subscription_status(orb_subscription_t *handle,
+                                 struct orb_subscription_status *status) {
+  ORB_CHECK_TRUE(handle && status, EINVAL, return false);
+
+  auto &sub = *reinterpret_cast<SubscriptionImpl *>(handle);
+  status->copy_count = sub.copy_count();
+  status->lost_count = sub.lost_count();
+  status->deadline_miss_count = sub.deadline_miss_count();
+  // Older messages are already overwritten
+  status->unread = std::min(sub.updates_available(), sub.queue_size());
+  return true;
+}
+
+int orb_get_lock_status(struct orb_lock_status *status, unsigned max_count) {
+#ifdef UORB_LOCK_STATS
+  ORB_CHECK_TRUE(status || !max_count, EINVAL, return -1);
+
+  const auto stats = uorb::base::CollectLockStats();
+  unsigned count = 0;
+  for (; count < max_count && count < stats.size(); ++count) {
+    const auto &from = stats[count];
+    auto &to = status[count];
+    to.name = from.name;
+    to.instance = from.instance;
+    to.lock_count = from.lock_count;
+    to.contended_count = from.contended_count;
+    to.wait_ns = from.wait_ns;
+    to.max_wait_ns = from.max_wait_ns;
+    to.hold_ns = from.hold_ns;
+    to.max_hold_ns = from.max_hold_ns;
+  }
+  return count;
+#else
+  (void)status;
+  (void)max_count;
+  errno = ENOTSUP;
+  return -1;
+#endif
+}
+
+unsigned orb_get_subscriber_backlog(orb_publication_t *handle) {
+  ORB_CHECK_TRUE(handle, EINVAL, return 0);
+
+  auto &dev = *(uorb::DeviceNode *)handle;
+  return dev.subscriber_backlog();
+}
+
 int orb_poll(struct orb_pollfd *fds, unsigned int nfds, int timeout_ms) {
   ORB_CHECK_TRUE(fds && nfds, EINVAL, return -1);
 
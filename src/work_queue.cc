@@ -0,0 +1,500 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include "work_queue.h"
+
+#include <sched.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+
+#include "base/orb_errno.h"
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+// Started queues, never destroyed: their threads run until the process exits
+struct WorkQueueRegistry {
+  uorb::base::Mutex lock;
+  std::vector<uorb::WorkQueue *> queues;
+};
+
+WorkQueueRegistry &registry() {
+  static auto *registry = new WorkQueueRegistry;
+  return *registry;
+}
+
+// The work queue worker of this thread (a WorkQueue::Worker), and the item it
+// runs
+thread_local void *current_worker = nullptr;
+thread_local uorb::WorkItem *current_item = nullptr;
+thread_local bool current_item_removed = false;
+
+template <typename T>
+void AtomicMax(uorb::base::atomic<T> *value, T other) {
+  T current = value->load();
+  while (other > current && !value->compare_exchange(&current, other)) {
+  }
+}
+
+template <typename T>
+void AtomicMin(uorb::base::atomic<T> *value, T other) {
+  T current = value->load();
+  while (other < current && !value->compare_exchange(&current, other)) {
+  }
+}
+
+}  // namespace
+
+constexpr int uorb::WorkQueue::kNoPriority;
+constexpr orb_abstime_us uorb::WorkQueue::kNoDeadline;
+
+bool uorb::WorkQueue::EntryOrder::operator()(const Entry &a,
+                                             const Entry &b) const {
+  if (ordering == WorkQueueConfig::kEarliestDeadline &&
+      a.deadline != b.deadline) {
+    return a.deadline < b.deadline;
+  }
+  if (a.priority != b.priority) return a.priority > b.priority;
+  return a.sequence < b.sequence;
+}
+
+uorb::WorkQueue *uorb::WorkQueue::FindOrCreate(const WorkQueueConfig &config) {
+  if (!config.name) {
+    errno = EINVAL;
+    return nullptr;
+  }
+
+  auto &r = registry();
+  base::LockGuard<base::Mutex> lg(r.lock);
+  for (auto queue : r.queues) {
+    if (!strcmp(queue->name(), config.name)) return queue;
+  }
+
+  auto queue = new WorkQueue(config);
+  if (!queue->Start()) {
+    auto error = errno;
+    delete queue;
+    errno = error;
+    return nullptr;
+  }
+  r.queues.push_back(queue);
+  return queue;
+}
+
+bool uorb::WorkQueue::Start() {
+  unsigned thread_count = std::max(config_.thread_count, 1U);
+  if (thread_count == WorkQueueConfig::kThreadPerCpu) {
+    thread_count = config_.cpu_affinity
+                       ? __builtin_popcountll(config_.cpu_affinity)
+                       : std::max(sysconf(_SC_NPROCESSORS_ONLN), 1L);
+  }
+
+  // Created before the threads, which access all of them
+  for (unsigned i = 0; i < thread_count; ++i) {
+    workers_.emplace_back(new Worker(order_));
+    workers_.back()->queue = this;
+    workers_.back()->index = i;
+  }
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  if (config_.stack_size) {
+    const size_t min_stack_size = PTHREAD_STACK_MIN;
+    pthread_attr_setstacksize(&attr,
+                              std::max(config_.stack_size, min_stack_size));
+  }
+
+  unsigned started = 0;
+  for (auto &worker : workers_) {
+    int ret =
+        pthread_create(&worker->thread, &attr, ThreadEntry, worker.get());
+    if (ret != 0) {
+      errno = ret;
+      break;
+    }
+    pthread_detach(worker->thread);
+    ++started;
+  }
+  pthread_attr_destroy(&attr);
+
+  // Items are only pushed to running workers
+  started_count_ = started;
+  return started > 0;
+}
+
+void *uorb::WorkQueue::ThreadEntry(void *arg) {
+  auto worker = static_cast<Worker *>(arg);
+  auto &queue = *worker->queue;
+#ifdef __linux__
+  // Names are limited to 16 characters including the terminator
+  char name[16];
+  if (queue.workers_.size() > 1) {
+    snprintf(name, sizeof(name), "%.11s%u", queue.name(), worker->index);
+  } else {
+    snprintf(name, sizeof(name), "%s", queue.name());
+  }
+  pthread_setname_np(pthread_self(), name);
+#endif
+  queue.SetThreadPriority();
+  queue.SetThreadAffinity();
+  queue.Loop(worker);
+  return nullptr;
+}
+
+void uorb::WorkQueue::SetThreadPriority() {
+  if (config_.priority > 0) {
+    // Without the permission, the thread keeps the default policy
+    sched_param param{};
+    param.sched_priority = config_.priority;
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+  } else if (config_.priority < 0) {
+#ifdef __linux__
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), -config_.priority);
+#endif
+  }
+}
+
+void uorb::WorkQueue::SetThreadAffinity() {
+#ifdef __linux__
+  if (!config_.cpu_affinity) return;
+
+  // Without a usable CPU, the thread keeps its affinity
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (unsigned cpu = 0; cpu < 64 && cpu < CPU_SETSIZE; ++cpu) {
+    if (config_.cpu_affinity & (1ULL << cpu)) CPU_SET(cpu, &cpu_set);
+  }
+  pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+#endif
+}
+
+void uorb::WorkQueue::Loop(Worker *worker) {
+  current_worker = worker;
+  while (true) {
+    const orb_abstime_us next_timer_time = next_timer_time_.load();
+    if (next_timer_time != kNoDeadline &&
+        orb_monotonic_time_us() >= next_timer_time) {
+      FireTimers();
+    }
+
+    auto item = Pop(worker);
+    if (!item) {
+      WaitForWork();
+      continue;
+    }
+
+    current_item = item;
+    current_item_removed = false;
+    item->Run();
+    current_item = nullptr;
+
+    // The item removed itself, it may be destroyed already
+    if (current_item_removed) continue;
+
+    item->run_count_.fetch_add(1);
+    uint8_t state = kRunning;
+    if (!item->state_.compare_exchange(&state, kIdle)) {
+      // Scheduled while running: run it again, in this thread
+      item->state_.store(kQueued);
+      Push(worker, item);
+    }
+
+    if (remove_waiting_count_.load()) {
+      base::LockGuard<base::Mutex> lg(remove_lock_);
+      run_finished_.notify_all();
+    }
+  }
+}
+
+void uorb::WorkQueue::Push(Worker *worker, WorkItem *item) {
+  {
+    base::LockGuard<base::Mutex> lg(worker->lock);
+    worker->items.insert(
+        {item->priority_.load(), item->deadline_.load(),
+         next_sequence_.fetch_add(1), item});
+  }
+
+  queued_count_.fetch_add(1);
+  if (sleeping_count_.load()) {
+    base::LockGuard<base::Mutex> lg(sleep_lock_);
+    work_added_.notify_one();
+  }
+}
+
+uorb::WorkItem *uorb::WorkQueue::Take(Worker *worker) {
+  if (worker->items.empty()) return nullptr;
+  auto item = worker->items.begin()->item;
+  worker->items.erase(worker->items.begin());
+
+  // Reschedules while it runs request the next run
+  item->priority_.store(kNoPriority);
+  item->deadline_.store(kNoDeadline);
+  item->state_.store(kRunning);
+  queued_count_.fetch_sub(1);
+  return item;
+}
+
+uorb::WorkItem *uorb::WorkQueue::Pop(Worker *worker) {
+  // The items of this worker first, without touching the other locks
+  {
+    base::LockGuard<base::Mutex> lg(worker->lock);
+    auto item = Take(worker);
+    if (item) return item;
+  }
+
+  // Idle: steal the most urgent item of the next busy worker, which waits
+  // behind the item that worker runs
+  for (unsigned i = 1; i < workers_.size(); ++i) {
+    auto &victim = *workers_[(worker->index + i) % workers_.size()];
+    base::LockGuard<base::Mutex> lg(victim.lock);
+    auto item = Take(&victim);
+    if (item) return item;
+  }
+  return nullptr;
+}
+
+void uorb::WorkQueue::WaitForWork() {
+  // Push() and AddTimer() update queued_count_ or next_timer_time_ before
+  // reading sleeping_count_, so either they notify or the change is seen here
+  base::LockGuard<base::Mutex> lg(sleep_lock_);
+  sleeping_count_.fetch_add(1);
+  while (!queued_count_.load()) {
+    const orb_abstime_us next_timer_time = next_timer_time_.load();
+    if (next_timer_time == kNoDeadline) {
+      work_added_.wait(sleep_lock_);
+    } else if (orb_monotonic_time_us() < next_timer_time) {
+      work_added_.wait_until_us(sleep_lock_, next_timer_time);
+    } else {
+      break;  // Fire the timer
+    }
+  }
+  sleeping_count_.fetch_sub(1);
+}
+
+void uorb::WorkQueue::FireTimers() {
+  // Held while adding the items, so that RemoveTimer() waits for it
+  base::LockGuard<base::Mutex> lg(timer_lock_);
+  const auto now = orb_monotonic_time_us();
+  while (!timers_.empty() && timers_.begin()->time <= now) {
+    const auto timer = *timers_.begin();
+    timers_.erase(timers_.begin());
+    auto item = timer.item;
+
+    orb_abstime_us deadline = 0;
+    if (item->timer_interval_us_) {
+      // The next period after now, at a multiple of the interval
+      const uint64_t interval = item->timer_interval_us_;
+      auto next_time = timer.time + interval;
+      if (next_time <= now) {
+        next_time += ((now - next_time) / interval + 1) * interval;
+      }
+      item->timer_time_ = next_time;
+      item->timer_sequence_ = next_sequence_.fetch_add(1);
+      timers_.insert({next_time, item->timer_sequence_, item});
+      deadline = next_time;
+    } else {
+      item->timer_time_ = 0;
+    }
+    Add(item, 0, deadline);
+  }
+  UpdateNextTimerTime();
+}
+
+void uorb::WorkQueue::UpdateNextTimerTime() {
+  next_timer_time_.store(timers_.empty() ? kNoDeadline
+                                         : timers_.begin()->time);
+}
+
+void uorb::WorkQueue::AddTimer(WorkItem *item, orb_abstime_us time,
+                               uint32_t interval_us) {
+  {
+    base::LockGuard<base::Mutex> lg(timer_lock_);
+    if (item->timer_time_) {
+      timers_.erase({item->timer_time_, item->timer_sequence_, item});
+    }
+    // 0 means no timer
+    item->timer_time_ = std::max<orb_abstime_us>(time, 1);
+    item->timer_interval_us_ = interval_us;
+    item->timer_sequence_ = next_sequence_.fetch_add(1);
+    timers_.insert({item->timer_time_, item->timer_sequence_, item});
+    UpdateNextTimerTime();
+  }
+
+  // A sleeping worker may wait for a later timer
+  if (sleeping_count_.load()) {
+    base::LockGuard<base::Mutex> lg(sleep_lock_);
+    work_added_.notify_one();
+  }
+}
+
+void uorb::WorkQueue::RemoveTimer(WorkItem *item) {
+  base::LockGuard<base::Mutex> lg(timer_lock_);
+  if (!item->timer_time_) return;
+  timers_.erase({item->timer_time_, item->timer_sequence_, item});
+  item->timer_time_ = 0;
+  UpdateNextTimerTime();
+}
+
+uorb::WorkQueue::Worker *uorb::WorkQueue::SelectWorker() {
+  // Keep items scheduled by a worker of this queue in the same thread
+  auto worker = static_cast<Worker *>(current_worker);
+  if (worker && worker->queue == this) return worker;
+
+  return workers_[next_worker_.fetch_add(1) % started_count_].get();
+}
+
+void uorb::WorkQueue::Add(WorkItem *item, int priority,
+                          orb_abstime_us deadline) {
+  if (!deadline) deadline = kNoDeadline;
+
+  uint8_t state = item->state_.load();
+  while (true) {
+    switch (state) {
+      case kIdle:
+        if (!item->state_.compare_exchange(&state, kQueued)) continue;
+        // Not in the items of a worker yet: other threads leave it alone
+        item->priority_.store(priority);
+        item->deadline_.store(deadline);
+        Push(SelectWorker(), item);
+        return;
+
+      case kQueued:
+        if (priority <= item->priority_.load() &&
+            deadline >= item->deadline_.load()) {
+          return;
+        }
+        // More urgent than requested before: queue it again
+        if (!Unqueue(item)) {
+          sched_yield();  // Being pushed, taken or requeued
+          state = item->state_.load();
+          continue;
+        }
+        AtomicMax(&item->priority_, priority);
+        AtomicMin(&item->deadline_, deadline);
+        Push(SelectWorker(), item);
+        return;
+
+      case kRunning:
+        // For the next run, set before the next run can start
+        AtomicMax(&item->priority_, priority);
+        AtomicMin(&item->deadline_, deadline);
+        if (!item->state_.compare_exchange(&state, kRunningRescheduled)) {
+          continue;
+        }
+        return;
+
+      default:  // kRunningRescheduled
+        AtomicMax(&item->priority_, priority);
+        AtomicMin(&item->deadline_, deadline);
+        return;
+    }
+  }
+}
+
+bool uorb::WorkQueue::Unqueue(WorkItem *item) {
+  for (auto &worker : workers_) {
+    base::LockGuard<base::Mutex> lg(worker->lock);
+    auto it = std::find_if(worker->items.begin(), worker->items.end(),
+                           [item](const Entry &entry) {
+                             return entry.item == item;
+                           });
+    if (it != worker->items.end()) {
+      worker->items.erase(it);
+      queued_count_.fetch_sub(1);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool uorb::WorkQueue::Erase(WorkItem *item) {
+  if (!Unqueue(item)) return false;
+  item->priority_.store(kNoPriority);
+  item->deadline_.store(kNoDeadline);
+  item->state_.store(kIdle);
+  return true;
+}
+
+void uorb::WorkQueue::WaitWhileRunning(WorkItem *item) {
+  base::LockGuard<base::Mutex> lg(remove_lock_);
+  remove_waiting_count_.fetch_add(1);
+  uint8_t state;
+  while ((state = item->state_.load()) == kRunning ||
+         state == kRunningRescheduled) {
+    run_finished_.wait(remove_lock_);
+  }
+  remove_waiting_count_.fetch_sub(1);
+}
+
+void uorb::WorkQueue::Remove(WorkItem *item) {
+  RemoveTimer(item);
+  while (true) {
+    if (Erase(item)) return;
+
+    uint8_t state = item->state_.load();
+    if (state == kIdle) return;
+    if (state == kQueued) {
+      sched_yield();  // Add() is about to push it
+      continue;
+    }
+
+    // Called from Run() of the item itself: waiting would never end
+    if (current_item == item) {
+      current_item_removed = true;
+      item->state_.store(kIdle);
+      return;
+    }
+
+    // Don't run it again after this run
+    state = kRunningRescheduled;
+    item->state_.compare_exchange(&state, kRunning);
+    WaitWhileRunning(item);
+  }
+}
+
+uorb::WorkItem::WorkItem(const WorkQueueConfig &config)
+    : queue_(WorkQueue::FindOrCreate(config)),
+      priority_(WorkQueue::kNoPriority),
+      deadline_(WorkQueue::kNoDeadline) {}
+
+uorb::WorkItem::~WorkItem() { ScheduleClear(); }
+
+bool uorb::WorkItem::ScheduleNow(int priority, orb_abstime_us deadline) {
+  if (!queue_) {
+    errno = EAGAIN;
+    return false;
+  }
+  queue_->Add(this, priority, deadline);
+  return true;
+}
+
+bool uorb::WorkItem::ScheduleTimer(orb_abstime_us time,
+                                   uint32_t interval_us) {
+  if (!queue_) {
+    errno = EAGAIN;
+    return false;
+  }
+  queue_->AddTimer(this, time, interval_us);
+  return true;
+}
+
+bool uorb::WorkItem::ScheduleOnInterval(uint32_t interval_us,
+                                        uint32_t delay_us) {
+  if (!interval_us) {
+    errno = EINVAL;
+    return false;
+  }
+  return ScheduleTimer(orb_monotonic_time_us() + delay_us, interval_us);
+}
+
+void uorb::WorkItem::ScheduleClear() {
+  if (queue_) queue_->Remove(this);
+}
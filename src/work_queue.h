@@ -0,0 +1,138 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#pragma once
+
+#include <pthread.h>
+#include <uorb/internal/atomic.h>
+#include <uorb/work_queue.h>
+
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "base/condition_variable.h"
+#include "base/mutex.h"
+
+namespace uorb {
+
+/**
+ * The threads of a WorkQueueConfig and their sets of scheduled work items,
+ * sorted by urgency.
+ */
+class WorkQueue : internal::Noncopyable {
+ public:
+  enum ItemState : uint8_t {
+    kIdle,
+    kQueued,              // In the items of a worker
+    kRunning,             // Run() in progress
+    kRunningRescheduled,  // Run() in progress, queued again when it returns
+  };
+
+  /**
+   * Get the queue named config.name, starting its threads on first use.
+   * @return nullptr with errno set if the threads could not be started.
+   */
+  static WorkQueue *FindOrCreate(const WorkQueueConfig &config);
+
+  const char *name() const { return config_.name; }
+  unsigned thread_count() const { return workers_.size(); }
+
+  // Queue the item unless it is already queued, see WorkItem::ScheduleNow()
+  void Add(WorkItem *item, int priority, orb_abstime_us deadline);
+
+  // Queue the item at the time, and then every interval_us if not 0
+  void AddTimer(WorkItem *item, orb_abstime_us time, uint32_t interval_us);
+
+  // Stop the timer, unqueue the item and wait until it is not running anymore
+  void Remove(WorkItem *item);
+
+  // Priority and deadline of an item that has not been scheduled
+  static constexpr int kNoPriority = INT32_MIN;
+  static constexpr orb_abstime_us kNoDeadline = UINT64_MAX;
+
+ private:
+  // A queued item, with the priority and deadline of its next run
+  struct Entry {
+    int priority;
+    orb_abstime_us deadline;
+    uint64_t sequence;  // Unique, in scheduling order
+    WorkItem *item;
+  };
+
+  // Most urgent first, according to WorkQueueConfig::ordering
+  struct EntryOrder {
+    WorkQueueConfig::Ordering ordering;
+    bool operator()(const Entry &a, const Entry &b) const;
+  };
+
+  // A timer of a work item, earliest first
+  struct Timer {
+    orb_abstime_us time;
+    uint64_t sequence;  // Unique, in scheduling order
+    WorkItem *item;
+
+    bool operator<(const Timer &other) const {
+      return time != other.time ? time < other.time
+                                : sequence < other.sequence;
+    }
+  };
+
+  struct Worker {
+    explicit Worker(EntryOrder order) : items(order) {}
+
+    WorkQueue *queue{nullptr};
+    unsigned index{0};
+    pthread_t thread{};
+
+    base::Mutex lock;
+    std::set<Entry, EntryOrder> items;  // Guarded by lock
+  };
+
+  explicit WorkQueue(const WorkQueueConfig &config)
+      : config_(config), order_{config.ordering} {}
+
+  bool Start();
+  static void *ThreadEntry(void *arg);
+  void SetThreadPriority();
+  void SetThreadAffinity();
+  void Loop(Worker *worker);
+
+  Worker *SelectWorker();
+  void Push(Worker *worker, WorkItem *item);
+  WorkItem *Pop(Worker *worker);
+  WorkItem *Take(Worker *worker);  // The most urgent item, with worker->lock
+  bool Unqueue(WorkItem *item);
+  bool Erase(WorkItem *item);
+  void WaitForWork();
+  void FireTimers();
+  void RemoveTimer(WorkItem *item);
+  void UpdateNextTimerTime();
+  void WaitWhileRunning(WorkItem *item);
+
+  const WorkQueueConfig config_;
+  const EntryOrder order_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  unsigned started_count_{0};  // workers_ with a running thread
+  base::atomic<unsigned> next_worker_{0};  // Round robin for other threads
+  base::atomic<uint64_t> next_sequence_{0};
+
+  // Sleeping workers wait for queued_count_ > 0
+  base::atomic<unsigned> queued_count_{0};
+  base::atomic<unsigned> sleeping_count_{0};
+  base::Mutex sleep_lock_;
+  base::ConditionVariable work_added_;
+
+  // Fired by the workers, before they look for queued items or sleep.
+  // Taken before the other locks.
+  base::Mutex timer_lock_;
+  std::set<Timer> timers_;  // Guarded by timer_lock_
+  base::atomic<orb_abstime_us> next_timer_time_{kNoDeadline};
+
+  // Remove() waits for the end of a Run()
+  base::atomic<unsigned> remove_waiting_count_{0};
+  base::Mutex remove_lock_;
+  base::ConditionVariable run_finished_;
+};
+
+}  // namespace uorb
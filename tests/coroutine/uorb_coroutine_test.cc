@@ -0,0 +1,144 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <uorb/coroutine.h>
+#include <uorb/publication.h>
+#include <uorb/topics/orb_test_medium.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using uorb::coro::Scheduler;
+using uorb::coro::Subscription;
+using uorb::coro::Task;
+
+// Skip the message of a previous test
+template <const orb_metadata &meta>
+static void Drain(Subscription<meta> &sub) {
+  orb_test_medium_s data{};
+  sub.Update(&data);
+}
+
+static Task ReceiveThree(Scheduler &scheduler, std::vector<int> *values,
+                         std::atomic<bool> *ready) {
+  Subscription<uorb::msg::orb_test_medium_coroutine> sub(scheduler);
+  Drain(sub);
+  *ready = true;
+  for (int i = 0; i < 3; ++i) {
+    auto data = co_await sub.next();
+    values->push_back(data.val);
+  }
+}
+
+TEST(CoroutineTest, next) {
+  Scheduler scheduler;
+  std::vector<int> values;
+  std::atomic<bool> ready{false};
+  scheduler.Spawn(ReceiveThree(scheduler, &values, &ready));
+  EXPECT_EQ(scheduler.task_count(), 1);
+
+  std::thread publisher([&]() {
+    uorb::PublicationData<uorb::msg::orb_test_medium_coroutine> pub;
+    while (!ready) usleep(1000);
+    for (int i = 1; i <= 3; ++i) {
+      pub.get().val = i;
+      pub.Publish();
+      usleep(5 * 1000);
+    }
+  });
+  scheduler.Run();  // Until the task has received the messages
+  publisher.join();
+
+  EXPECT_EQ(values, std::vector<int>({1, 2, 3}));
+  EXPECT_EQ(scheduler.task_count(), 0);
+}
+
+static Task WaitForAny(Scheduler &scheduler, std::vector<size_t> *indexes,
+                       std::atomic<bool> *ready) {
+  Subscription<uorb::msg::orb_test_medium_coroutine> sub_a(scheduler);
+  Subscription<uorb::msg::orb_test_medium_coroutine_any> sub_b(scheduler);
+  Drain(sub_a);
+  Drain(sub_b);
+  *ready = true;
+  for (int i = 0; i < 2; ++i) {
+    const auto index = co_await uorb::coro::when_any(sub_a, sub_b);
+    indexes->push_back(index);
+    orb_test_medium_s data{};
+    EXPECT_TRUE(index == 0 ? sub_a.Update(&data) : sub_b.Update(&data));
+  }
+}
+
+TEST(CoroutineTest, when_any) {
+  Scheduler scheduler;
+  std::vector<size_t> indexes;
+  std::atomic<bool> ready{false};
+  scheduler.Spawn(WaitForAny(scheduler, &indexes, &ready));
+
+  std::thread publisher([&]() {
+    uorb::PublicationData<uorb::msg::orb_test_medium_coroutine> pub_a;
+    uorb::PublicationData<uorb::msg::orb_test_medium_coroutine_any> pub_b;
+    while (!ready) usleep(1000);
+    pub_b.Publish();
+    usleep(20 * 1000);
+    pub_a.Publish();
+  });
+  scheduler.Run();
+  publisher.join();
+
+  EXPECT_EQ(indexes, std::vector<size_t>({1, 0}));
+}
+
+static Task ReceiveOne(Scheduler &scheduler, std::atomic<int> *subscribed,
+                       int *received) {
+  Subscription<uorb::msg::orb_test_medium_coroutine> sub(scheduler);
+  Drain(sub);
+  ++*subscribed;
+  co_await sub.next();
+  ++*received;
+}
+
+TEST(CoroutineTest, many_tasks_in_one_thread) {
+  const int num_tasks = 1000;
+  Scheduler scheduler;
+  std::atomic<int> subscribed{0};
+  int received = 0;
+  for (int i = 0; i < num_tasks; ++i) {
+    scheduler.Spawn(ReceiveOne(scheduler, &subscribed, &received));
+  }
+
+  // One publication for all the tasks
+  std::thread publisher([&]() {
+    while (subscribed < num_tasks) usleep(1000);
+    uorb::PublicationData<uorb::msg::orb_test_medium_coroutine> pub;
+    pub.Publish();
+  });
+  scheduler.Run();
+  publisher.join();
+
+  EXPECT_EQ(received, num_tasks);
+}
+
+TEST(CoroutineTest, stop_and_destroy_waiting_tasks) {
+  std::atomic<int> subscribed{0};
+  int received = 0;
+  auto scheduler = std::make_unique<Scheduler>();
+  scheduler->Spawn(ReceiveOne(*scheduler, &subscribed, &received));
+
+  std::thread stopper([&]() {
+    usleep(20 * 1000);
+    scheduler->Stop();
+  });
+  scheduler->Run();
+  stopper.join();
+  EXPECT_EQ(scheduler->task_count(), 1);
+
+  // Unsubscribes the waiting task
+  scheduler.reset();
+  uorb::PublicationData<uorb::msg::orb_test_medium_coroutine> pub;
+  EXPECT_TRUE(pub.Publish());
+  EXPECT_EQ(received, 0);
+}
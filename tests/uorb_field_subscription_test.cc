@@ -0,0 +1,97 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include <gtest/gtest.h>
+#include <uorb/publication.h>
+#include <uorb/subscription.h>
+#include <uorb/topics/orb_test_medium.h>
+
+TEST(FieldSubscriptionTest, check_update) {
+  uorb::PublicationData<uorb::msg::orb_test_medium_fields> pub;
+  uorb::Subscription<uorb::msg::orb_test_medium_fields> sub;
+  ASSERT_TRUE(sub.SetFields("val"));
+  orb_test_medium_s data{};
+
+  // The first message changes all fields
+  ASSERT_TRUE(pub.Publish());
+  ASSERT_TRUE(sub.Update(&data));
+
+  for (int i = 1; i <= 3; ++i) {
+    pub.get().timestamp = i;
+    pub.get().junk[0] = i;
+    ASSERT_TRUE(pub.Publish());
+  }
+  EXPECT_FALSE(orb_check_update(sub.handle()));
+
+  // The messages up to the one that changed val are read
+  pub.get().val = 1;
+  ASSERT_TRUE(pub.Publish());
+  pub.get().timestamp = 10;
+  ASSERT_TRUE(pub.Publish());
+  ASSERT_TRUE(sub.Update(&data));
+  EXPECT_EQ(data.timestamp, 1);
+  unsigned copied = 1;
+  while (sub.Update(&data)) ++copied;
+  EXPECT_EQ(copied, 4);
+  EXPECT_EQ(data.val, 1);
+  EXPECT_EQ(data.timestamp, 3);
+
+  // Several fields
+  ASSERT_TRUE(sub.SetFields("val;junk"));
+  while (sub.Update(&data)) {
+  }
+  pub.get().junk[63] = 1;
+  ASSERT_TRUE(pub.Publish());
+  ASSERT_TRUE(orb_check_update(sub.handle()));
+
+  // All messages again
+  ASSERT_TRUE(sub.SetFields(nullptr));
+  while (sub.Update(&data)) {
+  }
+  ASSERT_TRUE(pub.Publish());
+  EXPECT_TRUE(orb_check_update(sub.handle()));
+}
+
+TEST(FieldSubscriptionTest, unknown_fields) {
+  uorb::Subscription<uorb::msg::orb_test_medium_fields> sub;
+  ASSERT_TRUE(sub.Subscribed());
+  EXPECT_FALSE(orb_set_subscription_fields(sub.handle(), "val;missing"));
+  EXPECT_EQ(errno, EINVAL);
+  EXPECT_FALSE(orb_set_subscription_fields(sub.handle(), ""));
+  EXPECT_FALSE(orb_set_subscription_fields(nullptr, "val"));
+}
+
+static void Count(void *arg) { ++*static_cast<int *>(arg); }
+
+TEST(FieldSubscriptionTest, callbacks) {
+  uorb::PublicationData<uorb::msg::orb_test_medium_fields_callback> pub;
+  ASSERT_TRUE(pub.Publish());
+
+  uorb::Subscription<uorb::msg::orb_test_medium_fields_callback> sub_val;
+  uorb::Subscription<uorb::msg::orb_test_medium_fields_callback> sub_all;
+  ASSERT_TRUE(sub_val.SetFields("val"));
+  int val_count = 0, all_count = 0;
+  ASSERT_TRUE(orb_set_subscription_callback(sub_val.handle(), Count,
+                                            &val_count));
+  ASSERT_TRUE(orb_set_subscription_callback(sub_all.handle(), Count,
+                                            &all_count));
+
+  for (int i = 1; i <= 10; ++i) {
+    pub.get().timestamp = i;
+    if (i % 5 == 0) pub.get().val = i;
+    ASSERT_TRUE(pub.Publish());
+  }
+  EXPECT_EQ(val_count, 2);
+  EXPECT_EQ(all_count, 10);
+
+  // orb_poll() is not woken up either
+  orb_pollfd fds[] = {{sub_val.handle(), POLLIN, 0}};
+  orb_test_medium_s data{};
+  while (orb_check_update(sub_val.handle())) {
+    ASSERT_TRUE(orb_copy(sub_val.handle(), &data));
+  }
+  pub.get().timestamp = 11;
+  ASSERT_TRUE(pub.Publish());
+  EXPECT_EQ(orb_poll(fds, 1, 10), 0);
+  EXPECT_EQ(fds[0].revents, 0);
+}
@@ -0,0 +1,117 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include <gtest/gtest.h>
+#include <uorb/abs_time.h>
+#include <uorb/publication.h>
+#include <uorb/subscription.h>
+#include <uorb/topics/orb_test_medium.h>
+
+// Queues of orb_test_medium (ORB_QUEUE_SIZE = 16) with messages published
+// every millisecond of simulated time. Every test uses its own topic: the
+// simulated time starts again at the system time.
+class HistoryTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(orb_set_clock_source(ORB_CLOCK_LOCKSTEP));
+  }
+  void TearDown() override {
+    EXPECT_TRUE(orb_set_clock_source(ORB_CLOCK_MONOTONIC));
+  }
+
+  // Publishes val 1 to count, message n at start_ + n ms
+  template <const orb_metadata &meta>
+  void Publish(int count) {
+    uorb::PublicationData<meta> pub;
+    start_ = orb_absolute_time_us();
+    for (int i = 1; i <= count; ++i) {
+      ASSERT_TRUE(orb_advance_lockstep_time(1000));
+      pub.get().val = i;
+      ASSERT_TRUE(pub.Publish());
+    }
+  }
+
+  orb_abstime_us At(int ms) const { return start_ + ms * 1000; }
+
+  orb_abstime_us start_{0};
+};
+
+TEST_F(HistoryTest, copy_at_time) {
+  uorb::Subscription<uorb::msg::orb_test_medium_history> sub;
+  orb_test_medium_s data{};
+  orb_copy_info info{};
+  ASSERT_TRUE(sub.Subscribed());
+  Publish<uorb::msg::orb_test_medium_history>(10);
+
+  EXPECT_TRUE(sub.CopyAtTime(At(5) + 500, &data, &info));
+  EXPECT_EQ(data.val, 5);
+  EXPECT_EQ(info.timestamp, At(5));
+  EXPECT_TRUE(sub.CopyAtTime(At(5), &data));
+  EXPECT_EQ(data.val, 5);
+  EXPECT_TRUE(sub.CopyAtTime(At(100), &data));
+  EXPECT_EQ(data.val, 10);
+
+  EXPECT_FALSE(sub.CopyAtTime(At(0), &data));
+  EXPECT_EQ(errno, ENODATA);
+
+  // orb_copy() still reads the unread messages in order
+  EXPECT_TRUE(sub.Update(&data));
+  EXPECT_EQ(data.val, 1);
+}
+
+TEST_F(HistoryTest, only_queued_messages) {
+  uorb::Subscription<uorb::msg::orb_test_medium_history_wrap> sub;
+  orb_test_medium_s data{};
+  Publish<uorb::msg::orb_test_medium_history_wrap>(20);
+
+  // 1 to 4 were overwritten
+  EXPECT_FALSE(sub.CopyAtTime(At(4), &data));
+  EXPECT_TRUE(sub.CopyAtTime(At(5), &data));
+  EXPECT_EQ(data.val, 5);
+
+  orb_test_medium_s range[20]{};
+  EXPECT_EQ(sub.CopyRange(0, At(100), range, 20), 16);
+  EXPECT_EQ(range[0].val, 5);
+  EXPECT_EQ(range[15].val, 20);
+}
+
+TEST_F(HistoryTest, copy_range) {
+  uorb::Subscription<uorb::msg::orb_test_medium_history_range> sub;
+  Publish<uorb::msg::orb_test_medium_history_range>(10);
+
+  orb_test_medium_s range[10]{};
+  orb_copy_info infos[10]{};
+  ASSERT_EQ(sub.CopyRange(At(3), At(6), range, 10, infos), 4);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(range[i].val, 3 + i);
+    EXPECT_EQ(infos[i].timestamp, At(3 + i));
+    EXPECT_EQ(infos[i].generation, infos[0].generation + i);
+  }
+
+  // Only the information
+  orb_copy_info only_infos[10]{};
+  ASSERT_EQ(sub.CopyRange(At(3), At(6), nullptr, 10, only_infos), 4);
+  EXPECT_EQ(only_infos[3].timestamp, At(6));
+  EXPECT_EQ(sub.CopyRange(At(3), At(6), nullptr, 10), -1);
+  EXPECT_EQ(errno, EINVAL);
+
+  // The oldest ones first
+  ASSERT_EQ(sub.CopyRange(At(3) - 500, At(100), range, 2), 2);
+  EXPECT_EQ(range[0].val, 3);
+  EXPECT_EQ(range[1].val, 4);
+
+  EXPECT_EQ(sub.CopyRange(At(3) + 1, At(4) - 1, range, 10), 0);
+  EXPECT_EQ(sub.CopyRange(At(6), At(3), range, 10), 0);
+}
+
+TEST_F(HistoryTest, never_published) {
+  uorb::Subscription<uorb::msg::orb_test_medium_history_empty> sub;
+  orb_test_medium_s data{};
+  EXPECT_FALSE(sub.CopyAtTime(orb_absolute_time_us(), &data));
+  EXPECT_EQ(errno, ENODATA);
+  EXPECT_EQ(sub.CopyRange(0, orb_absolute_time_us(), &data, 1), 0);
+
+  EXPECT_FALSE(orb_copy_at_time(nullptr, 0, &data, nullptr));
+  EXPECT_EQ(errno, EINVAL);
+  EXPECT_EQ(orb_copy_range(nullptr, 0, 0, &data, 1, nullptr), -1);
+}
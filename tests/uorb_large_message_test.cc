@@ -0,0 +1,117 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include <gtest/gtest.h>
+#include <uorb/publication.h>
+#include <uorb/subscription.h>
+#include <uorb/topics/orb_test_image.h>
+
+#include <memory>
+
+static orb_status TopicStatus(const orb_metadata &meta) {
+  orb_status status{};
+  EXPECT_TRUE(orb_get_topic_status(&meta, 0, &status));
+  return status;
+}
+
+TEST(LargeMessageTest, publish) {
+  const auto &meta = uorb::msg::orb_test_image;
+  ASSERT_GT(meta.o_size, 65535);
+  ASSERT_EQ(meta.o_abi_version, ORB_METADATA_ABI_VERSION);
+
+  // The queue is allocated with the publication
+  auto handle = orb_create_publication(&meta);
+  ASSERT_NE(handle, nullptr);
+  EXPECT_EQ(TopicStatus(meta).queue_bytes,
+            meta.o_queue_size * (meta.o_size + sizeof(uint64_t)));
+
+  uorb::Subscription<uorb::msg::orb_test_image> sub;
+  std::unique_ptr<orb_test_image_s> image(new orb_test_image_s());
+  image->width = 640;
+  image->height = 480;
+  image->pixels[sizeof(image->pixels) - 1] = 1;
+  ASSERT_TRUE(orb_publish(handle, image.get()));
+
+  std::unique_ptr<orb_test_image_s> copy(new orb_test_image_s());
+  ASSERT_TRUE(sub.Update(copy.get()));
+  EXPECT_EQ(copy->width, 640);
+  EXPECT_EQ(copy->height, 480);
+  EXPECT_EQ(copy->pixels[sizeof(copy->pixels) - 1], 1);
+
+  ASSERT_TRUE(orb_destroy_publication(&handle));
+}
+
+TEST(LargeMessageTest, loan) {
+  const auto &meta = uorb::msg::orb_test_image_loan;
+  uorb::Publication<uorb::msg::orb_test_image_loan> pub;
+  uorb::Subscription<uorb::msg::orb_test_image_loan> sub;
+  ASSERT_TRUE(sub.Subscribed());
+  std::unique_ptr<orb_test_image_s> copy(new orb_test_image_s());
+
+  EXPECT_FALSE(pub.PublishLoan());
+  for (unsigned i = 0; i < meta.o_queue_size + 1; ++i) {
+    auto image = pub.Loan();
+    ASSERT_NE(image, nullptr);
+    image->width = i;
+
+    // Until the loaned slot is published
+    EXPECT_EQ(pub.Loan(), nullptr);
+    EXPECT_EQ(errno, EBUSY);
+    EXPECT_FALSE(pub.Publish(*copy));
+    EXPECT_EQ(errno, EBUSY);
+
+    ASSERT_TRUE(pub.PublishLoan());
+  }
+  EXPECT_EQ(TopicStatus(meta).publish_count, meta.o_queue_size + 1);
+
+  // The oldest message is given up when its slot is loaned
+  auto image = pub.Loan();
+  ASSERT_NE(image, nullptr);
+  image->width = 10;
+  orb_copy_info info{};
+  ASSERT_TRUE(sub.Update(copy.get(), &info));
+  EXPECT_EQ(copy->width, 2);
+  EXPECT_EQ(info.lost, 2);
+  ASSERT_TRUE(sub.Update(copy.get()));
+  EXPECT_EQ(copy->width, 3);
+  EXPECT_FALSE(sub.Update(copy.get()));
+
+  ASSERT_TRUE(pub.PublishLoan());
+  ASSERT_TRUE(sub.Update(copy.get()));
+  EXPECT_EQ(copy->width, 10);
+}
+
+TEST(LargeMessageTest, resize_while_loaned) {
+  const auto &meta = uorb::msg::orb_test_image_resize;
+  auto handle = orb_create_publication(&meta);
+  ASSERT_NE(handle, nullptr);
+  uorb::Subscription<uorb::msg::orb_test_image_resize> sub;
+  ASSERT_TRUE(sub.Subscribed());
+
+  ASSERT_NE(orb_loan(handle), nullptr);
+  // The queue is not resized until the loaned slot is published, the
+  // backlog is counted from the current queue size
+  ASSERT_TRUE(sub.SetQueueSize(meta.o_queue_size + 2));
+  EXPECT_EQ(TopicStatus(meta).queue_size, meta.o_queue_size);
+  EXPECT_EQ(orb_get_subscriber_backlog(handle), 0);
+
+  ASSERT_TRUE(orb_publish_loan(handle));
+  EXPECT_EQ(TopicStatus(meta).queue_size, meta.o_queue_size + 2);
+  EXPECT_EQ(orb_get_subscriber_backlog(handle), 1);
+
+  ASSERT_TRUE(orb_destroy_publication(&handle));
+}
+
+TEST(LargeMessageTest, abi_version) {
+  // Generated for an older layout of orb_metadata
+  const auto &image = uorb::msg::orb_test_image_abi;
+  const orb_metadata meta{ORB_METADATA_ABI_VERSION - 1, image.o_name,
+                          image.o_size, image.o_size_no_padding,
+                          image.o_fields, image.o_queue_size, image.o_flags};
+
+  EXPECT_EQ(orb_create_publication(&meta), nullptr);
+  EXPECT_EQ(errno, EPROTO);
+  EXPECT_EQ(orb_create_subscription(&meta), nullptr);
+  EXPECT_EQ(errno, EPROTO);
+  EXPECT_FALSE(orb_exists(&uorb::msg::orb_test_image_abi, 0));
+}
@@ -0,0 +1,212 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <uorb/abs_time.h>
+#include <uorb/publication.h>
+#include <uorb/subscription_interval.h>
+#include <uorb/topics/orb_test_medium.h>
+#include <uorb/work_queue.h>
+
+#include <atomic>
+#include <thread>
+
+class LockstepTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(orb_set_clock_source(ORB_CLOCK_LOCKSTEP));
+  }
+  void TearDown() override {
+    EXPECT_TRUE(orb_set_clock_source(ORB_CLOCK_MONOTONIC));
+  }
+};
+
+// Poll the condition in real time, for up to a second
+template <typename Predicate>
+static bool WaitFor(Predicate p) {
+  for (int i = 0; i < 1000 && !p(); ++i) usleep(1000);
+  return p();
+}
+
+TEST_F(LockstepTest, time) {
+  const auto start = orb_absolute_time_us();
+  usleep(10 * 1000);
+  EXPECT_EQ(orb_absolute_time_us(), start);
+  EXPECT_EQ(orb_monotonic_time_us(), start);
+
+  EXPECT_TRUE(orb_advance_lockstep_time(1000));
+  EXPECT_EQ(orb_absolute_time_us(), start + 1000);
+  EXPECT_TRUE(orb_set_lockstep_time(start + 5000));
+  EXPECT_EQ(orb_absolute_time_us(), start + 5000);
+
+  // Never backwards
+  EXPECT_FALSE(orb_set_lockstep_time(start));
+  EXPECT_EQ(errno, EINVAL);
+  EXPECT_EQ(orb_absolute_time_us(), start + 5000);
+}
+
+TEST_F(LockstepTest, concurrent_advance) {
+  const auto start = orb_absolute_time_us();
+  const int steps = 1000;
+
+  // No step is lost to another thread advancing at the same time
+  std::thread thread([] {
+    for (int i = 0; i < steps; ++i) ASSERT_TRUE(orb_advance_lockstep_time(1));
+  });
+  for (int i = 0; i < steps; ++i) ASSERT_TRUE(orb_advance_lockstep_time(1));
+  thread.join();
+  EXPECT_EQ(orb_absolute_time_us(), start + 2 * steps);
+
+  // Wrapping around is going backwards
+  EXPECT_FALSE(orb_advance_lockstep_time(UINT64_MAX));
+  EXPECT_EQ(errno, EINVAL);
+}
+
+TEST(LockstepTimeTest, not_selected) {
+  EXPECT_FALSE(orb_set_lockstep_time(orb_absolute_time_us() + 1000));
+  EXPECT_EQ(errno, EINVAL);
+}
+
+TEST_F(LockstepTest, publish_timestamp) {
+  uorb::PublicationData<uorb::msg::orb_test_medium_lockstep> pub;
+  uorb::SubscriptionData<uorb::msg::orb_test_medium_lockstep> sub;
+  ASSERT_TRUE(orb_advance_lockstep_time(1000));
+  ASSERT_TRUE(pub.Publish());
+
+  orb_test_medium_s data{};
+  orb_copy_info info{};
+  ASSERT_TRUE(sub.Copy(&data, &info));
+  EXPECT_EQ(info.timestamp, orb_absolute_time_us());
+}
+
+TEST_F(LockstepTest, poll_timeout) {
+  uorb::SubscriptionData<uorb::msg::orb_test_medium_lockstep> sub;
+  sub.Update();
+
+  std::atomic<bool> returned{false};
+  int ret = -1;
+  std::thread poller([&]() {
+    orb_pollfd fds[] = {{sub.handle(), POLLIN, 0}};
+    ret = orb_poll(fds, 1, 1000);
+    returned = true;
+  });
+
+  // Only the simulation time expires the timeout
+  usleep(50 * 1000);
+  EXPECT_FALSE(returned);
+  ASSERT_TRUE(orb_advance_lockstep_time(500 * 1000));
+  usleep(20 * 1000);
+  EXPECT_FALSE(returned);
+  ASSERT_TRUE(orb_advance_lockstep_time(500 * 1000));
+  EXPECT_TRUE(WaitFor([&]() { return returned.load(); }));
+  poller.join();
+  EXPECT_EQ(ret, 0);
+}
+
+TEST_F(LockstepTest, poll_wakes_on_publish) {
+  uorb::SubscriptionData<uorb::msg::orb_test_medium_lockstep> sub;
+  sub.Update();
+
+  std::thread publisher([]() {
+    usleep(20 * 1000);
+    uorb::PublicationData<uorb::msg::orb_test_medium_lockstep> pub;
+    pub.Publish();
+  });
+  orb_pollfd fds[] = {{sub.handle(), POLLIN, 0}};
+  EXPECT_EQ(orb_poll(fds, 1, 1000), 1);
+  publisher.join();
+}
+
+TEST_F(LockstepTest, work_queue_timer) {
+  static const uorb::WorkQueueConfig kLockstepQueue{
+      "wq:lockstep", 0, 0, 1, uorb::WorkQueueConfig::kFixedPriority, 0};
+  struct CountItem : uorb::WorkItem {
+    CountItem() : WorkItem(kLockstepQueue) {}
+    ~CountItem() override { ScheduleClear(); }
+    void Run() override {}
+  };
+
+  // An hour of 1 kHz loop, as fast as the thread can run it
+  CountItem item;
+  const uint32_t interval_us = 1000;
+  const uint64_t steps = 3600 * 1000;
+  ASSERT_TRUE(item.ScheduleOnInterval(interval_us));
+  usleep(20 * 1000);
+  EXPECT_EQ(item.run_count(), 1);
+
+  for (uint64_t i = 1; i <= 100; ++i) {
+    ASSERT_TRUE(orb_advance_lockstep_time(interval_us));
+    ASSERT_TRUE(WaitFor([&]() { return item.run_count() == i + 1; }));
+  }
+
+  // Skipped periods run once
+  ASSERT_TRUE(orb_advance_lockstep_time((steps - 100) * interval_us));
+  EXPECT_TRUE(WaitFor([&]() { return item.run_count() == 102; }));
+  usleep(10 * 1000);
+  EXPECT_EQ(item.run_count(), 102);
+}
+
+TEST_F(LockstepTest, subscription_interval) {
+  uorb::PublicationData<uorb::msg::orb_test_medium_lockstep> pub;
+  uorb::SubscriptionInterval<uorb::msg::orb_test_medium_lockstep> sub(
+      10 * 1000);
+  orb_test_medium_s data{};
+
+  ASSERT_TRUE(pub.Publish());
+  ASSERT_TRUE(orb_advance_lockstep_time(10 * 1000));
+  EXPECT_TRUE(sub.Update(&data));
+  // Catching up with the interval
+  ASSERT_TRUE(pub.Publish());
+  EXPECT_TRUE(sub.Update(&data));
+
+  ASSERT_TRUE(pub.Publish());
+  usleep(20 * 1000);
+  EXPECT_FALSE(sub.Update(&data));
+  ASSERT_TRUE(orb_advance_lockstep_time(10 * 1000));
+  EXPECT_TRUE(sub.Update(&data));
+}
+
+TEST_F(LockstepTest, subscription_interval_copy_info) {
+  uorb::PublicationData<uorb::msg::orb_test_medium_lockstep> pub;
+  uorb::SubscriptionInterval<uorb::msg::orb_test_medium_lockstep> sub(
+      10 * 1000);
+  orb_test_medium_s data{};
+  orb_copy_info info{};
+
+  // The copies with the information count for the interval as well
+  ASSERT_TRUE(pub.Publish());
+  ASSERT_TRUE(orb_advance_lockstep_time(10 * 1000));
+  EXPECT_TRUE(sub.Update(&data, &info));
+  EXPECT_EQ(info.timestamp, orb_absolute_time_us() - 10 * 1000);
+  ASSERT_TRUE(pub.Publish());
+  EXPECT_TRUE(sub.Update(&data, &info));
+
+  ASSERT_TRUE(pub.Publish());
+  EXPECT_FALSE(sub.Update(&data, &info));
+  ASSERT_TRUE(orb_advance_lockstep_time(10 * 1000));
+  ASSERT_TRUE(sub.Copy(&data, &info));
+  EXPECT_EQ(info.timestamp, orb_absolute_time_us() - 10 * 1000);
+
+  ASSERT_TRUE(pub.Publish());
+  EXPECT_FALSE(sub.Update(&data));
+}
+
+TEST_F(LockstepTest, leave_wakes_waits) {
+  uorb::SubscriptionData<uorb::msg::orb_test_medium_lockstep> sub;
+  sub.Update();
+
+  std::atomic<bool> returned{false};
+  std::thread poller([&]() {
+    orb_pollfd fds[] = {{sub.handle(), POLLIN, 0}};
+    orb_poll(fds, 1, 100);
+    returned = true;
+  });
+  usleep(20 * 1000);
+  EXPECT_FALSE(returned);
+
+  // The system clock expires the timeout after leaving the lockstep
+  ASSERT_TRUE(orb_set_clock_source(ORB_CLOCK_MONOTONIC));
+  EXPECT_TRUE(WaitFor([&]() { return returned.load(); }));
+  poller.join();
+}
@@ -0,0 +1,544 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <uorb/abs_time.h>
+#include <uorb/topics/orb_test_medium.h>
+#include <uorb/topics/uorb_topics.h>
+#include <uorb/uorb.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "uorb_log_format.h"
+#include "uorb_log_reader.h"
+#include "uorb_recorder.h"
+#include "uorb_replayer.h"
+#include "uorb_ulog_writer.h"
+
+using namespace uorb::logger;
+
+static std::string TempLogPath(const char *name, const char *suffix) {
+  return std::string("/tmp/uorb_") + name + "_" + std::to_string(getpid()) +
+         suffix;
+}
+
+static std::vector<uint8_t> ReadFile(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  return {std::istreambuf_iterator<char>(file),
+          std::istreambuf_iterator<char>()};
+}
+
+TEST(RecorderTest, record_topic) {
+  const auto path = TempLogPath("recorder", ".log");
+  const int num_messages = 64;
+
+  orb_test_medium_s pub_data{};
+  auto pub = orb_create_publication(ORB_ID(orb_test_medium_recorder));
+  ASSERT_NE(pub, nullptr);
+  ASSERT_TRUE(orb_publish(pub, &pub_data));
+  // Receives the publish times
+  auto sub = orb_create_subscription(ORB_ID(orb_test_medium_recorder));
+  ASSERT_NE(sub, nullptr);
+  ASSERT_TRUE(orb_set_subscription_queue_size(sub, num_messages + 1));
+
+  RecorderConfig config;
+  config.topics = orb_get_topics(&config.topic_count);
+  config.topic_names = {"orb_test_medium_recorder"};
+  config.block_size = 4096;
+  config.block_count = 4;
+
+  Recorder recorder(config);
+  ASSERT_TRUE(recorder.Start(path)) << "errno: " << errno;
+
+  usleep(10 * 1000);
+  for (int i = 1; i <= num_messages; ++i) {
+    pub_data.val = i;
+    orb_publish(pub, &pub_data);
+    usleep(1000);
+  }
+  recorder.Stop();
+  orb_destroy_publication(&pub);
+
+  auto status = recorder.status();
+  EXPECT_EQ(status.records, num_messages + 1);
+  EXPECT_EQ(status.dropped, 0);
+  EXPECT_EQ(status.write_errors, 0);
+
+  std::vector<uint64_t> publish_times;
+  orb_copy_info info{};
+  for (int i = 0; i <= num_messages; ++i) {
+    ASSERT_TRUE(orb_copy_ex(sub, &pub_data, &info));
+    EXPECT_EQ(info.lost, 0);
+    publish_times.push_back(info.timestamp);
+  }
+  orb_destroy_subscription(&sub);
+
+  auto file = ReadFile(path);
+  ASSERT_EQ(file.size(), status.bytes);
+  ASSERT_EQ(file.size() % config.block_size, 0);
+
+  auto &header = *reinterpret_cast<const LogFileHeader *>(file.data());
+  ASSERT_EQ(memcmp(header.magic, kLogFileMagic, sizeof(kLogFileMagic)), 0);
+  ASSERT_EQ(header.block_size, config.block_size);
+  ASSERT_EQ(header.topic_count, 1);
+  auto &desc = *reinterpret_cast<const LogTopicDesc *>(&header + 1);
+  EXPECT_EQ(desc.size, sizeof(orb_test_medium_s));
+  EXPECT_EQ(std::string(reinterpret_cast<const char *>(&desc + 1),
+                        desc.name_len),
+            "orb_test_medium_recorder");
+
+  int expected_val = 0;
+  int index_blocks = 0;
+  for (size_t offset = header.block_size; offset < file.size();
+       offset += header.block_size) {
+    auto block = file.data() + offset;
+    auto &block_header = *reinterpret_cast<const LogBlockHeader *>(block);
+    if (block_header.magic == kLogIndexMagic) {
+      ++index_blocks;
+      continue;
+    }
+    ASSERT_EQ(block_header.magic, kLogBlockMagic);
+
+    uint32_t used = sizeof(LogBlockHeader);
+    for (uint32_t i = 0; i < block_header.record_count; ++i) {
+      auto &record = *reinterpret_cast<const LogRecordHeader *>(block + used);
+      ASSERT_EQ(record.topic, 0);
+      ASSERT_EQ(record.size, sizeof(orb_test_medium_s));
+      orb_test_medium_s sub_data{};
+      memcpy(&sub_data, &record + 1, sizeof(sub_data));
+      // Recorded with the publish time, not the time of the copy
+      EXPECT_EQ(record.timestamp, publish_times[expected_val]);
+      EXPECT_EQ(sub_data.val, expected_val++);
+      used += sizeof(LogRecordHeader) +
+              LogAlignUp(record.size, kLogRecordAlignment);
+    }
+    ASSERT_EQ(used, block_header.used);
+  }
+  EXPECT_EQ(expected_val, num_messages + 1);
+  EXPECT_GE(index_blocks, 1);  // Written when stopping
+
+  remove(path.c_str());
+}
+
+// Record num_messages + 1 messages of the topic, 1ms apart
+static void RecordTopic(const struct orb_metadata *meta,
+                        const std::string &path, int num_messages) {
+  orb_test_medium_s pub_data{};
+  auto pub = orb_create_publication(meta);
+  ASSERT_NE(pub, nullptr);
+  ASSERT_TRUE(orb_publish(pub, &pub_data));
+
+  RecorderConfig config;
+  config.topics = orb_get_topics(&config.topic_count);
+  config.topic_names = {meta->o_name};
+  config.block_size = 4096;
+
+  Recorder recorder(config);
+  ASSERT_TRUE(recorder.Start(path)) << "errno: " << errno;
+
+  usleep(10 * 1000);
+  for (int i = 1; i <= num_messages; ++i) {
+    pub_data.timestamp = orb_absolute_time_us();
+    pub_data.val = i;
+    orb_publish(pub, &pub_data);
+    usleep(1000);
+  }
+  recorder.Stop();
+  orb_destroy_publication(&pub);
+  ASSERT_EQ(recorder.status().records, num_messages + 1);
+}
+
+TEST(LogReaderTest, read_records) {
+  const auto path = TempLogPath("reader", ".log");
+  const int num_messages = 600;  // Spans several blocks
+  RecordTopic(ORB_ID(orb_test_medium_replay), path, num_messages);
+
+  LogReader reader;
+  ASSERT_TRUE(reader.Open(path)) << "errno: " << errno;
+  ASSERT_EQ(reader.topics().size(), 1);
+  EXPECT_EQ(reader.topics()[0].name, "orb_test_medium_replay");
+  EXPECT_EQ(reader.topics()[0].size, sizeof(orb_test_medium_s));
+  EXPECT_GT(reader.block_count(), 1);
+
+  auto cursor = reader.Begin();
+  LogRecord record{};
+  int expected_val = 0;
+  uint64_t last_timestamp = 0;
+  while (reader.Next(&cursor, &record)) {
+    ASSERT_EQ(record.topic, 0);
+    ASSERT_EQ(record.size, sizeof(orb_test_medium_s));
+    EXPECT_GE(record.timestamp, last_timestamp);
+    last_timestamp = record.timestamp;
+
+    orb_test_medium_s data{};
+    memcpy(&data, record.data, sizeof(data));
+    EXPECT_EQ(data.val, expected_val++);
+  }
+  EXPECT_EQ(expected_val, num_messages + 1);
+
+  remove(path.c_str());
+  EXPECT_FALSE(reader.Open(path));
+}
+
+TEST(LogReaderTest, seek) {
+  const int num_messages = 400;
+
+  // With index blocks, and without (the reader indexes the data blocks)
+  for (uint32_t index_interval : {2, 0}) {
+    const auto path = TempLogPath("seek", ".log");
+
+    orb_test_medium_s pub_data{};
+    auto pub_a = orb_create_publication(ORB_ID(orb_test_medium_replay));
+    auto pub_b = orb_create_publication(ORB_ID(orb_test_medium_index));
+    ASSERT_NE(pub_a, nullptr);
+    ASSERT_NE(pub_b, nullptr);
+    ASSERT_TRUE(orb_publish(pub_a, &pub_data));
+    ASSERT_TRUE(orb_publish(pub_b, &pub_data));
+
+    RecorderConfig config;
+    config.topics = orb_get_topics(&config.topic_count);
+    config.topic_names = {"orb_test_medium_replay", "orb_test_medium_index"};
+    config.block_size = 4096;
+    config.block_count = 8;
+    config.index_interval = index_interval;
+
+    Recorder recorder(config);
+    ASSERT_TRUE(recorder.Start(path)) << "errno: " << errno;
+    usleep(10 * 1000);
+    for (int i = 1; i < num_messages; ++i) {
+      pub_data.val = i;
+      orb_publish(pub_a, &pub_data);
+      // Topic b is published 10 times less often
+      if (i % 10 == 0) orb_publish(pub_b, &pub_data);
+      usleep(500);
+    }
+    recorder.Stop();
+    orb_destroy_publication(&pub_a);
+    orb_destroy_publication(&pub_b);
+    ASSERT_EQ(recorder.status().dropped, 0);
+
+    LogReader reader;
+    ASSERT_TRUE(reader.Open(path)) << "errno: " << errno;
+    const int topic_b = reader.FindTopic("orb_test_medium_index");
+    ASSERT_GE(topic_b, 0);
+    EXPECT_EQ(reader.FindTopic("no_such_topic"), -1);
+
+    std::vector<LogRecord> records;
+    auto cursor = reader.Begin();
+    LogRecord record{};
+    while (reader.Next(&cursor, &record)) records.push_back(record);
+    ASSERT_EQ(records.size(), num_messages + num_messages / 10);
+    EXPECT_EQ(reader.first_timestamp(), records.front().timestamp);
+
+    // Iterate only topic b
+    int expected_val = 0;
+    cursor = reader.Begin();
+    while (reader.Next(topic_b, &cursor, &record)) {
+      ASSERT_EQ(record.topic, topic_b);
+      orb_test_medium_s data{};
+      memcpy(&data, record.data, sizeof(data));
+      EXPECT_EQ(data.val, expected_val);
+      expected_val += 10;
+    }
+    EXPECT_EQ(expected_val, num_messages);
+
+    for (size_t i = 0; i < records.size(); i += 37) {
+      const auto timestamp = records[i].timestamp;
+      auto first = std::find_if(
+          records.begin(), records.end(),
+          [&](const LogRecord &r) { return r.timestamp >= timestamp; });
+
+      cursor = reader.Seek(timestamp);
+      ASSERT_TRUE(reader.Next(&cursor, &record));
+      EXPECT_EQ(record.data, first->data);
+
+      auto first_b = std::find_if(
+          records.begin(), records.end(), [&](const LogRecord &r) {
+            return r.topic == topic_b && r.timestamp >= timestamp;
+          });
+      cursor = reader.Seek(topic_b, timestamp);
+      if (first_b == records.end()) {
+        EXPECT_FALSE(reader.Next(topic_b, &cursor, &record));
+      } else {
+        ASSERT_TRUE(reader.Next(topic_b, &cursor, &record));
+        EXPECT_EQ(record.data, first_b->data);
+      }
+    }
+
+    cursor = reader.Seek(records.back().timestamp + 1);
+    EXPECT_FALSE(reader.Next(&cursor, &record));
+
+    remove(path.c_str());
+  }
+}
+
+TEST(ReplayerTest, as_fast_as_possible) {
+  const auto path = TempLogPath("replay", ".log");
+  const int num_messages = 100;
+  RecordTopic(ORB_ID(orb_test_medium_replay), path, num_messages);
+
+  auto sub = orb_create_subscription(ORB_ID(orb_test_medium_replay));
+  ASSERT_NE(sub, nullptr);
+  orb_test_medium_s sub_data{};
+  orb_copy(sub, &sub_data);  // Skip the last recorded message
+
+  ReplayConfig config;
+  config.topics = orb_get_topics(&config.topic_count);
+  config.mode = ReplayMode::kAsFastAsPossible;
+  config.backlog_timeout_ms = 0;
+
+  Replayer replayer(config);
+  ASSERT_TRUE(replayer.Open(path)) << "errno: " << errno;
+  std::thread replay_thread([&replayer] { replayer.Run(); });
+
+  // A slow subscriber must still receive every message
+  int expected_val = 0;
+  orb_pollfd_t fds[1]{};
+  fds[0].fd = sub;
+  fds[0].events = POLLIN;
+  while (expected_val <= num_messages && orb_poll(fds, 1, 1000) > 0) {
+    while (orb_check_update(sub)) {
+      orb_copy(sub, &sub_data);
+      EXPECT_EQ(sub_data.val, expected_val++);
+      usleep(100);
+    }
+  }
+  replay_thread.join();
+  orb_destroy_subscription(&sub);
+
+  EXPECT_EQ(expected_val, num_messages + 1);
+  auto status = replayer.status();
+  EXPECT_EQ(status.published, num_messages + 1);
+  EXPECT_EQ(status.skipped, 0);
+  EXPECT_EQ(status.overruns, 0);
+
+  remove(path.c_str());
+}
+
+TEST(ReplayerTest, stalled_subscriber) {
+  const auto path = TempLogPath("replay_stall", ".log");
+  const int num_messages = 20;
+  RecordTopic(ORB_ID(orb_test_medium_replay), path, num_messages);
+
+  auto sub = orb_create_subscription(ORB_ID(orb_test_medium_replay));
+  ASSERT_NE(sub, nullptr);
+  orb_test_medium_s sub_data{};
+  orb_copy(sub, &sub_data);  // Skip the last recorded message
+
+  // The default configuration
+  ReplayConfig config;
+  config.topics = orb_get_topics(&config.topic_count);
+  config.mode = ReplayMode::kAsFastAsPossible;
+
+  Replayer replayer(config);
+  ASSERT_TRUE(replayer.Open(path)) << "errno: " << errno;
+  std::thread replay_thread([&replayer] { replayer.Run(); });
+
+  // Longer than any reasonable timeout, the replayer must keep waiting
+  usleep(1500 * 1000);
+  int expected_val = 0;
+  orb_pollfd_t fds[1]{};
+  fds[0].fd = sub;
+  fds[0].events = POLLIN;
+  while (expected_val <= num_messages && orb_poll(fds, 1, 1000) > 0) {
+    while (orb_check_update(sub)) {
+      orb_copy(sub, &sub_data);
+      EXPECT_EQ(sub_data.val, expected_val++);
+    }
+  }
+  replay_thread.join();
+
+  orb_subscription_status sub_status{};
+  ASSERT_TRUE(orb_get_subscription_status(sub, &sub_status));
+  orb_destroy_subscription(&sub);
+
+  EXPECT_EQ(expected_val, num_messages + 1);
+  EXPECT_EQ(sub_status.lost_count, 0);
+  EXPECT_EQ(replayer.status().overruns, 0);
+
+  remove(path.c_str());
+}
+
+TEST(ReplayerTest, scaled) {
+  const auto path = TempLogPath("replay_rt", ".log");
+  const int num_messages = 50;
+  RecordTopic(ORB_ID(orb_test_medium_replay), path, num_messages);
+
+  ReplayConfig config;
+  config.topics = orb_get_topics(&config.topic_count);
+  config.mode = ReplayMode::kScaled;
+  config.speed = 2;
+
+  Replayer replayer(config);
+  ASSERT_TRUE(replayer.Open(path)) << "errno: " << errno;
+
+  LogReader::Cursor cursor = replayer.reader().Begin();
+  LogRecord first{}, last{};
+  ASSERT_TRUE(replayer.reader().Next(&cursor, &first));
+  last = first;
+  while (replayer.reader().Next(&cursor, &last)) {
+  }
+
+  auto start_time = orb_absolute_time_us();
+  ASSERT_TRUE(replayer.Run());
+  auto elapsed = orb_elapsed_time_us(start_time);
+
+  auto expected = (last.timestamp - first.timestamp) / config.speed;
+  EXPECT_GE(elapsed, expected);
+  EXPECT_EQ(replayer.status().published, num_messages + 1);
+
+  remove(path.c_str());
+}
+
+TEST(ReplayerTest, out_of_order_topics) {
+  const auto path = TempLogPath("replay_order", ".log");
+
+  // The topics are drained in the order of orb_get_topics(), topic a is
+  // published first but drained after topic b
+  orb_test_medium_s pub_data{};
+  auto pub_a = orb_create_publication(ORB_ID(orb_test_medium_replay));
+  auto pub_b = orb_create_publication(ORB_ID(orb_test_medium_index));
+  ASSERT_NE(pub_a, nullptr);
+  ASSERT_NE(pub_b, nullptr);
+  pub_data.val = 1;
+  ASSERT_TRUE(orb_publish(pub_a, &pub_data));
+  usleep(20 * 1000);
+  pub_data.val = 2;
+  ASSERT_TRUE(orb_publish(pub_b, &pub_data));
+
+  RecorderConfig recorder_config;
+  recorder_config.topics = orb_get_topics(&recorder_config.topic_count);
+  recorder_config.topic_names = {"orb_test_medium_replay",
+                                 "orb_test_medium_index"};
+  recorder_config.block_size = 4096;
+
+  Recorder recorder(recorder_config);
+  ASSERT_TRUE(recorder.Start(path)) << "errno: " << errno;
+  usleep(10 * 1000);
+  recorder.Stop();
+  orb_destroy_publication(&pub_a);
+  orb_destroy_publication(&pub_b);
+  ASSERT_EQ(recorder.status().records, 2);
+
+  ReplayConfig config;
+  config.topics = orb_get_topics(&config.topic_count);
+  config.mode = ReplayMode::kScaled;
+  config.speed = 2;
+
+  Replayer replayer(config);
+  ASSERT_TRUE(replayer.Open(path)) << "errno: " << errno;
+
+  std::vector<int> vals;
+  std::vector<uint64_t> timestamps;
+  auto cursor = replayer.reader().Begin();
+  LogRecord record{};
+  while (replayer.reader().Next(&cursor, &record)) {
+    orb_test_medium_s data{};
+    memcpy(&data, record.data, sizeof(data));
+    vals.push_back(data.val);
+    timestamps.push_back(record.timestamp);
+  }
+  ASSERT_EQ(vals, std::vector<int>({1, 2}));
+  EXPECT_EQ(replayer.reader().first_timestamp(), timestamps[0]);
+
+  // Seeking the first record must not skip the one recorded before it
+  cursor = replayer.reader().Seek(timestamps[0]);
+  ASSERT_TRUE(replayer.reader().Next(&cursor, &record));
+  EXPECT_EQ(record.timestamp, timestamps[0]);
+
+  // The records are 20ms apart, replayed at twice the speed
+  auto start_time = orb_absolute_time_us();
+  ASSERT_TRUE(replayer.Run());
+  auto elapsed = orb_elapsed_time_us(start_time);
+  EXPECT_GE(elapsed, 10 * 1000);
+  EXPECT_LT(elapsed, 1000 * 1000);
+  EXPECT_EQ(replayer.status().published, 2);
+
+  remove(path.c_str());
+}
+
+TEST(RecorderTest, unknown_topic) {
+  RecorderConfig config;
+  config.topics = orb_get_topics(&config.topic_count);
+  config.topic_names = {"no_such_topic"};
+
+  Recorder recorder(config);
+  EXPECT_FALSE(recorder.Start(TempLogPath("unknown", ".log")));
+  EXPECT_EQ(errno, ENOENT);
+}
+
+TEST(ULogWriterTest, write_topic) {
+  const auto path = TempLogPath("ulog", ".ulg");
+  const int num_messages = 32;
+
+  orb_test_medium_s pub_data{};
+  auto pub = orb_create_publication(ORB_ID(orb_test_medium_ulog));
+  ASSERT_NE(pub, nullptr);
+  ASSERT_TRUE(orb_publish(pub, &pub_data));
+
+  ULogWriterConfig config;
+  config.topics = orb_get_topics(&config.topic_count);
+  config.topic_names = {"orb_test_medium_ulog"};
+
+  ULogWriter writer(config);
+  ASSERT_TRUE(writer.Start(path)) << "errno: " << errno;
+
+  usleep(10 * 1000);
+  for (int i = 1; i <= num_messages; ++i) {
+    pub_data.val = i;
+    orb_publish(pub, &pub_data);
+    usleep(1000);
+  }
+  writer.Stop();
+  orb_destroy_publication(&pub);
+
+  auto status = writer.status();
+  EXPECT_EQ(status.messages, num_messages + 1);
+  EXPECT_EQ(status.dropped, 0);
+
+  auto file = ReadFile(path);
+  ASSERT_EQ(file.size(), status.bytes);
+  ASSERT_GE(file.size(), 16);
+  const uint8_t magic[] = {'U', 'L', 'o', 'g', 0x01, 0x12, 0x35};
+  ASSERT_EQ(memcmp(file.data(), magic, sizeof(magic)), 0);
+
+  std::vector<char> message_types;
+  std::string format;
+  int expected_val = 0;
+  for (size_t offset = 16; offset + 3 <= file.size();) {
+    uint16_t size;
+    memcpy(&size, &file[offset], sizeof(size));
+    char type = file[offset + 2];
+    auto payload = &file[offset + 3];
+    ASSERT_LE(offset + 3 + size, file.size());
+    message_types.push_back(type);
+
+    if (type == 'F') format.assign(payload, payload + size);
+    if (type == 'D') {
+      // msg_id + message without the padding at the end
+      ASSERT_EQ(size, 2 + ORB_ID(orb_test_medium_ulog)->o_size_no_padding);
+      orb_test_medium_s sub_data{};
+      memcpy(&sub_data, payload + 2, size - 2);
+      EXPECT_EQ(sub_data.val, expected_val++);
+    }
+    offset += 3 + size;
+  }
+
+  ASSERT_FALSE(message_types.empty());
+  EXPECT_EQ(message_types.front(), 'B');
+  EXPECT_EQ(std::count(message_types.begin(), message_types.end(), 'A'), 1);
+  EXPECT_EQ(format,
+            "orb_test_medium_ulog:uint64_t timestamp;int32_t val;"
+            "uint8_t[64] junk;");
+  EXPECT_EQ(expected_val, num_messages + 1);
+
+  remove(path.c_str());
+}
@@ -0,0 +1,100 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include <gtest/gtest.h>
+#include <uorb/publication.h>
+#include <uorb/subscription.h>
+#include <uorb/topics/orb_test_medium.h>
+#include <uorb/topics/orb_test_status.h>
+
+#include <cstring>
+
+static orb_status TopicStatus(const orb_metadata &meta) {
+  orb_status status{};
+  EXPECT_TRUE(orb_get_topic_status(&meta, 0, &status));
+  return status;
+}
+
+TEST(PublishIfChangedTest, if_changed) {
+  uorb::PublicationData<uorb::msg::orb_test_medium_if_changed> pub;
+  uorb::Subscription<uorb::msg::orb_test_medium_if_changed> sub;
+  orb_test_medium_s data{};
+
+  // The first message is always published
+  ASSERT_TRUE(pub.PublishIfChanged());
+  ASSERT_TRUE(sub.Update(&data));
+
+  // Equal to the latest message
+  ASSERT_TRUE(pub.PublishIfChanged());
+  EXPECT_FALSE(orb_check_update(sub.handle()));
+
+  pub.get().val = 1;
+  ASSERT_TRUE(pub.PublishIfChanged());
+  ASSERT_TRUE(sub.Update(&data));
+  EXPECT_EQ(data.val, 1);
+
+  pub.get().junk[63] = 1;
+  ASSERT_TRUE(pub.PublishIfChanged());
+  ASSERT_TRUE(sub.Update(&data));
+  EXPECT_EQ(data.junk[63], 1);
+
+  // orb_publish() publishes all messages of this topic
+  ASSERT_TRUE(pub.Publish());
+  ASSERT_TRUE(sub.Update(&data));
+
+  const auto status = TopicStatus(uorb::msg::orb_test_medium_if_changed);
+  EXPECT_EQ(status.publish_count, 4);
+  EXPECT_EQ(status.suppressed_count, 1);
+}
+
+TEST(PublishIfChangedTest, suppress_duplicates) {
+  const auto &meta = uorb::msg::orb_test_status;
+  ASSERT_TRUE(meta.o_flags & ORB_FLAG_SUPPRESS_DUPLICATES);
+  ASSERT_LT(meta.o_size_no_padding, meta.o_size);
+
+  auto handle = orb_create_publication(&meta);
+  ASSERT_NE(handle, nullptr);
+  uorb::Subscription<uorb::msg::orb_test_status> sub;
+  ASSERT_TRUE(sub.Subscribed());
+
+  orb_test_status_s data{};
+  data.val = 1;
+  ASSERT_TRUE(orb_publish(handle, &data));
+  ASSERT_TRUE(sub.Update(&data));
+
+  // The padding at the end is not compared
+  for (int i = 0; i < 3; ++i) {
+    data._padding0[0] = i;
+    ASSERT_TRUE(orb_publish(handle, &data));
+  }
+  ASSERT_TRUE(orb_publish_if_changed(handle, &data));
+  EXPECT_FALSE(orb_check_update(sub.handle()));
+
+  data.flags[2] = 1;
+  ASSERT_TRUE(orb_publish(handle, &data));
+  ASSERT_TRUE(sub.Update(&data));
+  EXPECT_EQ(data.flags[2], 1);
+
+  // A new timestamp is a change
+  data.timestamp = 1;
+  ASSERT_TRUE(orb_publish(handle, &data));
+  ASSERT_TRUE(sub.Update(&data));
+
+  const auto status = TopicStatus(meta);
+  EXPECT_EQ(status.publish_count, 3);
+  EXPECT_EQ(status.suppressed_count, 4);
+
+  ASSERT_TRUE(orb_destroy_publication(&handle));
+}
+
+TEST(PublishIfChangedTest, errors) {
+  orb_test_medium_s data{};
+  EXPECT_FALSE(orb_publish_if_changed(nullptr, &data));
+  EXPECT_EQ(errno, EINVAL);
+
+  auto handle = orb_create_publication(&uorb::msg::orb_test_medium_if_changed);
+  ASSERT_NE(handle, nullptr);
+  EXPECT_FALSE(orb_publish_if_changed(handle, nullptr));
+  EXPECT_EQ(errno, EINVAL);
+  ASSERT_TRUE(orb_destroy_publication(&handle));
+}
@@ -0,0 +1,137 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include <gtest/gtest.h>
+#include <uorb/publication.h>
+#include <uorb/subscription.h>
+#include <uorb/topics/orb_test.h>
+
+static unsigned TopicQueueSize(const orb_metadata &meta) {
+  orb_status status{};
+  EXPECT_TRUE(orb_get_topic_status(&meta, 0, &status));
+  return status.queue_size;
+}
+
+TEST(QueueSizeTest, per_subscriber_depth) {
+  const auto &meta = uorb::msg::orb_test_queue_depth;
+  ASSERT_EQ(meta.o_queue_size, 1);
+  uorb::PublicationData<uorb::msg::orb_test_queue_depth> pub;
+  uorb::Subscription<uorb::msg::orb_test_queue_depth> deep, latest;
+  ASSERT_TRUE(deep.SetQueueSize(6));
+  ASSERT_TRUE(latest.Subscribed());
+  EXPECT_EQ(TopicQueueSize(meta), 6);
+
+  for (int i = 0; i < 10; ++i) {
+    pub.get().val = i;
+    ASSERT_TRUE(pub.Publish());
+  }
+
+  orb_subscription_status status{};
+  ASSERT_TRUE(orb_get_subscription_status(deep.handle(), &status));
+  EXPECT_EQ(status.unread, 6);
+
+  orb_test_s data{};
+  orb_copy_info info{};
+  ASSERT_TRUE(deep.Update(&data, &info));
+  EXPECT_EQ(data.val, 4);
+  EXPECT_EQ(info.lost, 4);
+  for (int i = 5; i < 10; ++i) {
+    ASSERT_TRUE(deep.Update(&data, &info));
+    EXPECT_EQ(data.val, i);
+    EXPECT_EQ(info.lost, 0);
+  }
+  EXPECT_FALSE(deep.Update(&data));
+
+  // The other subscribers keep the queue size of the topic
+  ASSERT_TRUE(latest.Update(&data, &info));
+  EXPECT_EQ(data.val, 9);
+  EXPECT_EQ(info.lost, 9);
+  EXPECT_FALSE(latest.Update(&data));
+
+  EXPECT_FALSE(deep.SetQueueSize(ORB_QUEUE_SIZE_MAX + 1));
+  EXPECT_EQ(errno, EINVAL);
+}
+
+TEST(QueueSizeTest, grow_keeps_messages) {
+  uorb::PublicationData<uorb::msg::orb_test_queue_depth_keep> pub;
+  pub.get().val = 1;
+  ASSERT_TRUE(pub.Publish());
+
+  uorb::Subscription<uorb::msg::orb_test_queue_depth_keep> sub;
+  ASSERT_TRUE(sub.SetQueueSize(4));
+  for (int i = 2; i <= 4; ++i) {
+    pub.get().val = i;
+    ASSERT_TRUE(pub.Publish());
+  }
+
+  orb_test_s data{};
+  orb_copy_info info{};
+  for (int i = 1; i <= 4; ++i) {
+    ASSERT_TRUE(sub.Update(&data, &info));
+    EXPECT_EQ(data.val, i);
+    EXPECT_EQ(info.lost, 0);
+  }
+}
+
+TEST(QueueSizeTest, shrink) {
+  const auto &meta = uorb::msg::orb_test_queue_depth_shrink;
+  uorb::PublicationData<uorb::msg::orb_test_queue_depth_shrink> pub;
+  uorb::Subscription<uorb::msg::orb_test_queue_depth_shrink> sub;
+  ASSERT_TRUE(sub.SetQueueSize(2));
+
+  {
+    uorb::Subscription<uorb::msg::orb_test_queue_depth_shrink> logger;
+    ASSERT_TRUE(logger.SetQueueSize(64));
+    EXPECT_EQ(TopicQueueSize(meta), 64);
+    for (int i = 0; i < 100; ++i) {
+      pub.get().val = i;
+      ASSERT_TRUE(pub.Publish());
+    }
+  }
+  EXPECT_EQ(TopicQueueSize(meta), 2);
+
+  // The newest messages are kept
+  orb_test_s data{};
+  ASSERT_TRUE(sub.Update(&data));
+  EXPECT_EQ(data.val, 98);
+  ASSERT_TRUE(sub.Update(&data));
+  EXPECT_EQ(data.val, 99);
+
+  orb_copy_info infos[4];
+  EXPECT_EQ(orb_copy_range(sub.handle(), 0, UINT64_MAX, nullptr, 4, infos), 2);
+
+  ASSERT_TRUE(sub.SetQueueSize(0));
+  EXPECT_EQ(TopicQueueSize(meta), 1);
+  ASSERT_TRUE(sub.Copy(&data));
+  EXPECT_EQ(data.val, 99);
+}
+
+TEST(QueueSizeTest, exact_size) {
+  const auto &meta = uorb::msg::orb_test_queue_depth_exact;
+  uorb::PublicationData<uorb::msg::orb_test_queue_depth_exact> pub;
+  uorb::Subscription<uorb::msg::orb_test_queue_depth_exact> sub;
+  ASSERT_TRUE(sub.SetQueueSize(33));
+
+  orb_status status{};
+  ASSERT_TRUE(orb_get_topic_status(&meta, 0, &status));
+  EXPECT_EQ(status.queue_size, 33);
+  EXPECT_EQ(status.queue_bytes, 0);  // Allocated by the first message
+
+  for (int i = 0; i < 100; ++i) {
+    pub.get().val = i;
+    ASSERT_TRUE(pub.Publish());
+  }
+  ASSERT_TRUE(orb_get_topic_status(&meta, 0, &status));
+  EXPECT_EQ(status.queue_bytes, 33 * (sizeof(orb_test_s) + sizeof(uint64_t)));
+
+  orb_test_s data{};
+  orb_copy_info info{};
+  ASSERT_TRUE(sub.Update(&data, &info));
+  EXPECT_EQ(data.val, 67);
+  EXPECT_EQ(info.lost, 67);
+  for (int i = 68; i < 100; ++i) {
+    ASSERT_TRUE(sub.Update(&data));
+    EXPECT_EQ(data.val, i);
+  }
+  EXPECT_FALSE(sub.Update(&data));
+}
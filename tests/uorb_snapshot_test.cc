@@ -0,0 +1,99 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include <gtest/gtest.h>
+#include <uorb/publication.h>
+#include <uorb/subscription.h>
+#include <uorb/topics/orb_test_medium.h>
+
+#include <atomic>
+#include <thread>
+
+TEST(SnapshotTest, latest_messages) {
+  uorb::PublicationData<uorb::msg::orb_test_medium_snapshot_a> pub_a;
+  uorb::PublicationData<uorb::msg::orb_test_medium_snapshot_b> pub_b;
+  uorb::Subscription<uorb::msg::orb_test_medium_snapshot_a> sub_a;
+  uorb::Subscription<uorb::msg::orb_test_medium_snapshot_b> sub_b;
+  ASSERT_TRUE(sub_a.Subscribed() && sub_b.Subscribed());
+  orb_test_medium_s data_a{}, data_b{};
+  sub_a.Update(&data_a);
+  sub_b.Update(&data_b);
+
+  for (int i = 1; i <= 3; ++i) {
+    pub_a.get().val = i;
+    ASSERT_TRUE(pub_a.Publish());
+  }
+  pub_b.get().val = 10;
+  ASSERT_TRUE(pub_b.Publish());
+
+  orb_subscription_t *handles[] = {sub_a.handle(), sub_b.handle()};
+  void *buffers[] = {&data_a, &data_b};
+  orb_copy_info infos[2]{};
+  ASSERT_TRUE(orb_snapshot(handles, 2, buffers, infos));
+  EXPECT_EQ(data_a.val, 3);
+  EXPECT_EQ(data_b.val, 10);
+  EXPECT_NE(infos[0].timestamp, 0);
+  EXPECT_LE(infos[0].timestamp, infos[1].timestamp);
+  ASSERT_TRUE(orb_snapshot(handles, 2, buffers, nullptr));
+
+  // The unread messages stay unread
+  EXPECT_TRUE(sub_a.Update(&data_a));
+  EXPECT_EQ(data_a.val, 1);
+}
+
+TEST(SnapshotTest, errors) {
+  uorb::Subscription<uorb::msg::orb_test_medium_snapshot_a> sub_a;
+  uorb::Subscription<uorb::msg::orb_test_medium_snapshot_empty> sub_empty;
+  ASSERT_TRUE(sub_a.Subscribed() && sub_empty.Subscribed());
+  orb_test_medium_s data_a{}, data_empty{};
+
+  orb_subscription_t *handles[] = {sub_a.handle(), sub_empty.handle()};
+  void *buffers[] = {&data_a, &data_empty};
+  EXPECT_FALSE(orb_snapshot(handles, 2, buffers, nullptr));
+  EXPECT_EQ(errno, ENODATA);
+
+  EXPECT_FALSE(orb_snapshot(handles, 0, buffers, nullptr));
+  EXPECT_EQ(errno, EINVAL);
+  void *null_buffers[] = {&data_a, nullptr};
+  EXPECT_FALSE(orb_snapshot(handles, 2, null_buffers, nullptr));
+  EXPECT_EQ(errno, EINVAL);
+}
+
+// The publisher publishes val k to a, then to b: a consistent snapshot has
+// a.val == b.val or a.val == b.val + 1
+TEST(SnapshotTest, consistent_while_publishing) {
+  std::atomic<bool> stop{false};
+  std::thread publisher([&]() {
+    uorb::PublicationData<uorb::msg::orb_test_medium_snapshot_a> pub_a;
+    uorb::PublicationData<uorb::msg::orb_test_medium_snapshot_b> pub_b;
+    for (int k = 1000; !stop; ++k) {
+      pub_a.get().val = k;
+      pub_a.Publish();
+      pub_b.get().val = k;
+      pub_b.Publish();
+    }
+  });
+
+  uorb::Subscription<uorb::msg::orb_test_medium_snapshot_a> sub_a;
+  uorb::Subscription<uorb::msg::orb_test_medium_snapshot_b> sub_b;
+  ASSERT_TRUE(sub_a.Subscribed() && sub_b.Subscribed());
+  orb_subscription_t *handles[] = {sub_a.handle(), sub_b.handle()};
+  orb_test_medium_s data_a{}, data_b{};
+  void *buffers[] = {&data_a, &data_b};
+
+  int snapshots = 0;
+  for (int i = 0; i < 300000; ++i) {
+    if (!orb_snapshot(handles, 2, buffers, nullptr)) {
+      EXPECT_EQ(errno, EAGAIN);
+      continue;
+    }
+    ++snapshots;
+    // Messages of the previous tests
+    if (data_a.val < 1000 || data_b.val < 1000) continue;
+    ASSERT_GE(data_a.val, data_b.val);
+    ASSERT_LE(data_a.val, data_b.val + 1);
+  }
+  stop = true;
+  publisher.join();
+  EXPECT_GT(snapshots, 0);
+}
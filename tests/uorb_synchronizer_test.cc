@@ -0,0 +1,173 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <uorb/abs_time.h>
+#include <uorb/publication.h>
+#include <uorb/synchronizer.h>
+#include <uorb/topics/orb_test_medium.h>
+
+#include <utility>
+#include <vector>
+
+using uorb::msg::orb_test_medium_sync_a;
+using uorb::msg::orb_test_medium_sync_b;
+using uorb::msg::orb_test_medium_sync_c;
+using uorb::msg::orb_test_medium_sync_exact_a;
+using uorb::msg::orb_test_medium_sync_exact_b;
+using uorb::msg::orb_test_medium_sync_monotonic_a;
+using uorb::msg::orb_test_medium_sync_monotonic_b;
+using uorb::msg::orb_test_medium_sync_none_a;
+using uorb::msg::orb_test_medium_sync_none_b;
+using uorb::msg::orb_test_medium_sync_wait_a;
+using uorb::msg::orb_test_medium_sync_wait_b;
+
+// Publish times are set with the lockstep clock. Every test uses its own
+// topics: the simulated time starts again at the system time.
+class SynchronizerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(orb_set_clock_source(ORB_CLOCK_LOCKSTEP));
+    start_ = orb_absolute_time_us();
+  }
+  void TearDown() override {
+    EXPECT_TRUE(orb_set_clock_source(ORB_CLOCK_MONOTONIC));
+  }
+
+  // Publish val at start_ + time_us, in the order of the calls
+  template <const orb_metadata &meta>
+  void PublishAt(uorb::PublicationData<meta> *pub, uint64_t time_us,
+                 int val) {
+    if (orb_absolute_time_us() < start_ + time_us) {
+      ASSERT_TRUE(orb_set_lockstep_time(start_ + time_us));
+    }
+    pub->get().val = val;
+    ASSERT_TRUE(pub->Publish());
+  }
+
+  uint64_t start_{0};
+};
+
+TEST_F(SynchronizerTest, exact_time) {
+  uorb::Synchronizer<orb_test_medium_sync_exact_a,
+                     orb_test_medium_sync_exact_b>
+      sync;
+  uorb::PublicationData<orb_test_medium_sync_exact_a> pub_a;
+  uorb::PublicationData<orb_test_medium_sync_exact_b> pub_b;
+  decltype(sync)::Tuple data;
+
+  PublishAt(&pub_b, 500, 0);  // Never matched
+  for (int i = 1; i <= 3; ++i) {
+    PublishAt(&pub_a, i * 1000, i);
+    PublishAt(&pub_b, i * 1000, 10 * i);
+  }
+  PublishAt(&pub_b, 4000, 40);  // Settles the last match
+
+  uint64_t time_us = 0;
+  for (int i = 1; i <= 3; ++i) {
+    ASSERT_TRUE(sync.Update(&data, &time_us));
+    EXPECT_EQ(std::get<0>(data).val, i);
+    EXPECT_EQ(std::get<1>(data).val, 10 * i);
+    EXPECT_EQ(time_us, start_ + i * 1000);
+  }
+  EXPECT_FALSE(sync.Update(&data));
+  EXPECT_EQ(sync.dropped_count(), 0);
+}
+
+TEST_F(SynchronizerTest, approximate_time) {
+  uorb::Synchronizer<orb_test_medium_sync_a, orb_test_medium_sync_b,
+                     orb_test_medium_sync_c>
+      sync(2000);
+  uorb::PublicationData<orb_test_medium_sync_a> pub_a;
+  uorb::PublicationData<orb_test_medium_sync_b> pub_b;
+  uorb::PublicationData<orb_test_medium_sync_c> pub_c;
+  decltype(sync)::Tuple data;
+
+  // a every 10 ms, b every 3 ms, c every 4 ms, val is the time in ms
+  for (int ms = 1; ms <= 34; ++ms) {
+    if (ms % 10 == 0) PublishAt(&pub_a, ms * 1000, ms);
+    if (ms % 3 == 0) PublishAt(&pub_b, ms * 1000, ms);
+    if (ms % 4 == 0) PublishAt(&pub_c, ms * 1000, ms);
+  }
+
+  // The nearest ones, the earlier one if both are as near
+  std::vector<std::vector<int>> matches;
+  while (sync.Update(&data)) {
+    matches.push_back({std::get<0>(data).val, std::get<1>(data).val,
+                       std::get<2>(data).val});
+  }
+  EXPECT_EQ(matches, (std::vector<std::vector<int>>{
+                         {10, 9, 8}, {20, 21, 20}, {30, 30, 28}}));
+  EXPECT_EQ(sync.dropped_count(), 0);
+}
+
+TEST_F(SynchronizerTest, wait_for_other_topics) {
+  uorb::Synchronizer<orb_test_medium_sync_wait_a, orb_test_medium_sync_wait_b>
+      sync(2000);
+  uorb::PublicationData<orb_test_medium_sync_wait_a> pub_a;
+  uorb::PublicationData<orb_test_medium_sync_wait_b> pub_b;
+  decltype(sync)::Tuple data;
+
+  PublishAt(&pub_b, 500, 1);
+  PublishAt(&pub_a, 1000, 1);
+  // A nearer message may follow
+  EXPECT_FALSE(sync.Update(&data));
+
+  PublishAt(&pub_b, 1200, 2);
+  ASSERT_TRUE(sync.Update(&data));
+  EXPECT_EQ(std::get<1>(data).val, 2);
+}
+
+TEST_F(SynchronizerTest, no_match) {
+  uorb::Synchronizer<orb_test_medium_sync_none_a, orb_test_medium_sync_none_b>
+      sync(1000);
+  uorb::PublicationData<orb_test_medium_sync_none_a> pub_a;
+  uorb::PublicationData<orb_test_medium_sync_none_b> pub_b;
+  decltype(sync)::Tuple data;
+
+  PublishAt(&pub_b, 1000, 1);
+  PublishAt(&pub_a, 1500, 1);
+  PublishAt(&pub_a, 2000, 2);
+  PublishAt(&pub_b, 5000, 2);
+
+  // b 1 is matched once, a 2 has nothing left within the tolerance
+  ASSERT_TRUE(sync.Update(&data));
+  EXPECT_EQ(std::get<0>(data).val, 1);
+  EXPECT_EQ(std::get<1>(data).val, 1);
+  EXPECT_FALSE(sync.Update(&data));
+  EXPECT_EQ(sync.dropped_count(), 1);
+}
+
+// Without lockstep, the publish times of the monotonic clock are matched
+TEST(SynchronizerClockTest, monotonic_clock) {
+  uorb::Synchronizer<orb_test_medium_sync_monotonic_a,
+                     orb_test_medium_sync_monotonic_b>
+      sync(50 * 1000);
+  uorb::PublicationData<orb_test_medium_sync_monotonic_a> pub_a;
+  uorb::PublicationData<orb_test_medium_sync_monotonic_b> pub_b;
+  decltype(sync)::Tuple data;
+
+  pub_b.get().val = 1;
+  ASSERT_TRUE(pub_b.Publish());
+  usleep(1000);
+  pub_a.get().val = 1;
+  ASSERT_TRUE(pub_a.Publish());
+  // A nearer message may follow
+  EXPECT_FALSE(sync.Update(&data));
+
+  usleep(100 * 1000);
+  pub_b.get().val = 2;
+  ASSERT_TRUE(pub_b.Publish());
+  uint64_t time_us = 0;
+  ASSERT_TRUE(sync.Update(&data, &time_us));
+  EXPECT_EQ(std::get<0>(data).val, 1);
+  EXPECT_EQ(std::get<1>(data).val, 1);
+  EXPECT_NE(time_us, 0);
+
+  // The messages up to the match are read, not the later ones
+  orb_subscription_status status{};
+  ASSERT_TRUE(orb_get_subscription_status(sync.handle(0), &status));
+  EXPECT_EQ(status.unread, 1);
+  EXPECT_EQ(status.lost_count, 0);
+}
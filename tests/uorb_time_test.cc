@@ -0,0 +1,130 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <uorb/abs_time.h>
+#include <uorb/publication.h>
+#include <uorb/subscription_interval.h>
+#include <uorb/topics/orb_test_medium.h>
+
+#include <atomic>
+#include <thread>
+
+static void TestClockSource(orb_clock_source source,
+                            orb_abstime_us max_error_us) {
+  if (!orb_set_clock_source(source)) {
+    EXPECT_EQ(errno, ENOTSUP);
+    return;
+  }
+  EXPECT_EQ(orb_get_clock_source(), source);
+
+  orb_abstime_us last = 0;
+  for (int i = 0; i < 1000; ++i) {
+    const auto before = orb_monotonic_time_us();
+    const auto now = orb_absolute_time_us();
+    const auto after = orb_monotonic_time_us();
+    EXPECT_LE(now, after + max_error_us);
+    EXPECT_GE(now + max_error_us, before);
+    EXPECT_GE(now, last);
+    last = now;
+  }
+
+  EXPECT_TRUE(orb_set_clock_source(ORB_CLOCK_MONOTONIC));
+}
+
+TEST(ClockSourceTest, monotonic) { TestClockSource(ORB_CLOCK_MONOTONIC, 0); }
+
+TEST(ClockSourceTest, monotonic_coarse) {
+  // Updated every scheduler tick
+  TestClockSource(ORB_CLOCK_MONOTONIC_COARSE, 10 * 1000);
+}
+
+TEST(ClockSourceTest, tsc) { TestClockSource(ORB_CLOCK_TSC, 100); }
+
+TEST(ClockSourceTest, select_while_reading) {
+  // Every reading comes from one whole clock state, even during a
+  // recalibration of the TSC
+  std::atomic<bool> done{false};
+  std::atomic<int> wrong{0};
+  std::thread reader([&] {
+    while (!done) {
+      const auto before = orb_monotonic_time_us();
+      const auto now = orb_absolute_time_us();
+      const auto after = orb_monotonic_time_us();
+      if (now > after + 10 * 1000 || now + 10 * 1000 < before) ++wrong;
+    }
+  });
+
+  for (auto source : {ORB_CLOCK_TSC, ORB_CLOCK_MONOTONIC_COARSE, ORB_CLOCK_TSC,
+                      ORB_CLOCK_TSC, ORB_CLOCK_MONOTONIC}) {
+    orb_set_clock_source(source);
+    usleep(10 * 1000);
+  }
+  done = true;
+  reader.join();
+
+  EXPECT_EQ(wrong, 0);
+  EXPECT_EQ(orb_get_clock_source(), ORB_CLOCK_MONOTONIC);
+}
+
+TEST(ClockSourceTest, invalid) {
+  EXPECT_FALSE(orb_set_clock_source(static_cast<orb_clock_source>(100)));
+  EXPECT_EQ(errno, EINVAL);
+  EXPECT_EQ(orb_get_clock_source(), ORB_CLOCK_MONOTONIC);
+}
+
+TEST(SubscriptionIntervalTest, check_update_ex) {
+  uorb::PublicationData<uorb::msg::orb_test_medium_interval> pub;
+  uorb::SubscriptionData<uorb::msg::orb_test_medium_interval> sub;
+  ASSERT_TRUE(sub.Subscribed());
+  sub.Update();
+
+  uint64_t publish_time = 0;
+  EXPECT_FALSE(orb_check_update_ex(sub.handle(), &publish_time));
+
+  const auto before = orb_monotonic_time_us();
+  ASSERT_TRUE(pub.Publish());
+  const auto after = orb_monotonic_time_us();
+  EXPECT_TRUE(orb_check_update_ex(sub.handle(), &publish_time));
+  EXPECT_GE(publish_time, before);
+  EXPECT_LE(publish_time, after);
+
+  EXPECT_FALSE(orb_check_update_ex(nullptr, &publish_time));
+  EXPECT_EQ(errno, EINVAL);
+}
+
+static void TestInterval(bool use_publish_time) {
+  uorb::PublicationData<uorb::msg::orb_test_medium_interval> pub;
+  uorb::SubscriptionInterval<uorb::msg::orb_test_medium_interval> sub(
+      20 * 1000);
+  sub.set_use_publish_time(use_publish_time);
+  orb_test_medium_s data{};
+
+  ASSERT_TRUE(pub.Publish());
+  usleep(25 * 1000);
+  EXPECT_TRUE(sub.Update(&data));
+
+  // A burst is limited to the interval, up to the message skipped last
+  int copied = 0;
+  bool skipped = false;
+  for (int i = 0; i < 10 && !skipped; ++i) {
+    ASSERT_TRUE(pub.Publish());
+    if (sub.Update(&data)) {
+      ++copied;
+    } else {
+      skipped = true;
+    }
+  }
+  EXPECT_LE(copied, 2);
+  ASSERT_TRUE(skipped);
+
+  // No newer message: the clock lets the skipped one through later, the
+  // publish time does not
+  usleep(25 * 1000);
+  EXPECT_EQ(sub.Update(&data), !use_publish_time);
+}
+
+TEST(SubscriptionIntervalTest, clock) { TestInterval(false); }
+
+TEST(SubscriptionIntervalTest, publish_time) { TestInterval(true); }
@@ -35,11 +35,14 @@
 
 #include <gtest/gtest.h>
 #include <uorb/abs_time.h>
+#include <uorb/subscription.h>
 
 #include <cerrno>
 #include <cstdarg>
 #include <cstdio>
+#include <cstring>
 #include <thread>
+#include <vector>
 
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
@@ -504,6 +507,44 @@ TEST_F(UnitTest, wrap_around) {
   ASSERT_TRUE(orb_destroy_subscription(&sfd));
 }
 
+TEST_F(UnitTest, wrap_around_exact_size) {
+  // 2^32 is not a multiple of the queue size
+  const unsigned queue_size = 5;
+  orb_test_s data{};
+  auto sfd = orb_create_subscription(ORB_ID(orb_test_queue_depth_wrap));
+  ASSERT_NE(sfd, nullptr);
+  ASSERT_TRUE(orb_set_subscription_queue_size(sfd, queue_size));
+  auto ptopic = orb_create_publication(ORB_ID(orb_test_queue_depth_wrap));
+  ASSERT_NE(ptopic, nullptr);
+  ASSERT_TRUE(orb_publish(ptopic, &data));
+
+  auto node = uorb::DeviceMaster::get_instance().GetDeviceNode(
+      *ORB_ID(orb_test_queue_depth_wrap), 0);
+  ASSERT_NE(node, nullptr);
+  set_generation(*node, unsigned(-3));
+  while (orb_check_update(sfd)) orb_copy(sfd, &data);
+
+  // Across the wrap-around, with and without overwriting
+  int val = 0;
+  for (int round = 0; round < 3; ++round) {
+    const int count = round == 1 ? queue_size + 2 : 2;
+    for (int i = 0; i < count; ++i) {
+      data.val = ++val;
+      ASSERT_TRUE(orb_publish(ptopic, &data));
+    }
+    const int first = round == 1 ? val - int(queue_size) + 1 : val - 1;
+    for (int expected = first; expected <= val; ++expected) {
+      ASSERT_TRUE(orb_check_update(sfd));
+      ASSERT_TRUE(orb_copy(sfd, &data));
+      ASSERT_EQ(data.val, expected);
+    }
+    ASSERT_FALSE(orb_check_update(sfd));
+  }
+
+  ASSERT_TRUE(orb_destroy_publication(&ptopic));
+  ASSERT_TRUE(orb_destroy_subscription(&sfd));
+}
+
 TEST_F(UnitTest, queue_poll_notify) {
   orb_test_medium_s t{};
   volatile int num_messages_sent = 0;
@@ -575,4 +616,233 @@ TEST_F(UnitTest, queue_poll_notify) {
       << "number of sent and received messages mismatch";
 }
 
+TEST_F(UnitTest, latency_status) {
+  orb_test_medium_s data{};
+  auto ptopic = orb_create_publication(ORB_ID(orb_test_medium_latency));
+  ASSERT_NE(ptopic, nullptr);
+  auto sfd = orb_create_subscription(ORB_ID(orb_test_medium_latency));
+  ASSERT_NE(sfd, nullptr);
+
+  // One stale message, the others are copied right after publication
+  ASSERT_TRUE(orb_publish(ptopic, &data));
+  usleep(10 * 1000);
+  ASSERT_TRUE(orb_copy(sfd, &data));
+  for (int i = 1; i < 100; ++i) {
+    ASSERT_TRUE(orb_publish(ptopic, &data));
+    ASSERT_TRUE(orb_copy(sfd, &data));
+  }
+
+  orb_status status{};
+  ASSERT_TRUE(
+      orb_get_topic_status(ORB_ID(orb_test_medium_latency), 0, &status));
+  const auto &latency = status.latency;
+#ifdef UORB_LATENCY_STATS
+  EXPECT_EQ(latency.count, 100);
+  EXPECT_GE(latency.max_ns, 10 * 1000 * 1000);
+  EXPECT_LT(latency.p50_ns, 1000 * 1000);
+  EXPECT_LE(latency.p50_ns, latency.p90_ns);
+  EXPECT_LE(latency.p90_ns, latency.p99_ns);
+  EXPECT_LE(latency.p99_ns, latency.p999_ns);
+  EXPECT_LE(latency.p999_ns, latency.max_ns);
+#else
+  EXPECT_EQ(latency.count, 0);
+  EXPECT_EQ(latency.max_ns, 0);
+#endif
+
+  ASSERT_TRUE(orb_destroy_publication(&ptopic));
+  ASSERT_TRUE(orb_destroy_subscription(&sfd));
+}
+
+TEST_F(UnitTest, lock_status) {
+  if (orb_get_lock_status(nullptr, 0) < 0 && errno == ENOTSUP) {
+    GTEST_SKIP() << "uorb is built without UORB_LOCK_STATS";
+  }
+
+  auto ptopic = orb_create_publication(ORB_ID(orb_test_medium_locks));
+  ASSERT_NE(ptopic, nullptr);
+  auto sfd = orb_create_subscription(ORB_ID(orb_test_medium_locks));
+  ASSERT_NE(sfd, nullptr);
+
+  // Publish and copy from threads that exit before the statistics are read
+  const int num_messages = 10000;
+  std::thread publisher([&]() {
+    orb_test_medium_s data{};
+    for (int i = 0; i < num_messages; ++i) orb_publish(ptopic, &data);
+  });
+  std::thread subscriber([&]() {
+    orb_test_medium_s data{};
+    for (int i = 0; i < num_messages; ++i) orb_copy(sfd, &data);
+  });
+  publisher.join();
+  subscriber.join();
+
+  std::vector<orb_lock_status> status(256);
+  const int count = orb_get_lock_status(status.data(), status.size());
+  ASSERT_GT(count, 0);
+  status.resize(count);
+
+  const orb_lock_status *topic = nullptr;
+  bool has_device_master = false;
+  for (const auto &s : status) {
+    if (!strcmp(s.name, ORB_ID(orb_test_medium_locks)->o_name)) topic = &s;
+    if (!strcmp(s.name, "orb_device_master")) has_device_master = true;
+
+    EXPECT_LE(s.contended_count, s.lock_count);
+    EXPECT_LE(s.max_wait_ns, s.wait_ns);
+    EXPECT_LE(s.max_hold_ns, s.hold_ns);
+  }
+  EXPECT_TRUE(has_device_master);
+  ASSERT_NE(topic, nullptr);
+  EXPECT_EQ(topic->instance, 0);
+  EXPECT_GE(topic->lock_count, 2 * num_messages);
+
+  // Most contended first
+  for (size_t i = 1; i < status.size(); ++i) {
+    EXPECT_GE(status[i - 1].wait_ns, status[i].wait_ns);
+  }
+
+  ASSERT_TRUE(orb_destroy_publication(&ptopic));
+  ASSERT_TRUE(orb_destroy_subscription(&sfd));
+}
+
+TEST_F(UnitTest, traffic_counters) {
+  orb_test_medium_s data{};
+  auto ptopic = orb_create_publication(ORB_ID(orb_test_medium_counters));
+  ASSERT_NE(ptopic, nullptr);
+  auto sfd = orb_create_subscription(ORB_ID(orb_test_medium_counters));
+  ASSERT_NE(sfd, nullptr);
+
+  orb_status status{};
+  ASSERT_TRUE(orb_get_topic_status(ORB_ID(orb_test_medium_counters), 0,
+                                   &status));
+  const unsigned queue_size = status.queue_size;
+  const unsigned num_messages = queue_size + 5;
+
+  for (unsigned i = 0; i < num_messages; ++i) {
+    data.val = i;
+    ASSERT_TRUE(orb_publish(ptopic, &data));
+    usleep(1000);
+  }
+
+  orb_subscription_status sub_status{};
+  ASSERT_TRUE(orb_get_subscription_status(sfd, &sub_status));
+  EXPECT_EQ(sub_status.unread, queue_size);
+  EXPECT_EQ(sub_status.copy_count, 0);
+
+  // The oldest 5 messages were overwritten
+  ASSERT_TRUE(orb_copy(sfd, &data));
+  EXPECT_EQ(data.val, 5);
+  while (orb_check_update(sfd)) ASSERT_TRUE(orb_copy(sfd, &data));
+
+  ASSERT_TRUE(orb_get_subscription_status(sfd, &sub_status));
+  EXPECT_EQ(sub_status.copy_count, queue_size);
+  EXPECT_EQ(sub_status.lost_count, 5);
+  EXPECT_EQ(sub_status.unread, 0);
+
+  ASSERT_TRUE(orb_get_topic_status(ORB_ID(orb_test_medium_counters), 0,
+                                   &status));
+  EXPECT_EQ(status.publish_count, num_messages);
+  EXPECT_EQ(status.publish_bytes, num_messages * sizeof(data));
+  EXPECT_EQ(status.copy_count, queue_size);
+  EXPECT_EQ(status.lost_count, 5);
+  // Published every ~1ms
+  EXPECT_GT(status.publish_rate_hz, 100);
+  EXPECT_LE(status.publish_rate_hz, 1000);
+
+  ASSERT_TRUE(orb_destroy_publication(&ptopic));
+  ASSERT_TRUE(orb_destroy_subscription(&sfd));
+}
+
+TEST_F(UnitTest, copy_info) {
+  orb_test_medium_s data{};
+  auto ptopic = orb_create_publication(ORB_ID(orb_test_medium_copy_info));
+  ASSERT_NE(ptopic, nullptr);
+  auto sfd = orb_create_subscription(ORB_ID(orb_test_medium_copy_info));
+  ASSERT_NE(sfd, nullptr);
+
+  orb_status status{};
+  ASSERT_TRUE(orb_get_topic_status(ORB_ID(orb_test_medium_copy_info), 0,
+                                   &status));
+  const unsigned num_messages = status.queue_size + 3;
+
+  std::vector<orb_abstime_us> publish_times;
+  for (unsigned i = 0; i < num_messages; ++i) {
+    data.val = i;
+    publish_times.push_back(orb_absolute_time_us());
+    ASSERT_TRUE(orb_publish(ptopic, &data));
+  }
+  const auto end_time = orb_absolute_time_us();
+
+  // The first 3 messages were overwritten
+  orb_copy_info info{};
+  ASSERT_TRUE(orb_copy_ex(sfd, &data, &info));
+  EXPECT_EQ(data.val, 3);
+  EXPECT_EQ(info.generation, 3);
+  EXPECT_EQ(info.lost, 3);
+  EXPECT_GE(info.timestamp, publish_times[3]);
+  EXPECT_LE(info.timestamp, publish_times[4]);
+
+  ASSERT_TRUE(orb_copy_ex(sfd, &data, &info));
+  EXPECT_EQ(data.val, 4);
+  EXPECT_EQ(info.generation, 4);
+  EXPECT_EQ(info.lost, 0);
+
+  // The C++ interface
+  uorb::Subscription<uorb::msg::orb_test_medium_copy_info> sub;
+  ASSERT_TRUE(sub.Copy(&data, &info));
+  EXPECT_EQ(data.val, num_messages - 1);
+  EXPECT_EQ(info.generation, num_messages - 1);
+  EXPECT_LE(info.timestamp, end_time);
+
+  ASSERT_TRUE(orb_copy_ex(sfd, &data, nullptr));
+  ASSERT_TRUE(orb_destroy_publication(&ptopic));
+  ASSERT_TRUE(orb_destroy_subscription(&sfd));
+}
+
+TEST_F(UnitTest, copy_batch) {
+  orb_test_medium_s data{};
+  auto ptopic = orb_create_publication(ORB_ID(orb_test_medium_copy_batch));
+  ASSERT_NE(ptopic, nullptr);
+  auto sfd = orb_create_subscription(ORB_ID(orb_test_medium_copy_batch));
+  ASSERT_NE(sfd, nullptr);
+
+  const unsigned queue_size = ORB_ID(orb_test_medium_copy_batch)->o_queue_size;
+  const unsigned num_messages = queue_size + 3;
+  for (unsigned i = 0; i < num_messages; ++i) {
+    data.val = i;
+    ASSERT_TRUE(orb_publish(ptopic, &data));
+  }
+
+  // Records with a header, like a logger
+  struct Record {
+    uint64_t header;
+    orb_test_medium_s data;
+  } records[8]{};
+  orb_copy_info infos[8]{};
+  ASSERT_EQ(orb_copy_batch(sfd, &records[0].data, sizeof(Record), 8, infos),
+            8);
+  for (int i = 0; i < 8; ++i) {
+    EXPECT_EQ(records[i].header, 0);
+    EXPECT_EQ(records[i].data.val, i + 3);
+    EXPECT_EQ(infos[i].generation, i + 3);
+    EXPECT_EQ(infos[i].lost, i ? 0 : 3);
+  }
+
+  // All the others over the same buffer
+  ASSERT_EQ(orb_copy_batch(sfd, &data, 0, 100, nullptr), queue_size - 8);
+  EXPECT_EQ(data.val, num_messages - 1);
+  EXPECT_EQ(orb_copy_batch(sfd, &data, 0, 100, nullptr), 0);
+  EXPECT_FALSE(orb_check_update(sfd));
+
+  orb_subscription_status status{};
+  ASSERT_TRUE(orb_get_subscription_status(sfd, &status));
+  EXPECT_EQ(status.copy_count, queue_size);
+  EXPECT_EQ(status.lost_count, 3);
+
+  EXPECT_EQ(orb_copy_batch(nullptr, &data, 0, 1, nullptr), -1);
+  EXPECT_EQ(errno, EINVAL);
+  ASSERT_TRUE(orb_destroy_publication(&ptopic));
+  ASSERT_TRUE(orb_destroy_subscription(&sfd));
+}
+
 }  // namespace uORBTest
@@ -62,7 +62,7 @@ class uORBTest::UnitTest : public testing::Test {
  public:
   // Assist in testing the wrap-around situation
   static void set_generation(uorb::DeviceNode &node, unsigned generation) {
-    node.generation_ = generation;
+    node.generation_.store_relaxed(generation);
   }
 
   template <typename S>
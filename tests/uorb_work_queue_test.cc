@@ -0,0 +1,629 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <uorb/publication.h>
+#include <uorb/subscription_callback.h>
+#include <uorb/topics/orb_test_medium.h>
+#include <uorb/uorb.h>
+#include <uorb/work_queue.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Wait up to 1 second for a condition set by a work queue thread
+template <typename Predicate>
+static bool WaitFor(Predicate predicate) {
+  for (int i = 0; i < 1000 && !predicate(); ++i) usleep(1000);
+  return predicate();
+}
+
+static void CountCallback(void *arg) {
+  ++*static_cast<std::atomic<int> *>(arg);
+}
+
+TEST(SubscriptionCallbackTest, set_callback) {
+  orb_test_medium_s data{};
+  auto pub = orb_create_publication(ORB_ID(orb_test_medium_callback));
+  ASSERT_NE(pub, nullptr);
+  auto sub = orb_create_subscription(ORB_ID(orb_test_medium_callback));
+  ASSERT_NE(sub, nullptr);
+
+  std::atomic<int> count{0};
+  ASSERT_TRUE(orb_set_subscription_callback(sub, CountCallback, &count));
+  for (int i = 0; i < 5; ++i) ASSERT_TRUE(orb_publish(pub, &data));
+  EXPECT_EQ(count, 5);
+
+  // Replaced
+  std::atomic<int> other_count{0};
+  ASSERT_TRUE(orb_set_subscription_callback(sub, CountCallback, &other_count));
+  ASSERT_TRUE(orb_publish(pub, &data));
+  EXPECT_EQ(count, 5);
+  EXPECT_EQ(other_count, 1);
+
+  // Removed
+  ASSERT_TRUE(orb_set_subscription_callback(sub, nullptr, nullptr));
+  ASSERT_TRUE(orb_publish(pub, &data));
+  EXPECT_EQ(other_count, 1);
+
+  // Removed with the subscription
+  ASSERT_TRUE(orb_set_subscription_callback(sub, CountCallback, &count));
+  ASSERT_TRUE(orb_destroy_subscription(&sub));
+  ASSERT_TRUE(orb_publish(pub, &data));
+  EXPECT_EQ(count, 5);
+
+  EXPECT_FALSE(orb_set_subscription_callback(nullptr, CountCallback, &count));
+  ASSERT_TRUE(orb_destroy_publication(&pub));
+}
+
+TEST(SubscriptionCallbackTest, deadline_miss_count) {
+  orb_test_medium_s data{};
+  auto pub = orb_create_publication(ORB_ID(orb_test_medium_callback));
+  ASSERT_NE(pub, nullptr);
+  auto sub = orb_create_subscription(ORB_ID(orb_test_medium_callback));
+  ASSERT_NE(sub, nullptr);
+
+  orb_sched_param param{};
+  ASSERT_TRUE(orb_get_subscription_sched_param(sub, &param));
+  EXPECT_EQ(param.priority, 0);
+  EXPECT_EQ(param.deadline_us, 0);
+
+  param = {5, 10 * 1000};
+  ASSERT_TRUE(orb_set_subscription_sched_param(sub, &param));
+  param = {};
+  ASSERT_TRUE(orb_get_subscription_sched_param(sub, &param));
+  EXPECT_EQ(param.priority, 5);
+  EXPECT_EQ(param.deadline_us, 10 * 1000);
+
+  // In time
+  ASSERT_TRUE(orb_publish(pub, &data));
+  ASSERT_TRUE(orb_copy(sub, &data));
+
+  // Late
+  ASSERT_TRUE(orb_publish(pub, &data));
+  usleep(20 * 1000);
+  ASSERT_TRUE(orb_copy(sub, &data));
+
+  orb_subscription_status status{};
+  ASSERT_TRUE(orb_get_subscription_status(sub, &status));
+  EXPECT_EQ(status.copy_count, 2);
+  EXPECT_EQ(status.deadline_miss_count, 1);
+
+  EXPECT_FALSE(orb_set_subscription_sched_param(sub, nullptr));
+  EXPECT_FALSE(orb_get_subscription_sched_param(nullptr, &param));
+  ASSERT_TRUE(orb_destroy_subscription(&sub));
+  ASSERT_TRUE(orb_destroy_publication(&pub));
+}
+
+TEST(SubscriptionCallbackTest, destroyed_while_publishing) {
+  // Implements Call() itself, so it unregisters in its own destructor
+  class CountingCallback
+      : public uorb::SubscriptionCallback<uorb::msg::orb_test_medium_callback> {
+   public:
+    ~CountingCallback() { UnregisterCallback(); }
+    std::atomic<int> count{0};
+
+   private:
+    void Call() override { ++count; }
+  };
+
+  std::atomic<bool> should_exit{false};
+  std::thread publisher([&should_exit]() {
+    uorb::PublicationData<uorb::msg::orb_test_medium_callback> pub;
+    while (!should_exit) pub.Publish();
+  });
+
+  // A Call() during the destruction aborts with a pure virtual call
+  int total = 0;
+  for (int i = 0; i < 100; ++i) {
+    CountingCallback callback;
+    ASSERT_TRUE(callback.RegisterCallback());
+    usleep(100);
+    total += callback.count;
+  }
+  should_exit = true;
+  publisher.join();
+  EXPECT_GT(total, 0);
+}
+
+namespace {
+
+class CopyItem : public uorb::WorkItem {
+ public:
+  explicit CopyItem(const uorb::WorkQueueConfig &config) : WorkItem(config) {}
+  ~CopyItem() override {
+    sub_.UnregisterCallback();
+    ScheduleClear();
+  }
+
+  bool Init() {
+    // Skip the message of a previous test
+    orb_test_medium_s data{};
+    sub_.Update(&data);
+    return sub_.RegisterCallback();
+  }
+
+  std::atomic<int> received{0};
+  std::atomic<int> last_val{-1};
+  std::atomic<bool> in_other_thread{true};
+  std::atomic<bool> in_order{true};
+  pthread_t test_thread{pthread_self()};
+
+ private:
+  void Run() override {
+    if (pthread_equal(pthread_self(), test_thread)) in_other_thread = false;
+
+    orb_test_medium_s data{};
+    while (sub_.Update(&data)) {
+      if (data.val != last_val + 1) in_order = false;
+      last_val = data.val;
+      ++received;
+    }
+  }
+
+  uorb::SubscriptionCallbackWorkItem<uorb::msg::orb_test_medium_work_queue>
+      sub_{this};
+};
+
+// Records the threads that run it, and can be blocked in Run()
+class ThreadItem : public uorb::WorkItem {
+ public:
+  explicit ThreadItem(const uorb::WorkQueueConfig &config) : WorkItem(config) {}
+  ~ThreadItem() override { ScheduleClear(); }
+
+  std::atomic<bool> running{false};
+  std::atomic<bool> blocked{false};
+  std::atomic<bool> finished{false};
+  pthread_t thread{};
+
+ private:
+  void Run() override {
+    thread = pthread_self();
+    running = true;
+    while (blocked) usleep(1000);
+    usleep(10 * 1000);
+    finished = true;
+    running = false;
+  }
+};
+
+}  // namespace
+
+static void TestScheduleOnPublish(const uorb::WorkQueueConfig &config) {
+  uorb::PublicationData<uorb::msg::orb_test_medium_work_queue> pub;
+  CopyItem item(config);
+  ASSERT_TRUE(item.Init());
+
+  const int num_messages = 100;
+  for (int i = 0; i < num_messages; ++i) {
+    pub.get().val = i;
+    ASSERT_TRUE(pub.Publish());
+    if (i % 10 == 0) usleep(1000);
+  }
+
+  EXPECT_TRUE(WaitFor([&]() { return item.last_val == num_messages - 1; }));
+  EXPECT_EQ(item.received, num_messages);
+  EXPECT_TRUE(item.in_other_thread);
+  EXPECT_TRUE(item.in_order);
+  EXPECT_GE(item.run_count(), 1);
+  EXPECT_LE(item.run_count(), num_messages);
+}
+
+TEST(WorkQueueTest, schedule_on_publish) {
+  TestScheduleOnPublish(uorb::wq_configurations::kDefault);
+}
+
+TEST(WorkQueueTest, pool_schedule_on_publish) {
+  TestScheduleOnPublish(uorb::wq_configurations::kPool);
+}
+
+TEST(WorkQueueTest, schedule_merged) {
+  ThreadItem item(uorb::wq_configurations::kDefault);
+
+  item.blocked = true;
+  ASSERT_TRUE(item.ScheduleNow());
+  ASSERT_TRUE(WaitFor([&]() { return bool(item.running); }));
+
+  // Scheduled again while running: runs once more
+  for (int i = 0; i < 10; ++i) ASSERT_TRUE(item.ScheduleNow());
+  item.blocked = false;
+
+  EXPECT_TRUE(WaitFor([&]() { return item.run_count() == 2; }));
+  usleep(50 * 1000);
+  EXPECT_EQ(item.run_count(), 2);
+}
+
+TEST(WorkQueueTest, shared_thread) {
+  ThreadItem item1(uorb::wq_configurations::kDefault);
+  ThreadItem item2(uorb::wq_configurations::kDefault);
+  ThreadItem item3(uorb::wq_configurations::kLowPriority);
+
+  for (auto item : {&item1, &item2, &item3}) {
+    ASSERT_TRUE(item->ScheduleNow());
+    EXPECT_TRUE(WaitFor([&]() { return item->run_count() == 1; }));
+  }
+  EXPECT_TRUE(pthread_equal(item1.thread, item2.thread));
+  EXPECT_FALSE(pthread_equal(item1.thread, item3.thread));
+}
+
+TEST(WorkQueueTest, schedule_clear_waits_for_run) {
+  ThreadItem item(uorb::wq_configurations::kDefault);
+
+  item.blocked = true;
+  ASSERT_TRUE(item.ScheduleNow());
+  ASSERT_TRUE(WaitFor([&]() { return bool(item.running); }));
+
+  std::thread unblock([&]() {
+    usleep(20 * 1000);
+    item.blocked = false;
+  });
+  item.ScheduleClear();
+  EXPECT_TRUE(item.finished);
+  unblock.join();
+
+  // Unqueued before it could run
+  ThreadItem blocker(uorb::wq_configurations::kDefault);
+  ThreadItem queued(uorb::wq_configurations::kDefault);
+  blocker.blocked = true;
+  ASSERT_TRUE(blocker.ScheduleNow());
+  ASSERT_TRUE(WaitFor([&]() { return bool(blocker.running); }));
+  ASSERT_TRUE(queued.ScheduleNow());
+  queued.ScheduleClear();
+  blocker.blocked = false;
+  blocker.ScheduleClear();
+  usleep(50 * 1000);
+  EXPECT_EQ(queued.run_count(), 0);
+}
+
+static constexpr uorb::WorkQueueConfig kTestPool{
+    "wq:test_pool", 0, 0, 4, uorb::WorkQueueConfig::kFixedPriority, 0};
+
+TEST(WorkQueueTest, pool_runs_in_parallel) {
+  // Every item waits until all of them are running
+  struct BarrierItem : uorb::WorkItem {
+    explicit BarrierItem(std::atomic<int> *running)
+        : WorkItem(kTestPool), running(running) {}
+    ~BarrierItem() override { ScheduleClear(); }
+
+    void Run() override {
+      ++*running;
+      for (int i = 0; i < 1000 && *running < 4; ++i) usleep(1000);
+      if (*running >= 4) all_running = true;
+    }
+
+    std::atomic<int> *running;
+    std::atomic<bool> all_running{false};
+  };
+
+  std::atomic<int> running{0};
+  BarrierItem item1(&running), item2(&running), item3(&running),
+      item4(&running);
+  for (auto item : {&item1, &item2, &item3, &item4}) {
+    ASSERT_TRUE(item->ScheduleNow());
+  }
+  for (auto item : {&item1, &item2, &item3, &item4}) {
+    EXPECT_TRUE(WaitFor([&]() { return item->run_count() == 1; }));
+    EXPECT_TRUE(item->all_running);
+  }
+}
+
+TEST(WorkQueueTest, pool_never_runs_item_concurrently) {
+  struct ExclusiveItem : uorb::WorkItem {
+    ExclusiveItem() : WorkItem(kTestPool) {}
+    ~ExclusiveItem() override { ScheduleClear(); }
+
+    void Run() override {
+      if (running.exchange(true)) overlapped = true;
+      usleep(100);
+      running = false;
+    }
+
+    std::atomic<bool> running{false};
+    std::atomic<bool> overlapped{false};
+  };
+
+  ExclusiveItem item;
+  std::atomic<bool> should_exit{false};
+  std::vector<std::thread> schedulers;
+  for (int i = 0; i < 4; ++i) {
+    schedulers.emplace_back([&]() {
+      while (!should_exit) item.ScheduleNow();
+    });
+  }
+  usleep(100 * 1000);
+  should_exit = true;
+  for (auto &thread : schedulers) thread.join();
+
+  item.ScheduleClear();
+  EXPECT_GT(item.run_count(), 10);
+  EXPECT_FALSE(item.overlapped);
+}
+
+namespace {
+
+// Appends its name to a list shared by the items of a test
+class OrderItem : public uorb::WorkItem {
+ public:
+  OrderItem(const uorb::WorkQueueConfig &config, char name,
+            std::vector<char> *order, std::mutex *order_lock)
+      : WorkItem(config), name_(name), order_(order), order_lock_(order_lock) {}
+  ~OrderItem() override { ScheduleClear(); }
+
+ private:
+  void Run() override {
+    std::lock_guard<std::mutex> lg(*order_lock_);
+    order_->push_back(name_);
+  }
+
+  const char name_;
+  std::vector<char> *const order_;
+  std::mutex *const order_lock_;
+};
+
+// Keeps the only thread of its queue busy until released
+class BlockerItem : public uorb::WorkItem {
+ public:
+  explicit BlockerItem(const uorb::WorkQueueConfig &config)
+      : WorkItem(config) {}
+  ~BlockerItem() override { ScheduleClear(); }
+
+  bool Block() {
+    blocked = true;
+    return ScheduleNow() && WaitFor([&]() { return bool(running); });
+  }
+
+  std::atomic<bool> blocked{false};
+  std::atomic<bool> running{false};
+
+ private:
+  void Run() override {
+    running = true;
+    while (blocked) usleep(1000);
+    running = false;
+  }
+};
+
+}  // namespace
+
+static constexpr uorb::WorkQueueConfig kTestPriorityQueue{
+    "wq:test_prio", 0, 0, 1, uorb::WorkQueueConfig::kFixedPriority, 0};
+static constexpr uorb::WorkQueueConfig kTestDeadlineQueue{
+    "wq:test_edf", 0, 0, 1, uorb::WorkQueueConfig::kEarliestDeadline, 0};
+
+TEST(WorkQueueTest, fixed_priority_order) {
+  std::vector<char> order;
+  std::mutex order_lock;
+  BlockerItem blocker(kTestPriorityQueue);
+  OrderItem a(kTestPriorityQueue, 'a', &order, &order_lock);
+  OrderItem b(kTestPriorityQueue, 'b', &order, &order_lock);
+  OrderItem c(kTestPriorityQueue, 'c', &order, &order_lock);
+  OrderItem d(kTestPriorityQueue, 'd', &order, &order_lock);
+
+  ASSERT_TRUE(blocker.Block());
+  ASSERT_TRUE(a.ScheduleNow(1, 0));
+  ASSERT_TRUE(b.ScheduleNow(5, 0));
+  ASSERT_TRUE(c.ScheduleNow());
+  ASSERT_TRUE(d.ScheduleNow(1, 0));
+  // Raised while queued
+  ASSERT_TRUE(c.ScheduleNow(10, 0));
+  blocker.blocked = false;
+
+  ASSERT_TRUE(WaitFor([&]() { return d.run_count() == 1; }));
+  std::lock_guard<std::mutex> lg(order_lock);
+  EXPECT_EQ(order, std::vector<char>({'c', 'b', 'a', 'd'}));
+}
+
+TEST(WorkQueueTest, earliest_deadline_order) {
+  std::vector<char> order;
+  std::mutex order_lock;
+  BlockerItem blocker(kTestDeadlineQueue);
+  OrderItem a(kTestDeadlineQueue, 'a', &order, &order_lock);
+  OrderItem b(kTestDeadlineQueue, 'b', &order, &order_lock);
+  OrderItem c(kTestDeadlineQueue, 'c', &order, &order_lock);
+  OrderItem d(kTestDeadlineQueue, 'd', &order, &order_lock);
+
+  const auto now = orb_monotonic_time_us();
+  ASSERT_TRUE(blocker.Block());
+  ASSERT_TRUE(a.ScheduleNow(100, 0));  // No deadline: last
+  ASSERT_TRUE(b.ScheduleNow(0, now + 3000));
+  ASSERT_TRUE(c.ScheduleNow(0, now + 1000));
+  ASSERT_TRUE(d.ScheduleNow(1, now + 3000));  // Same deadline as b
+  blocker.blocked = false;
+
+  ASSERT_TRUE(WaitFor([&]() { return a.run_count() == 1; }));
+  std::lock_guard<std::mutex> lg(order_lock);
+  EXPECT_EQ(order, std::vector<char>({'c', 'd', 'b', 'a'}));
+}
+
+// With c_api, the priorities are set with orb_set_subscription_sched_param()
+static void TestSubscriptionPriority(bool c_api) {
+  // Two work items ready from the same publication
+  class SubscriberItem : public uorb::WorkItem {
+   public:
+    SubscriberItem(char name, std::vector<char> *order, std::mutex *order_lock,
+                   int priority, bool c_api)
+        : WorkItem(kTestPriorityQueue),
+          name_(name),
+          order_(order),
+          order_lock_(order_lock) {
+      if (c_api) {
+        const orb_sched_param param{priority, 0};
+        orb_set_subscription_sched_param(sub_.handle(), &param);
+      } else {
+        sub_.SetSchedParam(priority);
+      }
+    }
+    ~SubscriberItem() override {
+      sub_.UnregisterCallback();
+      ScheduleClear();
+    }
+    bool Init() {
+      orb_test_medium_s data{};
+      sub_.Update(&data);
+      return sub_.RegisterCallback();
+    }
+
+   private:
+    void Run() override {
+      orb_test_medium_s data{};
+      while (sub_.Update(&data)) {
+        std::lock_guard<std::mutex> lg(*order_lock_);
+        order_->push_back(name_);
+      }
+    }
+
+    const char name_;
+    std::vector<char> *const order_;
+    std::mutex *const order_lock_;
+    uorb::SubscriptionCallbackWorkItem<uorb::msg::orb_test_medium_work_queue>
+        sub_{this};
+  };
+
+  std::vector<char> order;
+  std::mutex order_lock;
+  SubscriberItem logger('l', &order, &order_lock, 0, c_api);
+  SubscriberItem control('c', &order, &order_lock, 10, c_api);
+  ASSERT_TRUE(logger.Init());
+  ASSERT_TRUE(control.Init());
+  EXPECT_EQ(control.run_count(), 0);
+
+  // Queued before the publication, with a priority between the two
+  BlockerItem blocker(kTestPriorityQueue);
+  OrderItem other(kTestPriorityQueue, 'o', &order, &order_lock);
+  ASSERT_TRUE(blocker.Block());
+  ASSERT_TRUE(other.ScheduleNow(5, 0));
+  uorb::PublicationData<uorb::msg::orb_test_medium_work_queue> pub;
+  ASSERT_TRUE(pub.Publish());
+  blocker.blocked = false;
+
+  ASSERT_TRUE(WaitFor([&]() {
+    return logger.run_count() == 1 && control.run_count() == 1;
+  }));
+  std::lock_guard<std::mutex> lg(order_lock);
+  EXPECT_EQ(order, std::vector<char>({'c', 'o', 'l'}));
+}
+
+TEST(WorkQueueTest, subscription_priority) { TestSubscriptionPriority(false); }
+
+TEST(WorkQueueTest, subscription_priority_c_api) {
+  TestSubscriptionPriority(true);
+}
+
+namespace {
+
+// Records the times of its runs
+class TimerItem : public uorb::WorkItem {
+ public:
+  explicit TimerItem(const uorb::WorkQueueConfig &config) : WorkItem(config) {}
+  ~TimerItem() override { ScheduleClear(); }
+
+  std::vector<orb_abstime_us> RunTimes() {
+    std::lock_guard<std::mutex> lg(lock_);
+    return run_times_;
+  }
+
+ private:
+  void Run() override {
+    std::lock_guard<std::mutex> lg(lock_);
+    run_times_.push_back(orb_monotonic_time_us());
+  }
+
+  std::mutex lock_;
+  std::vector<orb_abstime_us> run_times_;
+};
+
+}  // namespace
+
+TEST(WorkQueueTest, schedule_delayed) {
+  TimerItem item(uorb::wq_configurations::kDefault);
+
+  const auto start = orb_monotonic_time_us();
+  ASSERT_TRUE(item.ScheduleDelayed(20 * 1000));
+  usleep(5 * 1000);
+  EXPECT_EQ(item.run_count(), 0);
+
+  ASSERT_TRUE(WaitFor([&]() { return item.run_count() == 1; }));
+  EXPECT_GE(item.RunTimes()[0], start + 20 * 1000);
+
+  // Once
+  usleep(30 * 1000);
+  EXPECT_EQ(item.run_count(), 1);
+
+  // Replaced by a later one, and stopped by ScheduleClear()
+  ASSERT_TRUE(item.ScheduleDelayed(10 * 1000));
+  ASSERT_TRUE(item.ScheduleAt(orb_monotonic_time_us() + 20 * 1000));
+  item.ScheduleClear();
+  usleep(30 * 1000);
+  EXPECT_EQ(item.run_count(), 1);
+}
+
+TEST(WorkQueueTest, schedule_on_interval) {
+  TimerItem item(uorb::wq_configurations::kDefault);
+
+  const uint32_t interval_us = 2000;
+  const auto start = orb_monotonic_time_us();
+  ASSERT_TRUE(item.ScheduleOnInterval(interval_us));
+  usleep(100 * 1000);
+  item.ScheduleClear();
+
+  // Never early: run n is due at start + n * interval_us at the earliest
+  const auto run_times = item.RunTimes();
+  ASSERT_GE(run_times.size(), 10);
+  EXPECT_LE(run_times.size(), 100 * 1000 / interval_us + 1);
+  for (size_t i = 1; i < run_times.size(); ++i) {
+    EXPECT_GE(run_times[i], start + i * interval_us);
+  }
+
+  const auto run_count = item.run_count();
+  usleep(10 * 1000);
+  EXPECT_EQ(item.run_count(), run_count);
+
+  EXPECT_FALSE(item.ScheduleOnInterval(0));
+  EXPECT_EQ(errno, EINVAL);
+}
+
+TEST(WorkQueueTest, timer_and_topic_in_one_thread) {
+  // A periodic loop that also copies the updates of a topic
+  class LoopItem : public uorb::WorkItem {
+   public:
+    LoopItem() : WorkItem(uorb::wq_configurations::kDefault) {}
+    ~LoopItem() override {
+      sub_.UnregisterCallback();
+      ScheduleClear();
+    }
+    bool Init() {
+      orb_test_medium_s data{};
+      sub_.Update(&data);
+      return sub_.RegisterCallback() && ScheduleOnInterval(5000);
+    }
+
+    std::atomic<int> received{0};
+
+   private:
+    void Run() override {
+      orb_test_medium_s data{};
+      while (sub_.Update(&data)) ++received;
+    }
+
+    uorb::SubscriptionCallbackWorkItem<uorb::msg::orb_test_medium_work_queue>
+        sub_{this};
+  };
+
+  LoopItem item;
+  ASSERT_TRUE(item.Init());
+
+  uorb::PublicationData<uorb::msg::orb_test_medium_work_queue> pub;
+  for (int i = 0; i < 5; ++i) {
+    ASSERT_TRUE(pub.Publish());
+    usleep(1000);
+  }
+  EXPECT_TRUE(WaitFor([&]() { return item.received == 5; }));
+  // Runs on the timer without publications
+  const auto run_count = item.run_count();
+  EXPECT_TRUE(WaitFor([&]() { return item.run_count() >= run_count + 3; }));
+  EXPECT_EQ(item.received, 5);
+}
@@ -64,10 +64,12 @@ struct_size, padding_end_size = add_padding_bytes(sorted_fields, search_path)
 topic_fields = ["%s %s" % (convert_type(field.type), field.name) for field in sorted_fields]
 
 topic_queue_size = 1
+topic_flags = []
 for constant in spec.constants:
   if constant.name == "ORB_QUEUE_SIZE":
     topic_queue_size =  constant.val
-    break
+  elif constant.name == "ORB_SUPPRESS_DUPLICATES" and constant.val:
+    topic_flags.append("ORB_FLAG_SUPPRESS_DUPLICATES")
 }@
 
 #include <uorb/topics/@(topic_name).h>
@@ -78,5 +80,9 @@ static constexpr char orb_@(topic_name)_fields[] =
   "@( ";".join(topic_fields) );";
 
 @[for multi_topic in topics]@
+@[if topic_flags]@
+ORB_DEFINE_FLAGS(@multi_topic, struct @uorb_struct, @(struct_size-padding_end_size), orb_@(topic_name)_fields, @topic_queue_size, @(" | ".join(topic_flags)));
+@[else]@
 ORB_DEFINE(@multi_topic, struct @uorb_struct, @(struct_size-padding_end_size), orb_@(topic_name)_fields, @topic_queue_size);
+@[end if]@
 @[end for]
@@ -0,0 +1,98 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * On-disk layout of the uorb binary topic log.
+ *
+ * The file is a sequence of fixed-size blocks (LogFileHeader::block_size):
+ *
+ *   block 0:   LogFileHeader, followed by LogTopicDesc entries
+ *   block 1..: LogBlockHeader, followed by records (data block) or by
+ *              LogIndexEntry entries (index block)
+ *
+ * Each record is a LogRecordHeader followed by the topic payload, padded to
+ * kLogRecordAlignment. The unused tail of a block is zero-filled, so every
+ * write is a whole block and the file can be written with O_DIRECT.
+ *
+ * The records of a data block are in timestamp order, and the records of a
+ * topic instance in the whole file. The topics are drained one after the
+ * other, so a record can be older than some records of the previous block.
+ *
+ * Every few data blocks an index block is written, with one entry for each
+ * topic that has records in one of those data blocks. Readers use it to seek
+ * by time and to iterate one topic without scanning the others. Data blocks
+ * that are not indexed (e.g. after a crash) are still valid.
+ */
+
+namespace uorb {
+namespace logger {
+
+static constexpr char kLogFileMagic[8] = {'U', 'O', 'R', 'B',
+                                          'L', 'O', 'G', '\0'};
+static constexpr uint32_t kLogFormatVersion = 1;
+static constexpr uint32_t kLogBlockMagic = 0x4B4C4255;  // "UBLK"
+static constexpr uint32_t kLogIndexMagic = 0x58444955;  // "UIDX"
+
+// Alignment of blocks in memory and on disk (required by O_DIRECT)
+static constexpr uint32_t kLogAlignment = 4096;
+static constexpr uint32_t kLogRecordAlignment = 8;
+
+struct LogFileHeader {
+  char magic[8];           // kLogFileMagic
+  uint32_t version;        // kLogFormatVersion
+  uint32_t block_size;     // Size of every block in the file
+  uint32_t topic_count;    // Number of LogTopicDesc entries
+  uint32_t header_size;    // Bytes used in block 0
+  uint64_t start_time_us;  // orb_monotonic_time_us() when recording started
+};
+
+/**
+ * Topic description, followed by name_len bytes of name and fields_len bytes
+ * of fields (not null terminated), padded to kLogRecordAlignment.
+ */
+struct LogTopicDesc {
+  uint32_t size;             // orb_metadata::o_size
+  uint32_t size_no_padding;  // orb_metadata::o_size_no_padding
+  uint16_t queue_size;       // orb_metadata::o_queue_size
+  uint16_t name_len;
+  uint32_t fields_len;
+};
+
+struct LogBlockHeader {
+  uint32_t magic;         // kLogBlockMagic or kLogIndexMagic
+  uint32_t used;          // Bytes used in this block, including this header
+  uint64_t sequence;      // Data or index block sequence number, from 0
+  uint32_t record_count;  // Number of records or index entries in this block
+  uint32_t dropped;       // Messages dropped right before this block
+};
+
+struct LogRecordHeader {
+  uint16_t topic;      // Index into the topic table
+  uint8_t instance;    // Topic instance
+  uint8_t reserved;
+  uint32_t size;       // Payload size
+  uint64_t timestamp;  // Publish time of the message (orb_copy_info), in us
+};
+
+/**
+ * Position of the first record of a topic in a data block.
+ */
+struct LogIndexEntry {
+  uint64_t timestamp;     // LogRecordHeader::timestamp of that record
+  uint64_t block_offset;  // File offset of the data block
+  uint32_t offset;        // Offset of the record in the block
+  uint32_t record;        // Index of the record in the block
+  uint16_t topic;         // Index into the topic table
+  uint16_t reserved[3];
+};
+
+static inline uint32_t LogAlignUp(uint32_t size, uint32_t alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+}  // namespace logger
+}  // namespace uorb
@@ -0,0 +1,121 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "uorb_log_format.h"
+
+namespace uorb {
+namespace logger {
+
+struct LogTopic {
+  std::string name;
+  std::string fields;
+  uint32_t size;
+  uint32_t size_no_padding;
+  uint16_t queue_size;
+};
+
+struct LogRecord {
+  uint16_t topic;  // Index into LogReader::topics()
+  uint8_t instance;
+  uint64_t timestamp;
+  const void *data;  // Points into the mapped file
+  uint32_t size;
+};
+
+/**
+ * Reads a log written by uorb::logger::Recorder. The file is mapped into
+ * memory, records are returned without copying their payload.
+ *
+ * The index blocks of the log are loaded when opening it, so seeking by time
+ * and iterating a single topic only touch the blocks that are needed.
+ */
+class LogReader {
+ public:
+  // Position of the next record to read
+  struct Cursor {
+    size_t block_offset;   // File offset of the current block
+    uint32_t offset;       // Offset of the next record in the block
+    uint32_t record;       // Index of the next record in the block
+  };
+
+  LogReader() = default;
+  ~LogReader();
+
+  LogReader(const LogReader &) = delete;
+  LogReader &operator=(const LogReader &) = delete;
+
+  /**
+   * Map a log file and parse its header.
+   * @return false with errno set on failure (EINVAL: not a valid log).
+   */
+  bool Open(const std::string &path);
+  void Close();
+
+  bool is_open() const { return data_ != nullptr; }
+  const LogFileHeader &header() const { return header_; }
+  const std::vector<LogTopic> &topics() const { return topics_; }
+
+  // Number of data blocks in the file
+  size_t block_count() const;
+
+  // Index of the topic in topics(), or -1 if the log does not contain it
+  int FindTopic(const std::string &name) const;
+
+  Cursor Begin() const;
+  Cursor End() const;
+
+  // Timestamp of the first record, 0 if the log is empty
+  uint64_t first_timestamp() const;
+
+  /**
+   * Read the record at the cursor and advance the cursor.
+   * @return false at the end of the log.
+   */
+  bool Next(Cursor *cursor, LogRecord *record) const;
+
+  /**
+   * Like Next(), but only returns records of one topic. The records of other
+   * topics are skipped without reading their payload, and blocks without a
+   * record of the topic are skipped entirely.
+   */
+  bool Next(uint16_t topic, Cursor *cursor, LogRecord *record) const;
+
+  /**
+   * Cursor of the first record whose timestamp is at or after timestamp.
+   */
+  Cursor Seek(uint64_t timestamp) const;
+
+  /**
+   * Cursor of the first record of the topic whose timestamp is at or after
+   * timestamp, to be used with Next(topic, ...).
+   */
+  Cursor Seek(uint16_t topic, uint64_t timestamp) const;
+
+ private:
+  const LogBlockHeader *BlockAt(size_t block_offset) const;
+  bool IsIndexBlock(size_t block_offset) const;
+  uint64_t LatestTimestamp(size_t block_offset) const;  // 0 if no records
+  bool ReadRecord(const LogBlockHeader &block, Cursor *cursor,
+                  LogRecord *record) const;
+  void BuildIndex();
+
+  const uint8_t *data_{nullptr};
+  size_t size_{0};
+  LogFileHeader header_{};
+  std::vector<LogTopic> topics_;
+
+  // First record of every data block, and first record of every topic in
+  // every data block, both sorted by block offset
+  std::vector<LogIndexEntry> block_index_;
+  std::vector<std::vector<LogIndexEntry>> topic_index_;
+};
+
+}  // namespace logger
+}  // namespace uorb
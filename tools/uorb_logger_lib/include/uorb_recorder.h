@@ -0,0 +1,127 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#pragma once
+
+#include <uorb/uorb.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "uorb_log_format.h"
+#include "uorb_topic_collector.h"
+
+namespace uorb {
+namespace logger {
+
+class BlockWriter;
+
+struct RecorderConfig {
+  // Topics that may be recorded, usually from orb_get_topics()
+  const struct orb_metadata *const *topics{nullptr};
+  size_t topic_count{0};
+
+  // Names of the topics to record, empty means all topics
+  std::vector<std::string> topic_names{};
+
+  // Size of a file block, a multiple of kLogAlignment (4KiB)
+  uint32_t block_size{1024 * 1024};
+
+  // Number of blocks in memory, 2 is double buffering. The memory used by
+  // the recorder is bounded by block_size * block_count.
+  uint32_t block_count{2};
+
+  // Bypass the page cache with O_DIRECT if the file system supports it
+  bool direct_io{false};
+
+  // A partially filled block is written out after this time
+  uint32_t flush_interval_ms{1000};
+
+  // An index block is written after this many data blocks and when
+  // recording stops, 0 disables the index.
+  uint32_t index_interval{16};
+};
+
+struct RecorderStatus {
+  uint64_t records;       // Records written into blocks
+  uint64_t dropped;       // Messages dropped because no block was free
+  uint64_t bytes;         // Bytes written to the file
+  uint64_t write_errors;  // Blocks that failed to be written
+  bool direct_io;         // Whether the file is written with O_DIRECT
+};
+
+/**
+ * Flight-recorder style binary logger of uorb topics.
+ *
+ * A collector thread subscribes to every instance of the configured topics
+ * and copies new messages straight into the current block; full blocks are
+ * written by a separate I/O thread, so publishers are never blocked by the
+ * file system. When the I/O thread cannot keep up the collector drops
+ * messages and counts them instead of growing its buffers.
+ *
+ * The file layout is described in uorb_log_format.h.
+ */
+class Recorder : private TopicCollector {
+ public:
+  explicit Recorder(RecorderConfig config);
+  ~Recorder() override;
+
+  Recorder(const Recorder &) = delete;
+  Recorder &operator=(const Recorder &) = delete;
+
+  /**
+   * Create the log file and start recording.
+   * @return false with errno set on failure.
+   */
+  bool Start(const std::string &path);
+
+  /**
+   * Stop recording, all collected messages are written before returning.
+   */
+  void Stop();
+
+  bool running() const { return collecting(); }
+
+  RecorderStatus status() const;
+
+ private:
+  bool WriteFileHeader(const std::vector<const struct orb_metadata *> &topics);
+  void SortCurrentBlock();
+  void SubmitCurrentBlock();
+  bool NextBlock();
+  void WriteIndex(bool blocking);
+
+  void Drain(const Subscription &sub) override;
+  void OnPeriodic() override { SubmitCurrentBlock(); }
+  void OnStopped() override;
+
+  const RecorderConfig config_;
+  std::vector<uint8_t> scratch_;  // Receives messages that are dropped
+  std::vector<orb_copy_info> infos_;  // Of the messages copied at once
+  std::vector<uint8_t> sorted_block_;  // See SortCurrentBlock()
+
+  std::unique_ptr<BlockWriter> writer_;
+  uint8_t *block_{nullptr};  // The block being filled
+  uint32_t block_used_{0};
+  uint32_t block_records_{0};
+  uint64_t block_sequence_{0};
+  uint32_t dropped_since_block_{0};
+  uint64_t file_offset_{0};  // File offset of the next submitted block
+
+  // Index entries of the current block, and of the blocks written since the
+  // last index block
+  std::vector<LogIndexEntry> block_index_;
+  std::vector<uint8_t> topic_in_block_;
+  std::vector<LogIndexEntry> pending_index_;
+  uint32_t blocks_since_index_{0};
+  uint64_t index_sequence_{0};
+
+  std::atomic<uint64_t> records_{0};
+  std::atomic<uint64_t> dropped_{0};
+};
+
+}  // namespace logger
+}  // namespace uorb
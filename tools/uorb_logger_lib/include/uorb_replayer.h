@@ -0,0 +1,111 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#pragma once
+
+#include <uorb/uorb.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "uorb_log_reader.h"
+
+namespace uorb {
+namespace logger {
+
+enum class ReplayMode : uint8_t {
+  kRealTime,         // Keep the recorded timing
+  kScaled,           // Recorded timing sped up by ReplayConfig::speed
+  kAsFastAsPossible, // No delays, but never overrun a subscriber's queue
+};
+
+struct ReplayConfig {
+  // Topics that may be replayed, usually from orb_get_topics()
+  const struct orb_metadata *const *topics{nullptr};
+  size_t topic_count{0};
+
+  // Names of the topics to replay, empty means all topics in the log
+  std::vector<std::string> topic_names{};
+
+  ReplayMode mode{ReplayMode::kRealTime};
+
+  // Speed factor of ReplayMode::kScaled, e.g. 10 replays 10x faster
+  double speed{1.0};
+
+  // Skip the records before this record timestamp, 0 starts at the
+  // beginning of the log
+  uint64_t start_timestamp{0};
+
+  // In ReplayMode::kAsFastAsPossible, a message is published anyway if the
+  // subscribers have not caught up within this time, overwriting a message
+  // they have not copied yet. 0 (the default) waits forever, so no message
+  // is lost.
+  uint32_t backlog_timeout_ms{0};
+};
+
+struct ReplayStatus {
+  uint64_t published;  // Messages published
+  uint64_t skipped;    // Records of topics that are not replayed
+  uint64_t overruns;   // Messages published after backlog_timeout_ms
+};
+
+/**
+ * Re-publishes the messages of a log written by Recorder, with the recorded
+ * timing or faster. Payloads (including their timestamps) are published
+ * unchanged, straight from the mapped file.
+ */
+class Replayer {
+ public:
+  explicit Replayer(ReplayConfig config);
+  ~Replayer();
+
+  Replayer(const Replayer &) = delete;
+  Replayer &operator=(const Replayer &) = delete;
+
+  /**
+   * Open a log and match its topics against the configured ones. Topics of
+   * the log that are unknown or whose size changed are not replayed.
+   * @return false with errno set on failure.
+   */
+  bool Open(const std::string &path);
+
+  /**
+   * Replay the log in the calling thread until the end of the log or until
+   * Stop() is called.
+   * @return false if no log is open.
+   */
+  bool Run();
+
+  // Make Run() return, can be called from any thread
+  void Stop() { should_exit_ = true; }
+
+  ReplayStatus status() const;
+  const LogReader &reader() const { return reader_; }
+
+ private:
+  struct TopicPublication {
+    const struct orb_metadata *meta;  // nullptr if the topic is not replayed
+    std::array<orb_publication_t *, ORB_MULTI_MAX_INSTANCES> handles;
+    std::array<unsigned, ORB_MULTI_MAX_INSTANCES> instances;  // In uorb
+    std::array<unsigned, ORB_MULTI_MAX_INSTANCES> queue_sizes;
+  };
+
+  orb_publication_t *GetPublication(const LogRecord &record);
+  void WaitForSubscribers(const LogRecord &record, orb_publication_t *handle);
+  void DestroyPublications();
+
+  const ReplayConfig config_;
+  LogReader reader_;
+  std::vector<TopicPublication> publications_;  // Indexed by log topic
+
+  std::atomic<bool> should_exit_{false};
+  std::atomic<uint64_t> published_{0};
+  std::atomic<uint64_t> skipped_{0};
+  std::atomic<uint64_t> overruns_{0};
+};
+
+}  // namespace logger
+}  // namespace uorb
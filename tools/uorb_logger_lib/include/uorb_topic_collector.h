@@ -0,0 +1,84 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#pragma once
+
+#include <uorb/uorb.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace uorb {
+namespace logger {
+
+/**
+ * Pick the topics named in 'names' from a topic list (usually from
+ * orb_get_topics()). An empty 'names' selects every topic.
+ * @return false with errno set to ENOENT if a name is not in the list.
+ */
+bool SelectTopics(const struct orb_metadata *const *topics, size_t topic_count,
+                  const std::vector<std::string> &names,
+                  std::vector<const struct orb_metadata *> *selected);
+
+/**
+ * Common part of the log writers: a thread that subscribes to every instance
+ * of a set of topics as they get advertised, waits for new data with
+ * orb_poll() and lets the writer drain each subscription.
+ */
+class TopicCollector {
+ public:
+  struct Subscription {
+    const struct orb_metadata *meta;
+    uint16_t topic_id;  // Index into topics()
+    uint8_t instance;
+    uint16_t index;  // Index of the subscription, in order of creation
+    orb_subscription_t *handle;
+  };
+
+  TopicCollector() = default;
+  virtual ~TopicCollector() = default;
+
+  TopicCollector(const TopicCollector &) = delete;
+  TopicCollector &operator=(const TopicCollector &) = delete;
+
+  bool collecting() const { return thread_.joinable(); }
+  const std::vector<const struct orb_metadata *> &topics() const {
+    return topics_;
+  }
+
+ protected:
+  void StartCollecting(std::vector<const struct orb_metadata *> topics,
+                       uint32_t periodic_interval_ms);
+
+  // Drains the subscriptions one last time before returning
+  void StopCollecting();
+
+  // A new topic instance was found, called before it is drained
+  virtual void OnSubscribed(const Subscription &) {}
+
+  // Copy all updates of a subscription
+  virtual void Drain(const Subscription &sub) = 0;
+
+  // Called every periodic_interval_ms, e.g. to flush partial buffers
+  virtual void OnPeriodic() {}
+
+  // Called from the collector thread after the final drain
+  virtual void OnStopped() {}
+
+ private:
+  void CollectorThread();
+  void SubscribeNewInstances();
+
+  std::vector<const struct orb_metadata *> topics_;
+  std::vector<Subscription> subscriptions_;
+  uint32_t periodic_interval_ms_{0};
+
+  std::thread thread_;
+  std::atomic<bool> should_exit_{false};
+};
+
+}  // namespace logger
+}  // namespace uorb
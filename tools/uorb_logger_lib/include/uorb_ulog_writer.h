@@ -0,0 +1,112 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#pragma once
+
+#include <uorb/uorb.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "uorb_topic_collector.h"
+
+namespace uorb {
+namespace logger {
+
+class BlockWriter;
+
+struct ULogWriterConfig {
+  // Topics that may be logged, usually from orb_get_topics()
+  const struct orb_metadata *const *topics{nullptr};
+  size_t topic_count{0};
+
+  // Names of the topics to log, empty means all topics
+  std::vector<std::string> topic_names{};
+
+  // Size and number of the write buffers, the memory used by the writer is
+  // bounded by buffer_size * buffer_count.
+  uint32_t buffer_size{64 * 1024};
+  uint32_t buffer_count{8};
+
+  // A partially filled buffer is written out after this time
+  uint32_t flush_interval_ms{1000};
+};
+
+struct ULogWriterStatus {
+  uint64_t messages;      // Data messages logged
+  uint64_t dropped;       // Data messages dropped because no buffer was free
+  uint64_t bytes;         // Bytes written to the file
+  uint64_t write_errors;  // Buffers that failed to be written
+};
+
+/**
+ * Writes uorb topics into a PX4 ULog file, readable by the ULog tool chain
+ * (pyulog, PlotJuggler, Flight Review, ...).
+ *
+ * The format definitions are generated from orb_metadata::o_fields and data
+ * messages only carry the first o_size_no_padding bytes of each message.
+ * Messages are collected by a dedicated thread and written by an I/O thread,
+ * so logging never blocks a publisher; if the buffers run full, data is
+ * dropped and a dropout message is logged.
+ *
+ * The first field of a logged topic is expected to be "uint64_t timestamp",
+ * as the ULog format requires.
+ */
+class ULogWriter : private TopicCollector {
+ public:
+  explicit ULogWriter(ULogWriterConfig config);
+  ~ULogWriter() override;
+
+  ULogWriter(const ULogWriter &) = delete;
+  ULogWriter &operator=(const ULogWriter &) = delete;
+
+  /**
+   * Create the log file, write the definitions and start logging.
+   * @return false with errno set on failure.
+   */
+  bool Start(const std::string &path);
+
+  /**
+   * Stop logging, all collected messages are written before returning.
+   */
+  void Stop();
+
+  bool running() const { return collecting(); }
+
+  ULogWriterStatus status() const;
+
+ private:
+  bool WriteDefinitions(const std::vector<const struct orb_metadata *> &topics);
+  bool WriteFormat(const struct orb_metadata &meta, bool strip_padding,
+                   std::set<std::string> *written);
+  bool WriteInfo(const std::string &key, const std::string &value);
+  bool WriteMessage(char type, const void *payload, uint32_t size,
+                    bool blocking);
+  bool WriteDropout();
+
+  uint8_t *Reserve(uint32_t size, bool blocking);
+  void SubmitCurrentBuffer();
+
+  void OnSubscribed(const Subscription &sub) override;
+  void Drain(const Subscription &sub) override;
+  void OnPeriodic() override;
+  void OnStopped() override;
+
+  const ULogWriterConfig config_;
+  std::vector<uint8_t> scratch_;  // Receives messages that are dropped
+
+  std::unique_ptr<BlockWriter> writer_;
+  uint8_t *buffer_{nullptr};  // The buffer being filled
+  uint32_t buffer_used_{0};
+  uint64_t dropout_start_us_{0};  // Start time of the current dropout
+
+  std::atomic<uint64_t> messages_{0};
+  std::atomic<uint64_t> dropped_{0};
+};
+
+}  // namespace logger
+}  // namespace uorb
@@ -0,0 +1,135 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include "block_writer.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+
+#include "uorb_log_format.h"
+
+uorb::logger::BlockWriter::BlockWriter(uint32_t block_size,
+                                       uint32_t block_count)
+    : block_size_(block_size) {
+  for (uint32_t i = 0; i < block_count; ++i) {
+    void *block = nullptr;
+    if (posix_memalign(&block, kLogAlignment, block_size_) != 0) break;
+    blocks_.push_back(static_cast<uint8_t *>(block));
+  }
+  free_blocks_ = blocks_;
+}
+
+uorb::logger::BlockWriter::~BlockWriter() {
+  Close();
+  for (auto block : blocks_) free(block);
+}
+
+bool uorb::logger::BlockWriter::Open(const std::string &path, bool direct_io) {
+  if (fd_ >= 0 || blocks_.empty()) {
+    errno = blocks_.empty() ? ENOMEM : EBUSY;
+    return false;
+  }
+
+  const int flags = O_WRONLY | O_CREAT | O_TRUNC;
+  direct_io_ = false;
+#ifdef O_DIRECT
+  if (direct_io && block_size_ % kLogAlignment == 0) {
+    fd_ = open(path.c_str(), flags | O_DIRECT, 0644);
+    direct_io_ = fd_ >= 0;
+  }
+#endif
+  if (fd_ < 0) fd_ = open(path.c_str(), flags, 0644);
+  if (fd_ < 0) return false;
+
+#if defined(__APPLE__) && defined(F_NOCACHE)
+  if (direct_io) direct_io_ = fcntl(fd_, F_NOCACHE, 1) == 0;
+#endif
+
+  closing_ = false;
+  thread_ = std::thread{&BlockWriter::WriteThread, this};
+  return true;
+}
+
+void uorb::logger::BlockWriter::Close() {
+  if (!thread_.joinable()) return;
+
+  {
+    std::lock_guard<std::mutex> lg(mutex_);
+    closing_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+
+  close(fd_);
+  fd_ = -1;
+}
+
+uint8_t *uorb::logger::BlockWriter::TryAcquire() {
+  std::lock_guard<std::mutex> lg(mutex_);
+  if (free_blocks_.empty()) return nullptr;
+  auto block = free_blocks_.back();
+  free_blocks_.pop_back();
+  return block;
+}
+
+uint8_t *uorb::logger::BlockWriter::Acquire() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [&] { return !free_blocks_.empty(); });
+  auto block = free_blocks_.back();
+  free_blocks_.pop_back();
+  return block;
+}
+
+void uorb::logger::BlockWriter::Submit(uint8_t *block, uint32_t size) {
+  {
+    std::lock_guard<std::mutex> lg(mutex_);
+    pending_blocks_.push_back({block, size});
+  }
+  cv_.notify_all();
+}
+
+void uorb::logger::BlockWriter::Release(uint8_t *block) {
+  {
+    std::lock_guard<std::mutex> lg(mutex_);
+    free_blocks_.push_back(block);
+  }
+  cv_.notify_all();
+}
+
+bool uorb::logger::BlockWriter::WriteAll(const uint8_t *data, uint32_t size) {
+  while (size > 0) {
+    auto ret = write(fd_, data, size);
+    if (ret < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data += ret;
+    size -= ret;
+  }
+  return true;
+}
+
+void uorb::logger::BlockWriter::WriteThread() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [&] { return closing_ || !pending_blocks_.empty(); });
+    if (pending_blocks_.empty()) break;  // Closing and everything written
+
+    auto pending = pending_blocks_.front();
+    pending_blocks_.pop_front();
+
+    lock.unlock();
+    if (WriteAll(pending.data, pending.size)) {
+      bytes_written_ += pending.size;
+    } else {
+      ++write_errors_;
+    }
+    lock.lock();
+
+    free_blocks_.push_back(pending.data);
+    cv_.notify_all();
+  }
+}
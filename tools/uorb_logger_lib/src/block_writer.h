@@ -0,0 +1,96 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace uorb {
+namespace logger {
+
+/**
+ * A fixed pool of aligned blocks that are written to a file by a dedicated
+ * I/O thread.
+ *
+ * The producer takes a free block with TryAcquire(), fills it and hands it
+ * back with Submit(). TryAcquire() never blocks: when the I/O thread falls
+ * behind it returns nullptr and the producer decides what to drop. Memory
+ * usage is bounded by block_size * block_count.
+ */
+class BlockWriter {
+ public:
+  BlockWriter(uint32_t block_size, uint32_t block_count);
+  ~BlockWriter();
+
+  BlockWriter(const BlockWriter &) = delete;
+  BlockWriter &operator=(const BlockWriter &) = delete;
+
+  /**
+   * Open (truncate) the file and start the I/O thread.
+   * @param direct_io Try to bypass the page cache (O_DIRECT), falls back to
+   * buffered io if the file system refuses it.
+   * @return false with errno set on failure.
+   */
+  bool Open(const std::string &path, bool direct_io);
+
+  /**
+   * Write all submitted blocks, stop the I/O thread and close the file.
+   */
+  void Close();
+
+  // Returns a free block, or nullptr if all blocks are in use.
+  uint8_t *TryAcquire();
+
+  // Returns a free block, waits for the I/O thread if all blocks are in use.
+  uint8_t *Acquire();
+
+  /**
+   * Queue a block for writing.
+   * @param size Number of bytes to write, must be a multiple of the block
+   * alignment when direct io is used.
+   */
+  void Submit(uint8_t *block, uint32_t size);
+
+  // Return an acquired block to the pool without writing it.
+  void Release(uint8_t *block);
+
+  uint32_t block_size() const { return block_size_; }
+  bool direct_io() const { return direct_io_; }
+  uint64_t bytes_written() const { return bytes_written_; }
+  uint64_t write_errors() const { return write_errors_; }
+
+ private:
+  struct PendingBlock {
+    uint8_t *data;
+    uint32_t size;
+  };
+
+  void WriteThread();
+  bool WriteAll(const uint8_t *data, uint32_t size);
+
+  const uint32_t block_size_;
+  std::vector<uint8_t *> blocks_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<uint8_t *> free_blocks_;
+  std::deque<PendingBlock> pending_blocks_;
+  bool closing_{false};
+
+  int fd_{-1};
+  bool direct_io_{false};
+  std::thread thread_;
+
+  std::atomic<uint64_t> bytes_written_{0};
+  std::atomic<uint64_t> write_errors_{0};
+};
+
+}  // namespace logger
+}  // namespace uorb
@@ -0,0 +1,342 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include "uorb_log_reader.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+uorb::logger::LogReader::~LogReader() { Close(); }
+
+bool uorb::logger::LogReader::Open(const std::string &path) {
+  Close();
+
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat st {};
+  if (fstat(fd, &st) != 0) {
+    auto error = errno;
+    close(fd);
+    errno = error;
+    return false;
+  }
+
+  size_t size = st.st_size;
+  void *data = nullptr;
+  if (size >= sizeof(LogFileHeader)) {
+    data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);  // The mapping keeps the file referenced
+  if (!data || data == MAP_FAILED) {
+    errno = data ? errno : EINVAL;
+    return false;
+  }
+  madvise(data, size, MADV_SEQUENTIAL);
+
+  data_ = static_cast<const uint8_t *>(data);
+  size_ = size;
+  memcpy(&header_, data_, sizeof(header_));
+
+  if (memcmp(header_.magic, kLogFileMagic, sizeof(kLogFileMagic)) != 0 ||
+      header_.version != kLogFormatVersion || header_.block_size == 0 ||
+      header_.header_size > header_.block_size ||
+      header_.block_size > size_) {
+    Close();
+    errno = EINVAL;
+    return false;
+  }
+
+  // Topic table
+  uint32_t offset = sizeof(LogFileHeader);
+  for (uint32_t i = 0; i < header_.topic_count; ++i) {
+    LogTopicDesc desc{};
+    if (offset + sizeof(desc) > header_.header_size) break;
+    memcpy(&desc, data_ + offset, sizeof(desc));
+
+    auto strings =
+        reinterpret_cast<const char *>(data_ + offset + sizeof(desc));
+    if (offset + sizeof(desc) + desc.name_len + desc.fields_len >
+        header_.header_size) {
+      break;
+    }
+
+    LogTopic topic;
+    topic.name.assign(strings, desc.name_len);
+    topic.fields.assign(strings + desc.name_len, desc.fields_len);
+    topic.size = desc.size;
+    topic.size_no_padding = desc.size_no_padding;
+    topic.queue_size = desc.queue_size;
+    topics_.push_back(std::move(topic));
+
+    offset += LogAlignUp(sizeof(desc) + desc.name_len + desc.fields_len,
+                         kLogRecordAlignment);
+  }
+
+  if (topics_.size() != header_.topic_count) {
+    Close();
+    errno = EINVAL;
+    return false;
+  }
+
+  BuildIndex();
+  return true;
+}
+
+void uorb::logger::LogReader::BuildIndex() {
+  topic_index_.assign(topics_.size(), {});
+
+  // Only the block headers are read here, except for data blocks that are
+  // not covered by an index block (e.g. the end of a crashed recording).
+  std::vector<size_t> unindexed;
+  std::vector<uint8_t> indexed(block_count() + 1, 0);
+  const size_t block_size = header_.block_size;
+  for (size_t offset = block_size; offset + block_size <= size_;
+       offset += block_size) {
+    if (BlockAt(offset)) {
+      if (!indexed[offset / block_size]) unindexed.push_back(offset);
+      continue;
+    }
+    if (!IsIndexBlock(offset)) continue;
+
+    auto &block = *reinterpret_cast<const LogBlockHeader *>(data_ + offset);
+    auto entries = reinterpret_cast<const LogIndexEntry *>(&block + 1);
+    const size_t max_entries =
+        (block.used - sizeof(LogBlockHeader)) / sizeof(LogIndexEntry);
+    for (size_t i = 0; i < std::min<size_t>(block.record_count, max_entries);
+         ++i) {
+      const auto &entry = entries[i];
+      if (entry.topic >= topics_.size() || entry.block_offset % block_size ||
+          !BlockAt(entry.block_offset)) {
+        continue;
+      }
+      topic_index_[entry.topic].push_back(entry);
+      indexed[entry.block_offset / block_size] = 1;
+    }
+  }
+
+  // Index blocks come after the data blocks they describe, so the data
+  // blocks without an index are only known now
+  for (auto offset : unindexed) {
+    if (indexed[offset / block_size]) continue;
+
+    auto &block = *BlockAt(offset);
+    std::vector<uint8_t> seen(topics_.size(), 0);
+    Cursor cursor{offset, sizeof(LogBlockHeader), 0};
+    LogRecord record{};
+    while (true) {
+      const auto record_cursor = cursor;
+      if (!ReadRecord(block, &cursor, &record)) break;
+      if (seen[record.topic]) continue;
+      seen[record.topic] = 1;
+
+      LogIndexEntry entry{};
+      entry.timestamp = record.timestamp;
+      entry.block_offset = offset;
+      entry.offset = record_cursor.offset;
+      entry.record = record_cursor.record;
+      entry.topic = record.topic;
+      topic_index_[record.topic].push_back(entry);
+    }
+  }
+
+  auto by_offset = [](const LogIndexEntry &a, const LogIndexEntry &b) {
+    return a.block_offset < b.block_offset;
+  };
+  block_index_.clear();
+  for (auto &entries : topic_index_) {
+    std::sort(entries.begin(), entries.end(), by_offset);
+    for (const auto &entry : entries) {
+      if (entry.record == 0) block_index_.push_back(entry);
+    }
+  }
+  std::sort(block_index_.begin(), block_index_.end(), by_offset);
+}
+
+void uorb::logger::LogReader::Close() {
+  if (data_) munmap(const_cast<uint8_t *>(data_), size_);
+  data_ = nullptr;
+  size_ = 0;
+  header_ = {};
+  topics_.clear();
+  block_index_.clear();
+  topic_index_.clear();
+}
+
+size_t uorb::logger::LogReader::block_count() const {
+  return is_open() ? size_ / header_.block_size - 1 : 0;
+}
+
+int uorb::logger::LogReader::FindTopic(const std::string &name) const {
+  for (size_t i = 0; i < topics_.size(); ++i) {
+    if (topics_[i].name == name) return i;
+  }
+  return -1;
+}
+
+uorb::logger::LogReader::Cursor uorb::logger::LogReader::Begin() const {
+  return {header_.block_size, sizeof(LogBlockHeader), 0};
+}
+
+uorb::logger::LogReader::Cursor uorb::logger::LogReader::End() const {
+  return {size_, sizeof(LogBlockHeader), 0};
+}
+
+uint64_t uorb::logger::LogReader::first_timestamp() const {
+  return block_index_.empty() ? 0 : block_index_.front().timestamp;
+}
+
+const uorb::logger::LogBlockHeader *uorb::logger::LogReader::BlockAt(
+    size_t block_offset) const {
+  if (!data_ || block_offset + header_.block_size > size_) return nullptr;
+
+  auto block = reinterpret_cast<const LogBlockHeader *>(data_ + block_offset);
+  if (block->magic != kLogBlockMagic || block->used > header_.block_size) {
+    return nullptr;
+  }
+  return block;
+}
+
+bool uorb::logger::LogReader::IsIndexBlock(size_t block_offset) const {
+  if (!data_ || block_offset + header_.block_size > size_) return false;
+
+  auto block = reinterpret_cast<const LogBlockHeader *>(data_ + block_offset);
+  return block->magic == kLogIndexMagic &&
+         block->used >= sizeof(LogBlockHeader) &&
+         block->used <= header_.block_size;
+}
+
+bool uorb::logger::LogReader::ReadRecord(const LogBlockHeader &block,
+                                         Cursor *cursor,
+                                         LogRecord *record) const {
+  if (cursor->record >= block.record_count ||
+      cursor->offset + sizeof(LogRecordHeader) > block.used) {
+    return false;
+  }
+
+  auto block_data = reinterpret_cast<const uint8_t *>(&block);
+  auto &header =
+      *reinterpret_cast<const LogRecordHeader *>(block_data + cursor->offset);
+  const uint32_t record_size =
+      sizeof(LogRecordHeader) + LogAlignUp(header.size, kLogRecordAlignment);
+  if (cursor->offset + record_size > block.used ||
+      header.topic >= topics_.size()) {
+    return false;  // Corrupted block, skip the rest of it
+  }
+
+  record->topic = header.topic;
+  record->instance = header.instance;
+  record->timestamp = header.timestamp;
+  record->data = &header + 1;
+  record->size = header.size;
+
+  cursor->offset += record_size;
+  cursor->record++;
+  return true;
+}
+
+bool uorb::logger::LogReader::Next(Cursor *cursor, LogRecord *record) const {
+  while (true) {
+    auto block = BlockAt(cursor->block_offset);
+    if (!block && !IsIndexBlock(cursor->block_offset)) return false;
+    if (block && ReadRecord(*block, cursor, record)) return true;
+
+    // Continue with the next block
+    cursor->block_offset += header_.block_size;
+    cursor->offset = sizeof(LogBlockHeader);
+    cursor->record = 0;
+  }
+}
+
+bool uorb::logger::LogReader::Next(uint16_t topic, Cursor *cursor,
+                                   LogRecord *record) const {
+  if (topic >= topic_index_.size()) return false;
+  const auto &entries = topic_index_[topic];
+
+  while (true) {
+    auto block = BlockAt(cursor->block_offset);
+    if (!block) return false;
+    while (ReadRecord(*block, cursor, record)) {
+      if (record->topic == topic) return true;
+    }
+
+    // Jump to the next block with a record of the topic
+    auto next = std::upper_bound(
+        entries.begin(), entries.end(), cursor->block_offset,
+        [](size_t offset, const LogIndexEntry &entry) {
+          return offset < entry.block_offset;
+        });
+    if (next == entries.end()) {
+      *cursor = End();
+      return false;
+    }
+    *cursor = {next->block_offset, next->offset, next->record};
+  }
+}
+
+uint64_t uorb::logger::LogReader::LatestTimestamp(size_t block_offset) const {
+  uint64_t latest = 0;
+  auto block = BlockAt(block_offset);
+  if (!block) return latest;
+
+  Cursor cursor{block_offset, sizeof(LogBlockHeader), 0};
+  LogRecord record{};
+  while (ReadRecord(*block, &cursor, &record)) {
+    latest = std::max(latest, record.timestamp);
+  }
+  return latest;
+}
+
+uorb::logger::LogReader::Cursor uorb::logger::LogReader::Seek(
+    uint64_t timestamp) const {
+  // The last block that starts at or before the timestamp
+  auto block = std::upper_bound(
+      block_index_.begin(), block_index_.end(), timestamp,
+      [](uint64_t timestamp, const LogIndexEntry &entry) {
+        return timestamp < entry.timestamp;
+      });
+  if (block != block_index_.begin()) --block;
+  // The blocks before may still have records at or after the timestamp, see
+  // uorb_log_format.h
+  while (block != block_index_.begin() &&
+         LatestTimestamp((block - 1)->block_offset) >= timestamp) {
+    --block;
+  }
+
+  auto cursor = block == block_index_.end()
+                    ? Begin()
+                    : Cursor{block->block_offset, block->offset, block->record};
+  LogRecord record{};
+  for (auto next = cursor; Next(&next, &record); cursor = next) {
+    if (record.timestamp >= timestamp) return cursor;
+  }
+  return End();
+}
+
+uorb::logger::LogReader::Cursor uorb::logger::LogReader::Seek(
+    uint16_t topic, uint64_t timestamp) const {
+  if (topic >= topic_index_.size() || topic_index_[topic].empty()) {
+    return End();
+  }
+  const auto &entries = topic_index_[topic];
+
+  auto block = std::upper_bound(
+      entries.begin(), entries.end(), timestamp,
+      [](uint64_t timestamp, const LogIndexEntry &entry) {
+        return timestamp < entry.timestamp;
+      });
+  if (block != entries.begin()) --block;
+
+  Cursor cursor{block->block_offset, block->offset, block->record};
+  LogRecord record{};
+  for (auto next = cursor; Next(topic, &next, &record); cursor = next) {
+    if (record.timestamp >= timestamp) return cursor;
+  }
+  return End();
+}
@@ -0,0 +1,351 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include "uorb_recorder.h"
+
+#include <uorb/abs_time.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "block_writer.h"
+#include "uorb_log_format.h"
+
+// Index entries kept while no block is free for an index block
+static constexpr size_t kMaxPendingIndexBlocks = 4;
+
+static uint32_t RecordSize(const orb_metadata &meta) {
+  return sizeof(uorb::logger::LogRecordHeader) +
+         uorb::logger::LogAlignUp(meta.o_size,
+                                  uorb::logger::kLogRecordAlignment);
+}
+
+uorb::logger::Recorder::Recorder(RecorderConfig config)
+    : config_(std::move(config)) {}
+
+uorb::logger::Recorder::~Recorder() { Stop(); }
+
+bool uorb::logger::Recorder::Start(const std::string &path) {
+  if (running()) {
+    errno = EBUSY;
+    return false;
+  }
+
+  if (config_.block_size == 0 || config_.block_size % kLogAlignment != 0 ||
+      config_.block_count < 2 || (!config_.topics && config_.topic_count)) {
+    errno = EINVAL;
+    return false;
+  }
+
+  std::vector<const orb_metadata *> topics;
+  if (!SelectTopics(config_.topics, config_.topic_count, config_.topic_names,
+                    &topics)) {
+    return false;
+  }
+
+  uint32_t max_size = 0;
+  uint32_t max_record_size = 0;
+  uint32_t min_record_size = UINT32_MAX;
+  for (auto meta : topics) {
+    max_size = std::max(max_size, uint32_t(meta->o_size));
+    max_record_size = std::max(max_record_size, RecordSize(*meta));
+    min_record_size = std::min(min_record_size, RecordSize(*meta));
+  }
+  if (sizeof(LogBlockHeader) + max_record_size > config_.block_size) {
+    errno = EINVAL;  // A message does not fit in a block
+    return false;
+  }
+  scratch_.resize(max_size);
+  sorted_block_.resize(config_.block_size);
+  // A block full of the smallest records is copied at once
+  infos_.resize(std::max<size_t>(
+      1, (config_.block_size - sizeof(LogBlockHeader)) / min_record_size));
+
+  writer_.reset(new BlockWriter(config_.block_size, config_.block_count));
+  if (!writer_->Open(path, config_.direct_io)) return false;
+  if (!WriteFileHeader(topics)) {
+    auto error = errno;
+    writer_->Close();
+    errno = error;
+    return false;
+  }
+
+  block_ = nullptr;
+  block_sequence_ = 0;
+  dropped_since_block_ = 0;
+  file_offset_ = config_.block_size;  // After the file header
+  block_index_.clear();
+  topic_in_block_.assign(topics.size(), 0);
+  pending_index_.clear();
+  blocks_since_index_ = 0;
+  index_sequence_ = 0;
+  records_ = 0;
+  dropped_ = 0;
+  StartCollecting(std::move(topics), config_.flush_interval_ms);
+  return true;
+}
+
+void uorb::logger::Recorder::Stop() {
+  if (!running()) return;
+
+  StopCollecting();
+  writer_->Close();
+}
+
+uorb::logger::RecorderStatus uorb::logger::Recorder::status() const {
+  RecorderStatus status{};
+  status.records = records_;
+  status.dropped = dropped_;
+  if (writer_) {
+    status.bytes = writer_->bytes_written();
+    status.write_errors = writer_->write_errors();
+    status.direct_io = writer_->direct_io();
+  }
+  return status;
+}
+
+bool uorb::logger::Recorder::WriteFileHeader(
+    const std::vector<const orb_metadata *> &topics) {
+  auto block = writer_->Acquire();
+  memset(block, 0, config_.block_size);
+
+  auto &header = *reinterpret_cast<LogFileHeader *>(block);
+  memcpy(header.magic, kLogFileMagic, sizeof(header.magic));
+  header.version = kLogFormatVersion;
+  header.block_size = config_.block_size;
+  header.topic_count = topics.size();
+  header.start_time_us = orb_monotonic_time_us();
+
+  uint32_t used = sizeof(LogFileHeader);
+  for (auto meta : topics) {
+    const uint32_t name_len = strlen(meta->o_name);
+    const uint32_t fields_len = meta->o_fields ? strlen(meta->o_fields) : 0;
+    const uint32_t desc_size = LogAlignUp(
+        sizeof(LogTopicDesc) + name_len + fields_len, kLogRecordAlignment);
+    if (used + desc_size > config_.block_size) {
+      writer_->Release(block);
+      errno = ENOSPC;  // The topic table does not fit in a block
+      return false;
+    }
+
+    auto &desc = *reinterpret_cast<LogTopicDesc *>(block + used);
+    desc.size = meta->o_size;
+    desc.size_no_padding = meta->o_size_no_padding;
+    // Informational, clamped to the width of the log format
+    desc.queue_size = meta->o_queue_size < UINT16_MAX ? meta->o_queue_size
+                                                      : UINT16_MAX;
+    desc.name_len = name_len;
+    desc.fields_len = fields_len;
+    auto strings = reinterpret_cast<char *>(&desc + 1);
+    memcpy(strings, meta->o_name, name_len);
+    memcpy(strings + name_len, meta->o_fields, fields_len);
+    used += desc_size;
+  }
+  header.header_size = used;
+
+  writer_->Submit(block, config_.block_size);
+  return true;
+}
+
+bool uorb::logger::Recorder::NextBlock() {
+  block_ = writer_->TryAcquire();
+  if (!block_) return false;
+
+  auto &header = *reinterpret_cast<LogBlockHeader *>(block_);
+  header.magic = kLogBlockMagic;
+  header.sequence = block_sequence_++;
+  header.dropped = dropped_since_block_;
+  dropped_since_block_ = 0;
+
+  block_used_ = sizeof(LogBlockHeader);
+  block_records_ = 0;
+  block_index_.clear();
+  std::fill(topic_in_block_.begin(), topic_in_block_.end(), 0);
+  return true;
+}
+
+void uorb::logger::Recorder::SortCurrentBlock() {
+  // Position of every record, in the order they were drained
+  struct Record {
+    uint64_t timestamp;
+    uint32_t offset;
+    uint32_t size;
+  };
+  std::vector<Record> records;
+  records.reserve(block_records_);
+  bool sorted = true;
+  for (uint32_t offset = sizeof(LogBlockHeader); offset < block_used_;) {
+    const auto &header =
+        *reinterpret_cast<const LogRecordHeader *>(block_ + offset);
+    const uint32_t size = sizeof(LogRecordHeader) +
+                          LogAlignUp(header.size, kLogRecordAlignment);
+    if (!records.empty() && header.timestamp < records.back().timestamp) {
+      sorted = false;
+    }
+    records.push_back({header.timestamp, offset, size});
+    offset += size;
+  }
+
+  // Stable: the records of a topic instance keep their order
+  if (!sorted) {
+    std::stable_sort(records.begin(), records.end(),
+                     [](const Record &a, const Record &b) {
+                       return a.timestamp < b.timestamp;
+                     });
+    uint32_t to = sizeof(LogBlockHeader);
+    for (const auto &record : records) {
+      memcpy(sorted_block_.data() + to, block_ + record.offset, record.size);
+      to += record.size;
+    }
+    memcpy(block_ + sizeof(LogBlockHeader),
+           sorted_block_.data() + sizeof(LogBlockHeader),
+           block_used_ - sizeof(LogBlockHeader));
+  }
+
+  // The first record of each topic, once the records are in place
+  uint32_t offset = sizeof(LogBlockHeader);
+  for (uint32_t i = 0; i < records.size(); ++i) {
+    const auto &header =
+        *reinterpret_cast<const LogRecordHeader *>(block_ + offset);
+    if (!topic_in_block_[header.topic]) {
+      topic_in_block_[header.topic] = 1;
+      LogIndexEntry entry{};
+      entry.timestamp = header.timestamp;
+      entry.offset = offset;
+      entry.record = i;
+      entry.topic = header.topic;
+      block_index_.push_back(entry);
+    }
+    offset += records[i].size;
+  }
+}
+
+void uorb::logger::Recorder::SubmitCurrentBlock() {
+  if (!block_ || !block_records_) return;
+
+  SortCurrentBlock();
+
+  auto &header = *reinterpret_cast<LogBlockHeader *>(block_);
+  header.used = block_used_;
+  header.record_count = block_records_;
+  memset(block_ + block_used_, 0, config_.block_size - block_used_);
+
+  writer_->Submit(block_, config_.block_size);
+  block_ = nullptr;
+
+  if (!config_.index_interval) return;
+  for (auto &entry : block_index_) {
+    entry.block_offset = file_offset_;
+    pending_index_.push_back(entry);
+  }
+  file_offset_ += config_.block_size;
+  if (++blocks_since_index_ >= config_.index_interval) WriteIndex(false);
+}
+
+void uorb::logger::Recorder::WriteIndex(bool blocking) {
+  const size_t capacity =
+      (config_.block_size - sizeof(LogBlockHeader)) / sizeof(LogIndexEntry);
+
+  size_t written = 0;
+  while (written < pending_index_.size()) {
+    auto block = blocking ? writer_->Acquire() : writer_->TryAcquire();
+    if (!block) break;
+
+    // Keep the entries of a data block in one index block if possible
+    size_t count = std::min(capacity, pending_index_.size() - written);
+    if (written + count < pending_index_.size()) {
+      auto boundary = count;
+      while (boundary && pending_index_[written + boundary - 1].block_offset ==
+                             pending_index_[written + boundary].block_offset) {
+        --boundary;
+      }
+      if (boundary) count = boundary;
+    }
+
+    const uint32_t used =
+        sizeof(LogBlockHeader) + count * sizeof(LogIndexEntry);
+    auto &header = *reinterpret_cast<LogBlockHeader *>(block);
+    header.magic = kLogIndexMagic;
+    header.used = used;
+    header.sequence = index_sequence_++;
+    header.record_count = count;
+    header.dropped = 0;
+    memcpy(&header + 1, &pending_index_[written],
+           count * sizeof(LogIndexEntry));
+    memset(block + used, 0, config_.block_size - used);
+
+    writer_->Submit(block, config_.block_size);
+    file_offset_ += config_.block_size;
+    written += count;
+  }
+  pending_index_.erase(pending_index_.begin(),
+                       pending_index_.begin() + written);
+  blocks_since_index_ = 0;
+
+  // Retry with the next data block, unless the I/O thread is far behind;
+  // readers index the blocks that are not covered themselves.
+  if (pending_index_.size() > kMaxPendingIndexBlocks * capacity) {
+    pending_index_.clear();
+  }
+}
+
+void uorb::logger::Recorder::Drain(const Subscription &sub) {
+  const auto &meta = *sub.meta;
+  const uint32_t record_size = RecordSize(meta);
+
+  for (;;) {
+    if (!block_ || block_used_ + record_size > config_.block_size) {
+      SubmitCurrentBlock();
+      if (!block_ && !NextBlock()) {
+        // The I/O thread is behind, consume the messages and count them
+        int count;
+        do {
+          count = orb_copy_batch(sub.handle, scratch_.data(), 0,
+                                 infos_.size(), infos_.data());
+          if (count <= 0) break;
+          dropped_ += count;
+          dropped_since_block_ += count;
+        } while (unsigned(count) == infos_.size());
+        return;
+      }
+    }
+
+    // Copy the unread messages directly into the records of the block, there
+    // is no intermediate buffer
+    const unsigned room = (config_.block_size - block_used_) / record_size;
+    auto records = block_ + block_used_;
+    const int count =
+        orb_copy_batch(sub.handle, records + sizeof(LogRecordHeader),
+                       record_size, std::min<size_t>(room, infos_.size()),
+                       infos_.data());
+    if (count <= 0) return;
+
+    for (int i = 0; i < count; ++i) {
+      auto &header =
+          *reinterpret_cast<LogRecordHeader *>(records + i * record_size);
+      auto payload = reinterpret_cast<uint8_t *>(&header + 1);
+      header.topic = sub.topic_id;
+      header.instance = sub.instance;
+      header.reserved = 0;
+      header.size = meta.o_size;
+      // The publish time, the drain may run much later. The block is
+      // sorted by it before it is written, see SortCurrentBlock().
+      header.timestamp = infos_[i].timestamp;
+      memset(payload + meta.o_size, 0,
+             record_size - sizeof(LogRecordHeader) - meta.o_size);
+
+      block_used_ += record_size;
+      ++block_records_;
+    }
+    records_ += count;
+    if (unsigned(count) < room) return;
+  }
+}
+
+void uorb::logger::Recorder::OnStopped() {
+  SubmitCurrentBlock();
+  if (block_) writer_->Release(block_);
+  block_ = nullptr;
+  if (!pending_index_.empty()) WriteIndex(true);
+}
@@ -0,0 +1,177 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include "uorb_replayer.h"
+
+#include <uorb/abs_time.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <thread>
+
+using namespace uorb::time_literals;
+
+// Longest sleep, so that Stop() is handled in time
+static constexpr orb_abstime_us kMaxSleep = 100_ms;
+// Polling period while waiting for subscribers to catch up
+static constexpr orb_abstime_us kBacklogPollInterval = 50_us;
+
+uorb::logger::Replayer::Replayer(ReplayConfig config)
+    : config_(std::move(config)) {}
+
+uorb::logger::Replayer::~Replayer() { DestroyPublications(); }
+
+bool uorb::logger::Replayer::Open(const std::string &path) {
+  DestroyPublications();
+
+  if ((config_.mode == ReplayMode::kScaled && !(config_.speed > 0)) ||
+      (!config_.topics && config_.topic_count)) {
+    errno = EINVAL;
+    return false;
+  }
+
+  if (!reader_.Open(path)) return false;
+
+  for (const auto &topic : reader_.topics()) {
+    TopicPublication pub{};
+    auto selected = config_.topic_names.empty() ||
+                    std::count(config_.topic_names.begin(),
+                               config_.topic_names.end(), topic.name);
+    for (size_t i = 0; selected && i < config_.topic_count; ++i) {
+      auto meta = config_.topics[i];
+      if (topic.name == meta->o_name && topic.size == meta->o_size) {
+        pub.meta = meta;
+      }
+    }
+    publications_.push_back(pub);
+  }
+
+  published_ = 0;
+  skipped_ = 0;
+  overruns_ = 0;
+  return true;
+}
+
+void uorb::logger::Replayer::DestroyPublications() {
+  for (auto &pub : publications_) {
+    for (auto &handle : pub.handles) {
+      if (handle) orb_destroy_publication(&handle);
+    }
+  }
+  publications_.clear();
+}
+
+uorb::logger::ReplayStatus uorb::logger::Replayer::status() const {
+  ReplayStatus status{};
+  status.published = published_;
+  status.skipped = skipped_;
+  status.overruns = overruns_;
+  return status;
+}
+
+orb_publication_t *uorb::logger::Replayer::GetPublication(
+    const LogRecord &record) {
+  if (record.topic >= publications_.size() ||
+      record.instance >= ORB_MULTI_MAX_INSTANCES) {
+    return nullptr;
+  }
+
+  auto &pub = publications_[record.topic];
+  if (!pub.meta) return nullptr;
+
+  // Advertise the lower instances too, so the instance numbers match the
+  // recording when the topic has no other publishers.
+  for (uint8_t i = 0; i <= record.instance; ++i) {
+    if (pub.handles[i]) continue;
+
+    unsigned instance;
+    pub.handles[i] = orb_create_publication_multi(pub.meta, &instance);
+    if (!pub.handles[i]) return nullptr;
+
+    orb_status status{};
+    orb_get_topic_status(pub.meta, instance, &status);
+    pub.instances[i] = instance;
+    pub.queue_sizes[i] = status.queue_size;
+  }
+  return pub.handles[record.instance];
+}
+
+void uorb::logger::Replayer::WaitForSubscribers(const LogRecord &record,
+                                                orb_publication_t *handle) {
+  auto &pub = publications_[record.topic];
+  auto &queue_size = pub.queue_sizes[record.instance];
+  const auto start_time = orb_absolute_time_us();
+
+  // Publishing now would overwrite a message a subscriber has not copied yet
+  while (orb_get_subscriber_backlog(handle) >= queue_size && !should_exit_) {
+    // Subscriptions may have changed the queue size since
+    orb_status status{};
+    if (orb_get_topic_status(pub.meta, pub.instances[record.instance],
+                             &status) &&
+        status.queue_size != queue_size) {
+      queue_size = status.queue_size;
+      continue;
+    }
+
+    if (config_.backlog_timeout_ms &&
+        orb_elapsed_time_us(start_time) >= config_.backlog_timeout_ms * 1_ms) {
+      ++overruns_;
+      return;
+    }
+    std::this_thread::sleep_for(
+        std::chrono::microseconds(kBacklogPollInterval));
+  }
+}
+
+bool uorb::logger::Replayer::Run() {
+  if (!reader_.is_open()) {
+    errno = EBADF;
+    return false;
+  }
+
+  should_exit_ = false;
+
+  const double speed =
+      config_.mode == ReplayMode::kScaled ? config_.speed : 1.0;
+  const auto start_time = orb_absolute_time_us();
+  uint64_t first_timestamp = 0;
+  bool first_record = true;
+
+  auto cursor = config_.start_timestamp ? reader_.Seek(config_.start_timestamp)
+                                        : reader_.Begin();
+  LogRecord record{};
+  while (!should_exit_ && reader_.Next(&cursor, &record)) {
+    auto handle = GetPublication(record);
+    if (!handle) {
+      ++skipped_;
+      continue;
+    }
+
+    if (first_record) {
+      first_timestamp = record.timestamp;
+      first_record = false;
+    }
+
+    if (config_.mode == ReplayMode::kAsFastAsPossible) {
+      WaitForSubscribers(record, handle);
+    } else {
+      // Records can be slightly older than the first one, see
+      // uorb_log_format.h: they are published right away
+      const uint64_t elapsed = record.timestamp > first_timestamp
+                                   ? record.timestamp - first_timestamp
+                                   : 0;
+      const orb_abstime_us publish_time = start_time + elapsed / speed;
+      orb_abstime_us now;
+      while ((now = orb_absolute_time_us()) < publish_time && !should_exit_) {
+        std::this_thread::sleep_for(std::chrono::microseconds(
+            std::min(publish_time - now, kMaxSleep)));
+      }
+    }
+    if (should_exit_) break;
+
+    if (orb_publish(handle, record.data)) ++published_;
+  }
+
+  return true;
+}
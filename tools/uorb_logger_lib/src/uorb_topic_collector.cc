@@ -0,0 +1,112 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include "uorb_topic_collector.h"
+
+#include <uorb/abs_time.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+
+using namespace uorb::time_literals;
+
+// How often new topic instances are looked for
+static constexpr orb_abstime_us kScanInterval = 500_ms;
+static constexpr int kPollTimeoutMs = 100;
+
+bool uorb::logger::SelectTopics(
+    const struct orb_metadata *const *topics, size_t topic_count,
+    const std::vector<std::string> &names,
+    std::vector<const struct orb_metadata *> *selected) {
+  selected->clear();
+  for (size_t i = 0; topics && i < topic_count; ++i) {
+    auto meta = topics[i];
+    if (names.empty() ||
+        std::count(names.begin(), names.end(), meta->o_name)) {
+      selected->push_back(meta);
+    }
+  }
+
+  if (!names.empty() && selected->size() != names.size()) {
+    errno = ENOENT;  // Some of the requested topics are unknown
+    return false;
+  }
+  return true;
+}
+
+void uorb::logger::TopicCollector::StartCollecting(
+    std::vector<const struct orb_metadata *> topics,
+    uint32_t periodic_interval_ms) {
+  topics_ = std::move(topics);
+  periodic_interval_ms_ = periodic_interval_ms;
+  should_exit_ = false;
+  thread_ = std::thread{&TopicCollector::CollectorThread, this};
+}
+
+void uorb::logger::TopicCollector::StopCollecting() {
+  if (!collecting()) return;
+
+  should_exit_ = true;
+  thread_.join();
+}
+
+void uorb::logger::TopicCollector::SubscribeNewInstances() {
+  for (uint16_t topic_id = 0; topic_id < topics_.size(); ++topic_id) {
+    auto meta = topics_[topic_id];
+    for (uint8_t instance = 0; instance < ORB_MULTI_MAX_INSTANCES;
+         ++instance) {
+      auto subscribed =
+          std::any_of(subscriptions_.begin(), subscriptions_.end(),
+                      [&](const Subscription &sub) {
+                        return sub.topic_id == topic_id &&
+                               sub.instance == instance;
+                      });
+      if (subscribed || !orb_exists(meta, instance)) continue;
+
+      auto handle = orb_create_subscription_multi(meta, instance);
+      if (!handle) continue;
+
+      uint16_t index = subscriptions_.size();
+      subscriptions_.push_back({meta, topic_id, instance, index, handle});
+      OnSubscribed(subscriptions_.back());
+    }
+  }
+}
+
+void uorb::logger::TopicCollector::CollectorThread() {
+  std::vector<orb_pollfd> fds;
+  orb_abstime_us last_scan_time = 0;
+  orb_abstime_us last_periodic_time = orb_absolute_time_us();
+
+  while (!should_exit_) {
+    if (orb_elapsed_time_us(last_scan_time) >= kScanInterval) {
+      last_scan_time = orb_absolute_time_us();
+      SubscribeNewInstances();
+      fds.clear();
+      for (const auto &sub : subscriptions_) {
+        fds.push_back({sub.handle, POLLIN, 0});
+      }
+    }
+
+    if (fds.empty()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(kPollTimeoutMs));
+    } else {
+      orb_poll(fds.data(), fds.size(), kPollTimeoutMs);
+      for (const auto &sub : subscriptions_) Drain(sub);
+    }
+
+    if (orb_elapsed_time_us(last_periodic_time) >=
+        periodic_interval_ms_ * 1_ms) {
+      last_periodic_time = orb_absolute_time_us();
+      OnPeriodic();
+    }
+  }
+
+  // Collect what is left
+  for (const auto &sub : subscriptions_) Drain(sub);
+  OnStopped();
+
+  for (auto &sub : subscriptions_) orb_destroy_subscription(&sub.handle);
+  subscriptions_.clear();
+}
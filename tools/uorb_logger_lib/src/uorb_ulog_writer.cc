@@ -0,0 +1,307 @@
+//
+// Copyright (c) 2021 shawnfeng. All rights reserved.
+//
+#include "uorb_ulog_writer.h"
+
+#include <uorb/abs_time.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "block_writer.h"
+
+// ULog file format:
+// https://docs.px4.io/main/en/dev_log/ulog_file_format.html
+static constexpr uint8_t kULogMagic[] = {'U', 'L', 'o', 'g', 0x01, 0x12, 0x35};
+static constexpr uint8_t kULogVersion = 1;
+static constexpr uint8_t kULogSyncMagic[] = {0x2F, 0x73, 0x13, 0x20,
+                                             0x25, 0x0C, 0xBB, 0x12};
+static constexpr uint32_t kULogMessageHeaderSize = 3;  // uint16 size, char type
+static constexpr uint32_t kULogMaxPayloadSize = UINT16_MAX;
+
+enum ULogMessageType : char {
+  kULogFlagBits = 'B',
+  kULogFormat = 'F',
+  kULogInfo = 'I',
+  kULogAddLogged = 'A',
+  kULogData = 'D',
+  kULogSync = 'S',
+  kULogDropout = 'O',
+};
+
+static const char *const kULogBasicTypes[] = {
+    "int8_t", "uint8_t",  "int16_t", "uint16_t", "int32_t", "uint32_t",
+    "int64_t", "uint64_t", "float",   "double",   "bool",    "char"};
+
+static uint8_t *PutMessageHeader(uint8_t *dst, uint32_t payload_size,
+                                 char type) {
+  uint16_t size = payload_size;
+  memcpy(dst, &size, sizeof(size));
+  dst[2] = type;
+  return dst + kULogMessageHeaderSize;
+}
+
+static uint32_t DataSize(const orb_metadata &meta) {
+  return meta.o_size_no_padding ? meta.o_size_no_padding : meta.o_size;
+}
+
+// Split "uint8_t[4] _padding0;float x;" into {"uint8_t[4] _padding0", ...}
+static std::vector<std::string> SplitFields(const char *fields) {
+  std::vector<std::string> result;
+  std::string field;
+  for (auto p = fields; p && *p; ++p) {
+    if (*p == ';') {
+      if (!field.empty()) result.push_back(field);
+      field.clear();
+    } else {
+      field += *p;
+    }
+  }
+  if (!field.empty()) result.push_back(field);
+  return result;
+}
+
+uorb::logger::ULogWriter::ULogWriter(ULogWriterConfig config)
+    : config_(std::move(config)) {}
+
+uorb::logger::ULogWriter::~ULogWriter() { Stop(); }
+
+bool uorb::logger::ULogWriter::Start(const std::string &path) {
+  if (running()) {
+    errno = EBUSY;
+    return false;
+  }
+
+  if (config_.buffer_size < 1024 || config_.buffer_count < 2 ||
+      (!config_.topics && config_.topic_count)) {
+    errno = EINVAL;
+    return false;
+  }
+
+  std::vector<const orb_metadata *> topics;
+  if (!SelectTopics(config_.topics, config_.topic_count, config_.topic_names,
+                    &topics)) {
+    return false;
+  }
+
+  uint32_t max_size = 0;
+  for (auto meta : topics) {
+    max_size = std::max(max_size, uint32_t(meta->o_size));
+  }
+  const uint32_t max_data_message_size =
+      kULogMessageHeaderSize + sizeof(uint16_t) + max_size;
+  if (max_data_message_size - kULogMessageHeaderSize > kULogMaxPayloadSize ||
+      max_data_message_size > config_.buffer_size) {
+    errno = EINVAL;  // A message does not fit in a buffer
+    return false;
+  }
+  scratch_.resize(max_size);
+
+  writer_.reset(new BlockWriter(config_.buffer_size, config_.buffer_count));
+  if (!writer_->Open(path, false)) return false;
+
+  buffer_ = nullptr;
+  dropout_start_us_ = 0;
+  messages_ = 0;
+  dropped_ = 0;
+  if (!WriteDefinitions(topics)) {
+    auto error = errno;
+    OnStopped();
+    writer_->Close();
+    errno = error;
+    return false;
+  }
+
+  StartCollecting(std::move(topics), config_.flush_interval_ms);
+  return true;
+}
+
+void uorb::logger::ULogWriter::Stop() {
+  if (!running()) return;
+
+  StopCollecting();
+  writer_->Close();
+}
+
+uorb::logger::ULogWriterStatus uorb::logger::ULogWriter::status() const {
+  ULogWriterStatus status{};
+  status.messages = messages_;
+  status.dropped = dropped_;
+  if (writer_) {
+    status.bytes = writer_->bytes_written();
+    status.write_errors = writer_->write_errors();
+  }
+  return status;
+}
+
+uint8_t *uorb::logger::ULogWriter::Reserve(uint32_t size, bool blocking) {
+  if (buffer_ && buffer_used_ + size > config_.buffer_size) {
+    SubmitCurrentBuffer();
+  }
+
+  if (!buffer_) {
+    buffer_ = blocking ? writer_->Acquire() : writer_->TryAcquire();
+    if (!buffer_) return nullptr;
+    buffer_used_ = 0;
+  }
+  return buffer_ + buffer_used_;
+}
+
+void uorb::logger::ULogWriter::SubmitCurrentBuffer() {
+  if (!buffer_ || !buffer_used_) return;
+
+  writer_->Submit(buffer_, buffer_used_);
+  buffer_ = nullptr;
+}
+
+bool uorb::logger::ULogWriter::WriteMessage(char type, const void *payload,
+                                            uint32_t size, bool blocking) {
+  if (size > kULogMaxPayloadSize ||
+      size + kULogMessageHeaderSize > config_.buffer_size) {
+    errno = EINVAL;
+    return false;
+  }
+
+  auto dst = Reserve(kULogMessageHeaderSize + size, blocking);
+  if (!dst) return false;
+
+  memcpy(PutMessageHeader(dst, size, type), payload, size);
+  buffer_used_ += kULogMessageHeaderSize + size;
+  return true;
+}
+
+bool uorb::logger::ULogWriter::WriteInfo(const std::string &key,
+                                         const std::string &value) {
+  // "char[len] key" followed by the value
+  auto key_with_type = "char[" + std::to_string(value.size()) + "] " + key;
+  std::string payload;
+  payload += char(key_with_type.size());
+  payload += key_with_type;
+  payload += value;
+  return WriteMessage(kULogInfo, payload.data(), payload.size(), true);
+}
+
+bool uorb::logger::ULogWriter::WriteFormat(const orb_metadata &meta,
+                                           bool strip_padding,
+                                           std::set<std::string> *written) {
+  if (!written->insert(meta.o_name).second) return true;
+
+  auto fields = SplitFields(meta.o_fields);
+
+  // The data messages do not contain the padding at the end
+  if (strip_padding) {
+    while (!fields.empty() &&
+           fields.back().find(" _padding") != std::string::npos) {
+      fields.pop_back();
+    }
+  }
+
+  std::string format = std::string(meta.o_name) + ":";
+  for (const auto &field : fields) {
+    format += field + ";";
+
+    // Nested types need their own format definition
+    auto type = field.substr(0, field.find_first_of("[ "));
+    auto is_basic_type =
+        std::any_of(std::begin(kULogBasicTypes), std::end(kULogBasicTypes),
+                    [&](const char *basic) { return type == basic; });
+    if (is_basic_type) continue;
+
+    for (size_t i = 0; i < config_.topic_count; ++i) {
+      if (type == config_.topics[i]->o_name &&
+          !WriteFormat(*config_.topics[i], false, written)) {
+        return false;
+      }
+    }
+  }
+
+  return WriteMessage(kULogFormat, format.data(), format.size(), true);
+}
+
+bool uorb::logger::ULogWriter::WriteDefinitions(
+    const std::vector<const orb_metadata *> &topics) {
+  // File header
+  uint8_t header[16]{};
+  memcpy(header, kULogMagic, sizeof(kULogMagic));
+  header[7] = kULogVersion;
+  uint64_t timestamp = orb_absolute_time_us();
+  memcpy(header + 8, &timestamp, sizeof(timestamp));
+
+  auto dst = Reserve(sizeof(header), true);
+  memcpy(dst, header, sizeof(header));
+  buffer_used_ += sizeof(header);
+
+  // Flag bits: no compat/incompat flags, no appended data
+  uint8_t flag_bits[8 + 8 + 3 * 8]{};
+  if (!WriteMessage(kULogFlagBits, flag_bits, sizeof(flag_bits), true)) {
+    return false;
+  }
+
+  std::set<std::string> written;
+  for (auto meta : topics) {
+    if (!WriteFormat(*meta, true, &written)) return false;
+  }
+
+  return WriteInfo("sys_name", "uORB") &&
+         WriteInfo("ver_sw", orb_version());
+}
+
+void uorb::logger::ULogWriter::OnSubscribed(const Subscription &sub) {
+  // uint8 multi_id, uint16 msg_id, char[] message_name
+  std::string payload;
+  payload += char(sub.instance);
+  payload.append(reinterpret_cast<const char *>(&sub.index),
+                 sizeof(sub.index));
+  payload += sub.meta->o_name;
+  WriteMessage(kULogAddLogged, payload.data(), payload.size(), true);
+}
+
+void uorb::logger::ULogWriter::Drain(const Subscription &sub) {
+  const auto &meta = *sub.meta;
+  const uint32_t payload_size = sizeof(sub.index) + DataSize(meta);
+
+  while (orb_check_update(sub.handle)) {
+    // The whole message is copied, but only the part without padding is kept
+    uint8_t *dst = nullptr;
+    if (!dropout_start_us_ || WriteDropout()) {
+      dst = Reserve(kULogMessageHeaderSize + sizeof(sub.index) + meta.o_size,
+                    false);
+    }
+    if (!dst) {
+      // The I/O thread is behind, consume the message and count it
+      orb_copy(sub.handle, scratch_.data());
+      ++dropped_;
+      if (!dropout_start_us_) dropout_start_us_ = orb_absolute_time_us();
+      continue;
+    }
+
+    auto payload = PutMessageHeader(dst, payload_size, kULogData);
+    memcpy(payload, &sub.index, sizeof(sub.index));
+    if (!orb_copy(sub.handle, payload + sizeof(sub.index))) break;
+
+    buffer_used_ += kULogMessageHeaderSize + payload_size;
+    ++messages_;
+  }
+}
+
+bool uorb::logger::ULogWriter::WriteDropout() {
+  uint16_t duration_ms = std::min<uint64_t>(
+      orb_elapsed_time_us(dropout_start_us_) / 1000, UINT16_MAX);
+  if (!WriteMessage(kULogDropout, &duration_ms, sizeof(duration_ms), false)) {
+    return false;
+  }
+  dropout_start_us_ = 0;
+  return true;
+}
+
+void uorb::logger::ULogWriter::OnPeriodic() {
+  WriteMessage(kULogSync, kULogSyncMagic, sizeof(kULogSyncMagic), false);
+  SubmitCurrentBuffer();
+}
+
+void uorb::logger::ULogWriter::OnStopped() {
+  SubmitCurrentBuffer();
+  if (buffer_) writer_->Release(buffer_);
+  buffer_ = nullptr;
+}
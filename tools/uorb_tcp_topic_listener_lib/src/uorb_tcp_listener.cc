@@ -7,9 +7,13 @@
 #include <uorb/abs_time.h>
 #include <uorb/uorb.h>
 
+#include <cerrno>
+#include <cinttypes>
 #include <csignal>
+#include <cstdlib>
 #include <thread>
 #include <utility>
+#include <vector>
 
 #include "command_manager.h"
 #include "data_printer.h"
@@ -102,8 +106,9 @@ static void CmdStatus(uorb::listener::Fd &fd,
                       const std::vector<std::string> &) {
   char send_buffer[256];
   snprintf(send_buffer, sizeof(send_buffer),
-           "%-20s %-10s %-10s %-10s %-10s %-10s\n", "topic", "instance",
-           "queue", "sub", "pub", "index");
+           "%-20s %-10s %-10s %-10s %-10s %-10s %-10s %-10s %-10s\n", "topic",
+           "instance", "queue", "sub", "pub", "index", "rate(Hz)", "lost",
+           "suppressed");
   fd.write(send_buffer);
 
   size_t orb_topics_count = 0;
@@ -119,15 +124,88 @@ static void CmdStatus(uorb::listener::Fd &fd,
         if (status.has_anonymous_publisher) pub_count_str += "+";
 
         snprintf(send_buffer, sizeof(send_buffer),
-                 "%-20s %-10zu %-10d %-10s %-10s %-10d\n", topics[i]->o_name,
-                 instance, status.queue_size, sub_count_str.c_str(),
-                 pub_count_str.c_str(), status.latest_data_index);
+                 "%-20s %-10zu %-10u %-10s %-10s %-10d %-10.1f %-10" PRIu64
+                 " %-10" PRIu64 "\n",
+                 topics[i]->o_name, instance, status.queue_size,
+                 sub_count_str.c_str(), pub_count_str.c_str(),
+                 status.latest_data_index, status.publish_rate_hz,
+                 status.lost_count, status.suppressed_count);
         fd.write(send_buffer);
       }
     }
   }
 }
 
+static void CmdLatency(uorb::listener::Fd &fd,
+                       const std::vector<std::string> &) {
+#ifndef UORB_LATENCY_STATS
+  fd.write("uorb is built without UORB_LATENCY_STATS\n");
+  return;
+#endif
+
+  orb_status status{};
+
+  char send_buffer[256];
+  snprintf(send_buffer, sizeof(send_buffer),
+           "%-20s %-10s %-10s %-10s %-10s %-10s %-10s %-10s\n", "topic",
+           "instance", "count", "mean(us)", "p50(us)", "p99(us)", "p99.9(us)",
+           "max(us)");
+  fd.write(send_buffer);
+
+  size_t orb_topics_count = 0;
+  auto topics = orb_get_topics(&orb_topics_count);
+  for (size_t i = 0; i < orb_topics_count; ++i) {
+    for (size_t instance = 0; instance < ORB_MULTI_MAX_INSTANCES; ++instance) {
+      const auto &latency = status.latency;
+      if (orb_get_topic_status(topics[i], instance, &status) &&
+          latency.count) {
+        snprintf(send_buffer, sizeof(send_buffer),
+                 "%-20s %-10zu %-10" PRIu64
+                 " %-10.1f %-10.1f %-10.1f %-10.1f %-10.1f\n",
+                 topics[i]->o_name, instance, latency.count,
+                 latency.mean_ns / 1e3, latency.p50_ns / 1e3,
+                 latency.p99_ns / 1e3, latency.p999_ns / 1e3,
+                 latency.max_ns / 1e3);
+        fd.write(send_buffer);
+      }
+    }
+  }
+}
+
+static void CmdLocks(uorb::listener::Fd &fd,
+                     const std::vector<std::string> &argv) {
+  if (orb_get_lock_status(nullptr, 0) < 0 && errno == ENOTSUP) {
+    fd.write("uorb is built without UORB_LOCK_STATS\n");
+    return;
+  }
+
+  // Most contended locks first, 20 by default
+  size_t max_count = 20;
+  if (!argv.empty()) max_count = strtoul(argv[0].c_str(), nullptr, 0);
+
+  std::vector<orb_lock_status> locks(max_count);
+  int count = orb_get_lock_status(locks.data(), locks.size());
+  if (count < 0) return;
+
+  char send_buffer[256];
+  snprintf(send_buffer, sizeof(send_buffer),
+           "%-20s %-10s %-10s %-10s %-10s %-10s %-10s %-10s\n", "topic",
+           "instance", "locks", "contended", "wait(us)", "max_wait",
+           "hold(us)", "max_hold");
+  fd.write(send_buffer);
+
+  for (int i = 0; i < count; ++i) {
+    const auto &lock = locks[i];
+    snprintf(send_buffer, sizeof(send_buffer),
+             "%-20s %-10u %-10" PRIu64 " %-10" PRIu64
+             " %-10.1f %-10.1f %-10.1f %-10.1f\n",
+             lock.name, lock.instance, lock.lock_count, lock.contended_count,
+             lock.wait_ns / 1e3, lock.max_wait_ns / 1e3, lock.hold_ns / 1e3,
+             lock.max_hold_ns / 1e3);
+    fd.write(send_buffer);
+  }
+}
+
 static void TcpSocketSendThread(
     int socket_fd, const uorb::listener::CommandManager &command_manager) {
   uorb::listener::Fd socket(socket_fd);
@@ -169,6 +247,11 @@ static void TcpServerThread(uint16_t port) {
   uorb::listener::CommandManager command_manager;
   command_manager.AddCommand("version", CmdGetVersion, "Print uorb version");
   command_manager.AddCommand("status", CmdStatus, "Print uorb status");
+  command_manager.AddCommand("latency", CmdLatency,
+                             "Print the publish to copy latency of topics");
+  command_manager.AddCommand("locks", CmdLocks,
+                             "Print the most contended topic locks, example: "
+                             "locks 10");
   command_manager.AddCommand("listener", CmdListener,
                              "topic listener, example: listener topic_name");
 